@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <alsa/asoundlib.h>
+#include "output.h"
+
+// Вывод напрямую в ALSA, без звукового сервера. Свой поток ждет, пока в
+// кольцевом буфере устройства освободится место, и источник пишет фреймы
+// прямо в отображенную память от snd_pcm_mmap_begin. Если устройство не
+// умеет mmap (часть плагинов), данные идут через snd_pcm_writei.
+// Все вызовы snd_pcm_* выполняются под mutex, fill - тоже
+
+#define ALSA_DEFAULT_DEVICE "default"
+#define ALSA_RETRY_NSEC 1000000         // Повторный запрос, если у источника не было данных
+#define ALSA_WAIT_MSEC 100
+
+static pthread_t thread;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond;
+static bool running = false;
+static bool waiting = false;            // Поток в snd_pcm_wait без блокировки
+static OutputConfig output_config;
+
+static snd_pcm_t* pcm = NULL;
+static bool use_mmap = false;
+static bool can_pause = false;
+static int spec_rate = 0;
+static int spec_channels = 0;
+static OutputFormat spec_format;
+static size_t frame_bytes = 0;
+static snd_pcm_uframes_t period_frames = 0;
+static void* staging = NULL;            // Буфер для snd_pcm_writei без mmap
+
+// Источник данных, меняется только под mutex
+static output_fill_fn fill_fn = NULL;
+static output_done_fn done_fn = NULL;
+static void* fill_data = NULL;
+static bool paused = false;
+static bool draining = false;
+
+static _Atomic uint64_t latency_usec = 0;
+static atomic_uint underruns = 0;
+
+static void wait_nsec(long nsec) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += nsec;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&cond, &mutex, &deadline);
+}
+
+// Восстановление после опустошения буфера или приостановки системы
+static bool recover(int err) {
+    if (err == -EPIPE) atomic_fetch_add(&underruns, 1);
+    return snd_pcm_recover(pcm, err, 1) == 0;
+}
+
+// Поток уходит в snd_pcm_wait без блокировки, чтобы не задерживать
+// паузу и остановку. Закрывать устройство можно только когда он вернулся
+static void wait_device(void) {
+    waiting = true;
+    pthread_mutex_unlock(&mutex);
+    snd_pcm_wait(pcm, ALSA_WAIT_MSEC);
+    pthread_mutex_lock(&mutex);
+    waiting = false;
+    pthread_cond_broadcast(&cond);
+}
+
+static void update_latency(void) {
+    snd_pcm_sframes_t delay;
+    if (snd_pcm_delay(pcm, &delay) == 0 && delay > 0) {
+        atomic_store(&latency_usec, (uint64_t)delay * 1000000 / spec_rate);
+    } else {
+        atomic_store(&latency_usec, 0);
+    }
+}
+
+// Источник закончился: ждем, пока устройство доиграет отданное.
+// snd_pcm_drain не используется - он блокирует до конца буфера
+static void finish_drain(void) {
+    snd_pcm_state_t state = snd_pcm_state(pcm);
+
+    // Короткий трек мог не набрать порог старта
+    if (state == SND_PCM_STATE_PREPARED) {
+        snd_pcm_start(pcm);
+        state = snd_pcm_state(pcm);
+    }
+
+    snd_pcm_sframes_t delay = 0;
+    if (state == SND_PCM_STATE_RUNNING && snd_pcm_delay(pcm, &delay) == 0 && delay > 0) {
+        long nsec = (long)(delay * 1000000000LL / spec_rate);
+        wait_nsec(nsec < ALSA_WAIT_MSEC * 1000000L ? nsec : ALSA_WAIT_MSEC * 1000000L);
+        update_latency();
+        return;
+    }
+
+    draining = false;
+    output_done_fn done = done_fn;
+    fill_fn = NULL;
+    done_fn = NULL;
+    if (done) done(fill_data);
+}
+
+// Одна порция записи: сколько влезает в буфер устройства
+static void write_output(void) {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+    if (avail < 0) {
+        if (!recover(avail)) {
+            output_done_fn done = done_fn;
+            fill_fn = NULL;
+            done_fn = NULL;
+            if (done) done(fill_data);
+        }
+        return;
+    }
+    if ((snd_pcm_uframes_t)avail < period_frames) {
+        // Буфер полон, а порог старта не достигнут: запускаем сами
+        if (snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED) snd_pcm_start(pcm);
+        wait_device();
+        return;
+    }
+
+    long got;
+    if (use_mmap) {
+        const snd_pcm_channel_area_t* areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = avail;
+        int err = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames);
+        if (err < 0) {
+            recover(err);
+            return;
+        }
+
+        // Interleaved: все каналы в одной области, шаг - целый фрейм
+        unsigned char* dst = (unsigned char*)areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8;
+        got = fill_fn(fill_data, dst, frames);
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, got > 0 ? got : 0);
+        if (committed < 0) recover(committed);
+    } else {
+        got = fill_fn(fill_data, staging, period_frames);
+        if (got > 0) {
+            snd_pcm_sframes_t written = snd_pcm_writei(pcm, staging, got);
+            if (written < 0) recover(written);
+        }
+    }
+
+    if (got == OUTPUT_END) {
+        draining = true;
+    } else if (got == 0) {
+        wait_nsec(ALSA_RETRY_NSEC);
+    }
+    update_latency();
+}
+
+static void* alsa_worker(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&mutex);
+
+    while (running) {
+        if (!pcm || !fill_fn || paused) {
+            pthread_cond_wait(&cond, &mutex);
+        } else if (draining) {
+            finish_drain();
+        } else {
+            write_output();
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+static void close_device(void) {
+    while (waiting) pthread_cond_wait(&cond, &mutex);
+    if (pcm) snd_pcm_close(pcm);
+    pcm = NULL;
+    free(staging);
+    staging = NULL;
+    spec_rate = 0;
+}
+
+static unsigned int config_usec(int ms, int fallback_ms) {
+    return (unsigned int)(ms > 0 ? ms : fallback_ms) * 1000;
+}
+
+// Открытие устройства с параметрами из output_config. Вызывается под mutex
+static bool open_device(int sample_rate, int channels) {
+    const char* device = output_config.device ? output_config.device : ALSA_DEFAULT_DEVICE;
+    int err = snd_pcm_open(&pcm, device, SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        fprintf(stderr, "ALSA: cannot open %s: %s\n", device, snd_strerror(err));
+        pcm = NULL;
+        return false;
+    }
+
+    snd_pcm_hw_params_t* hw;
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_hw_params_any(pcm, hw);
+
+    use_mmap = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+    if (!use_mmap && snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
+        close_device();
+        return false;
+    }
+
+    // Сначала форматы без потери разрядности, 16 бит в последнюю очередь
+    const snd_pcm_format_t formats[] = { SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE };
+    const OutputFormat output_formats[] = { OUTPUT_FORMAT_FLOAT32, OUTPUT_FORMAT_S32, OUTPUT_FORMAT_S16 };
+    const size_t sample_bytes[] = { 4, 4, 2 };
+    size_t chosen = sizeof(formats) / sizeof(formats[0]);
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (snd_pcm_hw_params_test_format(pcm, hw, formats[i]) == 0) {
+            chosen = i;
+            break;
+        }
+    }
+
+    unsigned int buffer_time = config_usec(output_config.tlength_ms, OUTPUT_DEFAULT_TLENGTH_MS);
+    unsigned int period_time = config_usec(output_config.minreq_ms, OUTPUT_DEFAULT_MINREQ_MS);
+
+    // Частота только точная: передискретизацию делает plughw, если его выбрали явно
+    if (chosen == sizeof(formats) / sizeof(formats[0]) ||
+        snd_pcm_hw_params_set_format(pcm, hw, formats[chosen]) < 0 ||
+        snd_pcm_hw_params_set_channels(pcm, hw, channels) < 0 ||
+        snd_pcm_hw_params_set_rate(pcm, hw, sample_rate, 0) < 0 ||
+        snd_pcm_hw_params_set_buffer_time_near(pcm, hw, &buffer_time, NULL) < 0 ||
+        snd_pcm_hw_params_set_period_time_near(pcm, hw, &period_time, NULL) < 0 ||
+        (err = snd_pcm_hw_params(pcm, hw)) < 0) {
+        fprintf(stderr, "ALSA: %s does not support %d Hz, %d channels\n", device, sample_rate, channels);
+        close_device();
+        return false;
+    }
+
+    snd_pcm_uframes_t buffer_frames;
+    snd_pcm_hw_params_get_period_size(hw, &period_frames, NULL);
+    snd_pcm_hw_params_get_buffer_size(hw, &buffer_frames);
+    can_pause = snd_pcm_hw_params_can_pause(hw);
+
+    // Порог старта - prebuf, по умолчанию почти полный буфер
+    snd_pcm_uframes_t start_threshold = buffer_frames - period_frames;
+    if (output_config.prebuf_ms >= 0) {
+        start_threshold = (snd_pcm_uframes_t)sample_rate * output_config.prebuf_ms / 1000;
+        if (start_threshold < 1) start_threshold = 1;
+        if (start_threshold > buffer_frames - period_frames) start_threshold = buffer_frames - period_frames;
+    }
+
+    snd_pcm_sw_params_t* sw;
+    snd_pcm_sw_params_alloca(&sw);
+    snd_pcm_sw_params_current(pcm, sw);
+    snd_pcm_sw_params_set_start_threshold(pcm, sw, start_threshold);
+    snd_pcm_sw_params_set_avail_min(pcm, sw, period_frames);
+    if (snd_pcm_sw_params(pcm, sw) < 0) {
+        close_device();
+        return false;
+    }
+
+    frame_bytes = sample_bytes[chosen] * channels;
+    if (!use_mmap) {
+        staging = malloc(period_frames * frame_bytes);
+        if (!staging) {
+            close_device();
+            return false;
+        }
+    }
+
+    spec_rate = sample_rate;
+    spec_channels = channels;
+    spec_format = output_formats[chosen];
+    return true;
+}
+
+static bool alsa_init(const OutputConfig* config) {
+    output_config = *config;
+    running = true;
+    atomic_store(&underruns, 0);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&thread, NULL, alsa_worker, NULL) != 0) {
+        pthread_cond_destroy(&cond);
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+static void alsa_shutdown(void) {
+    pthread_mutex_lock(&mutex);
+    running = false;
+    fill_fn = NULL;
+    done_fn = NULL;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+
+    pthread_mutex_lock(&mutex);
+    close_device();
+    pthread_mutex_unlock(&mutex);
+    pthread_cond_destroy(&cond);
+}
+
+static bool alsa_start(int sample_rate, int channels, output_fill_fn fill,
+                       output_done_fn done, void* userdata, OutputFormat* format) {
+    pthread_mutex_lock(&mutex);
+
+    fill_fn = NULL;
+    done_fn = NULL;
+
+    bool reuse = pcm && spec_rate == sample_rate && spec_channels == channels;
+    if (reuse) {
+        // Устройство осталось от прошлого трека: старые данные уже не нужны
+        snd_pcm_drop(pcm);
+        snd_pcm_prepare(pcm);
+    } else {
+        close_device();
+        open_device(sample_rate, channels);
+    }
+
+    bool ok = pcm != NULL;
+    if (ok) {
+        fill_fn = fill;
+        done_fn = done;
+        fill_data = userdata;
+        paused = false;
+        draining = false;
+        *format = spec_format;
+        pthread_cond_broadcast(&cond);
+    }
+
+    pthread_mutex_unlock(&mutex);
+    return ok;
+}
+
+static void alsa_stop(void) {
+    pthread_mutex_lock(&mutex);
+    fill_fn = NULL;
+    done_fn = NULL;
+    fill_data = NULL;
+    draining = false;
+    if (pcm) {
+        snd_pcm_drop(pcm);
+        snd_pcm_prepare(pcm);
+    }
+    atomic_store(&latency_usec, 0);
+    pthread_mutex_unlock(&mutex);
+}
+
+// Без аппаратной паузы буфер сбрасывается, и после продолжения
+// устройство снова набирает порог старта
+static void alsa_pause(bool pause) {
+    pthread_mutex_lock(&mutex);
+    if (pcm && pause != paused) {
+        if (can_pause && snd_pcm_state(pcm) != SND_PCM_STATE_PREPARED) {
+            snd_pcm_pause(pcm, pause);
+        } else if (pause) {
+            snd_pcm_drop(pcm);
+            snd_pcm_prepare(pcm);
+        }
+    }
+    paused = pause;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+static void alsa_flush(void) {
+    pthread_mutex_lock(&mutex);
+    if (pcm) {
+        // Во время паузы поток все равно не пишет, пока ее не снимут
+        snd_pcm_drop(pcm);
+        snd_pcm_prepare(pcm);
+    }
+    atomic_store(&latency_usec, 0);
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+static uint64_t alsa_latency_usec(void) {
+    return atomic_load(&latency_usec);
+}
+
+static unsigned alsa_underruns(void) {
+    return atomic_load(&underruns);
+}
+
+const OutputBackend alsa_output = {
+    .name = "alsa",
+    .init = alsa_init,
+    .shutdown = alsa_shutdown,
+    .start = alsa_start,
+    .stop = alsa_stop,
+    .pause = alsa_pause,
+    .flush = alsa_flush,
+    .latency_usec = alsa_latency_usec,
+    .underruns = alsa_underruns
+};
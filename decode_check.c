@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "registry.h"
+
+// Проверка параллельного декодирования: decoder_decode_all должен дать
+// побитно те же отсчеты, что последовательное чтение через decoder_read.
+// Тестовый сигнал генерируется здесь же, кодируют его внешние lame и flac (make check)
+
+#define CHECK_RATE 44100
+#define CHECK_CHANNELS 2
+#define READ_CHUNK_FRAMES 4096
+
+// xorshift32: шум должен повторяться от запуска к запуску
+static uint32_t noise_state = 0x12345678u;
+
+static float noise(void) {
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    return (float)noise_state / 2147483648.0f - 1.0f;
+}
+
+// Отсчет в bits разрядов, little-endian
+static void put_sample(FILE* file, float value, int bits) {
+    int32_t sample = (int32_t)lrintf(value * (float)((1 << (bits - 1)) - 1));
+    for (int i = 0; i < bits / 8; i++) fputc((sample >> (8 * i)) & 0xFF, file);
+}
+
+static void put_u32(FILE* file, uint32_t value) {
+    for (int i = 0; i < 4; i++) fputc((value >> (8 * i)) & 0xFF, file);
+}
+
+static void put_u16(FILE* file, uint16_t value) {
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+// Сигнал, на котором MP3 кодер использует и короткие блоки, и bit reservoir,
+// и joint stereo: логарифмический свип, щелчки шума каждые полсекунды
+// и правый канал, частично совпадающий с левым
+static int generate(const char* path, int seconds, int bits) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+
+    uint32_t frames = (uint32_t)CHECK_RATE * seconds;
+    uint32_t data_size = frames * CHECK_CHANNELS * (bits / 8);
+    fwrite("RIFF", 1, 4, file);
+    put_u32(file, 36 + data_size);
+    fwrite("WAVEfmt ", 1, 8, file);
+    put_u32(file, 16);
+    put_u16(file, 1);
+    put_u16(file, CHECK_CHANNELS);
+    put_u32(file, CHECK_RATE);
+    put_u32(file, CHECK_RATE * CHECK_CHANNELS * (bits / 8));
+    put_u16(file, CHECK_CHANNELS * (bits / 8));
+    put_u16(file, bits);
+    fwrite("data", 1, 4, file);
+    put_u32(file, data_size);
+
+    double phase = 0.0;
+    for (uint32_t i = 0; i < frames; i++) {
+        double t = (double)i / CHECK_RATE;
+        double freq = 50.0 * pow(200.0, fmod(t, 20.0) / 20.0);
+        phase += 2.0 * M_PI * freq / CHECK_RATE;
+
+        uint32_t in_burst = i % (CHECK_RATE / 2);
+        float burst = in_burst < CHECK_RATE / 100 ? 0.4f * noise() : 0.0f;
+        float left = 0.35f * (float)sin(phase) + burst + 0.02f * noise();
+        float right = 0.6f * left + 0.25f * (float)sin(2.0 * M_PI * 330.0 * t) + 0.02f * noise();
+
+        put_sample(file, left, bits);
+        put_sample(file, right, bits);
+    }
+
+    return fclose(file) == 0 ? 0 : 1;
+}
+
+static const char* mode_name(int mode) {
+    switch (mode) {
+        case DECODE_ALL_PARALLEL: return "parallel";
+        case DECODE_ALL_FALLBACK: return "serial fallback";
+        default: return "serial";
+    }
+}
+
+// Весь файл через decoder_read. Возвращает число фреймов, <0 при ошибке
+static long decode_serial(const DecoderPlugin* plugin, const char* path, float** pcm, StreamInfo* info) {
+    DecoderStream* stream = plugin->open(path, info);
+    if (!stream) return -1;
+
+    size_t capacity = info->total_frames > 0 ? info->total_frames : (size_t)info->sample_rate * 60;
+    *pcm = malloc(capacity * info->channels * sizeof(float));
+    long total = 0;
+    long got = 0;
+
+    while (*pcm) {
+        if ((size_t)total + READ_CHUNK_FRAMES > capacity) {
+            capacity *= 2;
+            float* grown = realloc(*pcm, capacity * info->channels * sizeof(float));
+            if (!grown) break;
+            *pcm = grown;
+        }
+        got = plugin->read(stream, *pcm + total * info->channels, READ_CHUNK_FRAMES);
+        if (got <= 0) break;
+        total += got;
+    }
+
+    plugin->close(stream);
+    return *pcm && got == 0 ? total : -1;
+}
+
+static int compare(const char* plugin_dir, const char* path, int threads) {
+    if (registry_load(plugin_dir) == 0) {
+        fprintf(stderr, "No decoder plugins in %s\n", plugin_dir);
+        return 1;
+    }
+
+    const DecoderPlugin* plugin = registry_find(path);
+    if (!plugin || !plugin->decode_all) {
+        fprintf(stderr, "%s: no plugin with decoder_decode_all\n", path);
+        return 1;
+    }
+
+    StreamInfo info;
+    float* serial = NULL;
+    long serial_frames = decode_serial(plugin, path, &serial, &info);
+    if (serial_frames <= 0) {
+        fprintf(stderr, "%s: serial decode failed\n", path);
+        free(serial);
+        return 1;
+    }
+
+    // С запасом: decode_all не должен выдать больше, чем поток
+    uint64_t capacity = (uint64_t)serial_frames + info.sample_rate;
+    float* parallel = calloc(capacity * info.channels, sizeof(float));
+    DecodeAllOptions options = { .threads = threads };
+    long parallel_frames = parallel ? plugin->decode_all(path, parallel, capacity, &options) : -1;
+
+    int status = 0;
+    printf("%s: %ld frames, %s", path, serial_frames, mode_name(options.mode));
+    if (parallel_frames != serial_frames) {
+        printf(", length differs: %ld\n", parallel_frames);
+        status = 1;
+    } else if (options.mode != DECODE_ALL_PARALLEL) {
+        // Без отрезков проверять нечего, а откат значит, что стык разошелся
+        printf(", expected a segmented decode\n");
+        status = 1;
+    } else {
+        size_t samples = (size_t)serial_frames * info.channels;
+        size_t i = 0;
+        while (i < samples && memcmp(&serial[i], &parallel[i], sizeof(float)) == 0) i++;
+        if (i < samples) {
+            long frame = (long)(i / info.channels);
+            printf(", first difference at frame %ld (%.3f s)\n", frame, (double)frame / info.sample_rate);
+            status = 1;
+        } else {
+            printf(", identical\n");
+        }
+    }
+
+    free(serial);
+    free(parallel);
+    registry_unload();
+    return status;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 5 && strcmp(argv[1], "generate") == 0) {
+        int bits = atoi(argv[4]);
+        if (bits != 16 && bits != 24) {
+            fprintf(stderr, "Bits must be 16 or 24\n");
+            return 2;
+        }
+        return generate(argv[2], atoi(argv[3]), bits);
+    }
+    if (argc == 5 && strcmp(argv[1], "compare") == 0) {
+        return compare(argv[2], argv[3], atoi(argv[4]));
+    }
+
+    fprintf(stderr, "Usage: %s generate OUT.wav SECONDS 16|24\n"
+                    "       %s compare PLUGIN_DIR FILE THREADS\n", argv[0], argv[0]);
+    return 2;
+}
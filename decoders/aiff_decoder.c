@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "decoder_api.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AIFF_X86 1
+#endif
+
+typedef struct {
+    int16_t* pcm_data;
+    uint32_t samples_count;
+    int sample_rate;
+    int channels;
+} AudioData;
+
+// Файл, отображенный в память целиком
+typedef struct {
+    unsigned char* map;
+    size_t map_size;
+    const unsigned char* pcm;   // Начало отсчетов внутри SSND
+    uint64_t data_size;
+    int sample_rate;
+    int channels;
+    int bits_per_sample;
+    int frame_size;
+    int little_endian;          // AIFC 'sowt'
+    int is_float;               // AIFC 'fl32'
+    uint64_t total_frames;
+} AiffFile;
+
+static uint16_t read_be16(const unsigned char* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t read_be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Частота в AIFF хранится как 80-битное расширенное число с плавающей точкой
+static double read_extended(const unsigned char* p) {
+    int exponent = ((p[0] & 0x7F) << 8) | p[1];
+    uint64_t mantissa = 0;
+    for (int i = 0; i < 8; i++) mantissa = (mantissa << 8) | p[2 + i];
+
+    if (exponent == 0 && mantissa == 0) return 0.0;
+    double value = ldexp((double)mantissa, exponent - 16383 - 63);
+    return (p[0] & 0x80) ? -value : value;
+}
+
+// Ядра преобразования big-endian отсчетов в float [-1, 1].
+// Выбираются один раз при загрузке плагина по возможностям процессора
+
+#define S16_SCALE (1.0f / 32768.0f)
+#define S32_SCALE (1.0f / 2147483648.0f)
+
+typedef void (*convert_fn)(const unsigned char* src, float* dst, size_t samples);
+
+static void s16be_scalar(const unsigned char* src, float* dst, size_t samples) {
+    for (size_t i = 0; i < samples; i++) dst[i] = (int16_t)read_be16(src + i * 2) * S16_SCALE;
+}
+
+static void s24be_scalar(const unsigned char* src, float* dst, size_t samples) {
+    // 24 бита в старших разрядах int32
+    for (size_t i = 0; i < samples; i++) {
+        const unsigned char* p = src + i * 3;
+        int32_t value = (int32_t)((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8);
+        dst[i] = value * S32_SCALE;
+    }
+}
+
+static void s32be_scalar(const unsigned char* src, float* dst, size_t samples) {
+    for (size_t i = 0; i < samples; i++) dst[i] = (int32_t)read_be32(src + i * 4) * S32_SCALE;
+}
+
+#ifdef AIFF_X86
+
+__attribute__((target("ssse3")))
+static void s16be_ssse3(const unsigned char* src, float* dst, size_t samples) {
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    size_t i = 0;
+
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 2)), mask);
+        // Знаковое расширение int16 -> int32
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    s16be_scalar(src + i * 2, dst + i, samples - i);
+}
+
+__attribute__((target("ssse3")))
+static void s24be_ssse3(const unsigned char* src, float* dst, size_t samples) {
+    // 4 отсчета по 3 байта в старшие байты 32-битных слов, младший обнуляется
+    const __m128i mask = _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+    const __m128 scale = _mm_set1_ps(S32_SCALE);
+    size_t i = 0;
+
+    // Загрузка читает 16 байт, а использует 12, поэтому нужен запас
+    for (; i + 6 <= samples; i += 4) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 3)), mask);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    s24be_scalar(src + i * 3, dst + i, samples - i);
+}
+
+__attribute__((target("ssse3")))
+static void s32be_ssse3(const unsigned char* src, float* dst, size_t samples) {
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128 scale = _mm_set1_ps(S32_SCALE);
+    size_t i = 0;
+
+    for (; i + 4 <= samples; i += 4) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 4)), mask);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    s32be_scalar(src + i * 4, dst + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void s16be_avx2(const unsigned char* src, float* dst, size_t samples) {
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const __m256 scale = _mm256_set1_ps(S16_SCALE);
+    size_t i = 0;
+
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 2)), mask);
+        __m256i wide = _mm256_cvtepi16_epi32(v);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(wide), scale));
+    }
+    s16be_scalar(src + i * 2, dst + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void s24be_avx2(const unsigned char* src, float* dst, size_t samples) {
+    // pshufb работает внутри 128-битных половин: в каждую по 4 отсчета
+    const __m256i mask = _mm256_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9,
+                                          -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+    const __m256 scale = _mm256_set1_ps(S32_SCALE);
+    size_t i = 0;
+
+    for (; i + 10 <= samples; i += 8) {
+        const unsigned char* p = src + i * 3;
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+                                            _mm_loadu_si128((const __m128i*)(p + 12)), 1);
+        v = _mm256_shuffle_epi8(v, mask);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    s24be_ssse3(src + i * 3, dst + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void s32be_avx2(const unsigned char* src, float* dst, size_t samples) {
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256 scale = _mm256_set1_ps(S32_SCALE);
+    size_t i = 0;
+
+    for (; i + 8 <= samples; i += 8) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + i * 4)), mask);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    s32be_scalar(src + i * 4, dst + i, samples - i);
+}
+
+#endif
+
+static convert_fn convert_s16be = s16be_scalar;
+static convert_fn convert_s24be = s24be_scalar;
+static convert_fn convert_s32be = s32be_scalar;
+
+__attribute__((constructor))
+static void aiff_select_kernels(void) {
+#ifdef AIFF_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        convert_s16be = s16be_avx2;
+        convert_s24be = s24be_avx2;
+        convert_s32be = s32be_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        convert_s16be = s16be_ssse3;
+        convert_s24be = s24be_ssse3;
+        convert_s32be = s32be_ssse3;
+    }
+#endif
+}
+
+// Редкие варианты: 8 бит, little-endian 'sowt', float
+static void convert_generic(const AiffFile* aiff, const unsigned char* src, float* dst, size_t samples) {
+    int bytes = aiff->bits_per_sample / 8;
+
+    for (size_t i = 0; i < samples; i++) {
+        const unsigned char* p = src + i * bytes;
+
+        if (aiff->is_float) {
+            uint32_t bits = read_be32(p);
+            memcpy(&dst[i], &bits, 4);
+        } else if (bytes == 1) {
+            dst[i] = (int8_t)p[0] * (1.0f / 128);
+        } else {
+            // Little-endian: собираем отсчет в старших разрядах int32
+            uint32_t value = 0;
+            for (int b = 0; b < bytes; b++) value |= (uint32_t)p[b] << (32 - 8 * bytes + 8 * b);
+            dst[i] = (int32_t)value * S32_SCALE;
+        }
+    }
+}
+
+static void aiff_convert(const AiffFile* aiff, const unsigned char* src, float* dst, size_t samples) {
+    if (aiff->is_float || aiff->little_endian || aiff->bits_per_sample == 8) {
+        convert_generic(aiff, src, dst, samples);
+        return;
+    }
+
+    switch (aiff->bits_per_sample) {
+        case 16: convert_s16be(src, dst, samples); break;
+        case 24: convert_s24be(src, dst, samples); break;
+        case 32: convert_s32be(src, dst, samples); break;
+    }
+}
+
+static void aiff_unmap(AiffFile* aiff) {
+    if (aiff->map) munmap(aiff->map, aiff->map_size);
+    aiff->map = NULL;
+}
+
+// Отображение файла и разбор чанков FORM. 0 при успехе
+static int aiff_map(const char* filename, AiffFile* aiff) {
+    memset(aiff, 0, sizeof(AiffFile));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+        close(fd);
+        return -1;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    aiff->map = map;
+    aiff->map_size = st.st_size;
+    madvise(aiff->map, aiff->map_size, MADV_SEQUENTIAL);
+
+    const unsigned char* p = aiff->map;
+    const unsigned char* end = aiff->map + aiff->map_size;
+
+    int is_aifc = memcmp(p + 8, "AIFC", 4) == 0;
+    if (memcmp(p, "FORM", 4) != 0 || (!is_aifc && memcmp(p + 8, "AIFF", 4) != 0)) {
+        aiff_unmap(aiff);
+        return -1;
+    }
+
+    int have_comm = 0;
+    int supported = 1;
+    uint64_t declared_frames = 0;
+
+    p += 12;
+    while (end - p >= 8) {
+        uint32_t chunk_size = read_be32(p + 4);
+        const unsigned char* body = p + 8;
+        uint64_t available = end - body;
+
+        if (memcmp(p, "COMM", 4) == 0 && chunk_size >= 18 && available >= 18) {
+            aiff->channels = read_be16(body);
+            declared_frames = read_be32(body + 2);
+            aiff->bits_per_sample = read_be16(body + 6);
+            aiff->sample_rate = (int)read_extended(body + 8);
+
+            if (is_aifc && chunk_size >= 22 && available >= 22) {
+                const unsigned char* compression = body + 18;
+                if (memcmp(compression, "sowt", 4) == 0) {
+                    aiff->little_endian = 1;
+                } else if (memcmp(compression, "fl32", 4) == 0 || memcmp(compression, "FL32", 4) == 0) {
+                    aiff->is_float = 1;
+                } else if (memcmp(compression, "NONE", 4) != 0 && memcmp(compression, "twos", 4) != 0) {
+                    supported = 0; // Сжатые варианты (ima4, ulaw, ...) не поддерживаем
+                }
+            }
+            have_comm = 1;
+        } else if (memcmp(p, "SSND", 4) == 0 && chunk_size >= 8 && available >= 8) {
+            uint32_t offset = read_be32(body);
+            uint64_t size = chunk_size < available ? chunk_size : available;
+            if (8 + (uint64_t)offset <= size) {
+                aiff->pcm = body + 8 + offset;
+                aiff->data_size = size - 8 - offset;
+            }
+        }
+
+        uint64_t step = 8 + (uint64_t)chunk_size + (chunk_size & 1);
+        if (step > (uint64_t)(end - p)) break;
+        p += step;
+    }
+
+    // Отсчеты короче байта дополняются до целых байт
+    aiff->bits_per_sample = (aiff->bits_per_sample + 7) / 8 * 8;
+    aiff->frame_size = aiff->channels * aiff->bits_per_sample / 8;
+
+    if (!have_comm || !supported || !aiff->pcm || aiff->channels <= 0 || aiff->sample_rate <= 0 ||
+        aiff->bits_per_sample < 8 || aiff->bits_per_sample > 32 ||
+        (aiff->is_float && aiff->bits_per_sample != 32)) {
+        aiff_unmap(aiff);
+        return -1;
+    }
+
+    aiff->total_frames = aiff->data_size / aiff->frame_size;
+    if (declared_frames > 0 && declared_frames < aiff->total_frames) {
+        aiff->total_frames = declared_frames;
+    }
+
+    return 0;
+}
+
+// Полное декодирование
+
+AudioData* decode_aiff(const char* filename) {
+    AiffFile aiff;
+    if (aiff_map(filename, &aiff) != 0) return NULL;
+
+    AudioData* audio = malloc(sizeof(AudioData));
+    if (!audio) {
+        aiff_unmap(&aiff);
+        return NULL;
+    }
+
+    size_t samples = aiff.total_frames * aiff.channels;
+    audio->sample_rate = aiff.sample_rate;
+    audio->channels = aiff.channels;
+    audio->samples_count = samples;
+    audio->pcm_data = malloc(samples * sizeof(int16_t));
+
+    if (!audio->pcm_data) {
+        free(audio);
+        aiff_unmap(&aiff);
+        return NULL;
+    }
+
+    // Старый интерфейс отдает int16: переводим порциями через float
+    float chunk[4096];
+    int bytes = aiff.bits_per_sample / 8;
+    for (size_t done = 0; done < samples; ) {
+        size_t count = samples - done < 4096 ? samples - done : 4096;
+        aiff_convert(&aiff, aiff.pcm + done * bytes, chunk, count);
+        for (size_t i = 0; i < count; i++) {
+            float value = chunk[i] * 32768.0f;
+            if (value > 32767.0f) value = 32767.0f;
+            else if (value < -32768.0f) value = -32768.0f;
+            audio->pcm_data[done + i] = (int16_t)lrintf(value);
+        }
+        done += count;
+    }
+    aiff_unmap(&aiff);
+
+    return audio;
+}
+
+void free_audio_data(AudioData* audio) {
+    if (audio) {
+        free(audio->pcm_data);
+        free(audio);
+    }
+}
+
+// Потоковый интерфейс
+
+struct DecoderStream {
+    AiffFile aiff;
+    uint64_t position;
+};
+
+DecoderStream* decoder_open(const char* filename, StreamInfo* info) {
+    DecoderStream* stream = calloc(1, sizeof(DecoderStream));
+    if (!stream) return NULL;
+
+    if (aiff_map(filename, &stream->aiff) != 0) {
+        free(stream);
+        return NULL;
+    }
+
+    info->sample_rate = stream->aiff.sample_rate;
+    info->channels = stream->aiff.channels;
+    info->total_frames = stream->aiff.total_frames;
+
+    return stream;
+}
+
+long decoder_read(DecoderStream* stream, float* buffer, long frames) {
+    AiffFile* aiff = &stream->aiff;
+    uint64_t left = aiff->total_frames - stream->position;
+    if ((uint64_t)frames > left) frames = left;
+    if (frames <= 0) return 0;
+
+    const unsigned char* src = aiff->pcm + stream->position * aiff->frame_size;
+    aiff_convert(aiff, src, buffer, frames * aiff->channels);
+
+    stream->position += frames;
+    return frames;
+}
+
+int decoder_seek(DecoderStream* stream, uint64_t frame) {
+    if (frame > stream->aiff.total_frames) frame = stream->aiff.total_frames;
+    stream->position = frame;
+    return 0;
+}
+
+void decoder_close(DecoderStream* stream) {
+    if (!stream) return;
+
+    aiff_unmap(&stream->aiff);
+    free(stream);
+}
+
+int decoder_probe(const unsigned char* header, size_t size, const char* filename) {
+    (void)filename;
+    if (size >= 12 && memcmp(header, "FORM", 4) == 0 &&
+        (memcmp(header + 8, "AIFF", 4) == 0 || memcmp(header + 8, "AIFC", 4) == 0)) {
+        return 100;
+    }
+    return 0;
+}
+
+// Отсчеты берутся из отображенного в память файла
+int decoder_flags(void) {
+    return DECODER_FLAG_DIRECT;
+}
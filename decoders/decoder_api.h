@@ -0,0 +1,101 @@
+#ifndef DECODER_API_H
+#define DECODER_API_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Потоковый интерфейс декодеров.
+// Каждый плагин экспортирует одинаковые имена decoder_*, плеер получает их через dlsym.
+// Память на трек постоянна: данные читаются порциями в буфер вызывающего.
+// Отсчеты отдаются как float в диапазоне [-1, 1] без потери разрядности,
+// в 16 бит плеер переводит только на выходе.
+
+typedef struct {
+    int sample_rate;
+    int channels;
+    uint64_t total_frames;  // 0 если длина неизвестна
+} StreamInfo;
+
+typedef struct DecoderStream DecoderStream;
+
+// Значения ReplayGain из тегов файла. Отсутствующие поля - NAN
+typedef struct {
+    float track_gain;       // дБ
+    float track_peak;       // Линейный, 1.0 - полная шкала
+    float album_gain;
+    float album_peak;
+} ReplayGainInfo;
+
+// Параметры и итог decoder_decode_all
+typedef struct {
+    int threads;            // Сколько потоков можно занять, 1 - подряд
+    int mode;               // Заполняет плагин: DECODE_ALL_*
+    // Необязательная: плагин опрашивает ее между порциями декодирования
+    // и при ненулевом ответе бросает файл с ошибкой
+    int (*cancelled)(void* context);
+    void* context;
+} DecodeAllOptions;
+
+typedef DecoderStream* (*decoder_open_fn)(const char* filename, StreamInfo* info);
+typedef long (*decoder_read_fn)(DecoderStream* stream, float* buffer, long frames);
+typedef int (*decoder_seek_fn)(DecoderStream* stream, uint64_t frame);
+typedef void (*decoder_close_fn)(DecoderStream* stream);
+typedef int (*decoder_probe_fn)(const unsigned char* header, size_t size, const char* filename);
+typedef int (*decoder_init_fn)(void);
+typedef void (*decoder_shutdown_fn)(void);
+typedef int (*decoder_replaygain_fn)(DecoderStream* stream, ReplayGainInfo* info);
+typedef int (*decoder_flags_fn)(void);
+typedef long (*decoder_decode_all_fn)(const char* filename, float* pcm, uint64_t frames, DecodeAllOptions* options);
+
+#define DECODER_PROBE_SIZE 512  // Сколько байт начала файла получает decoder_probe
+
+// Биты decoder_flags
+#define DECODER_FLAG_DIRECT 0x01  // PCM читается прямо из файла, кэш декодированного не ускорит
+
+// Как decoder_decode_all декодировал файл
+#define DECODE_ALL_SERIAL   0   // Подряд: файл короткий или поток один
+#define DECODE_ALL_PARALLEL 1   // Отрезками, стыки совпали с последовательным декодированием
+#define DECODE_ALL_FALLBACK 2   // Отрезки не сошлись, весь файл декодирован заново подряд
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Открывает файл и заполняет info. NULL при ошибке
+DecoderStream* decoder_open(const char* filename, StreamInfo* info);
+
+// Читает до frames фреймов (interleaved float). Возвращает число фреймов, 0 в конце, <0 при ошибке
+long decoder_read(DecoderStream* stream, float* buffer, long frames);
+
+// Перемотка на абсолютный фрейм. 0 при успехе
+int decoder_seek(DecoderStream* stream, uint64_t frame);
+
+void decoder_close(DecoderStream* stream);
+
+// Оценка, насколько файл подходит плагину, по первым байтам: 0 - не наш, 100 - точно наш.
+// Плеер выбирает плагин с наибольшей оценкой
+int decoder_probe(const unsigned char* header, size_t size, const char* filename);
+
+// Необязательные: однократная инициализация библиотеки кодека при загрузке плагина
+// (0 при успехе) и освобождение кэшированных контекстов при выгрузке
+int decoder_init(void);
+void decoder_shutdown(void);
+
+// Необязательная: ReplayGain из тегов открытого файла. 0, если есть хотя бы
+// усиление трека. Тогда громкость трека не нужно измерять декодированием
+int decoder_replaygain(DecoderStream* stream, ReplayGainInfo* info);
+
+// Необязательная: свойства плагина, DECODER_FLAG_*. Без нее 0
+int decoder_flags(void);
+
+// Необязательная: весь файл с начала в pcm, не больше frames фреймов, для рендера
+// и анализа громкости. Длинный файл делится на отрезки, которые декодируются
+// параллельно, не больше чем в options->threads потоков. Отсчеты те же, что дал бы
+// decoder_read. Возвращает число фреймов, <0 при ошибке или отмене
+long decoder_decode_all(const char* filename, float* pcm, uint64_t frames, DecodeAllOptions* options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,7 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <FLAC/stream_decoder.h>
+#include "decoder_api.h"
+#include "replaygain_tags.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FLAC_X86 1
+#endif
 
 typedef struct {
     int16_t* pcm_data;
@@ -11,13 +22,249 @@ typedef struct {
     int bits_per_sample;
 } AudioData;
 
+// Ядра перевода кадра FLAC (int32 по каналам) в interleaved выход.
+// Разрядность передается готовым множителем или сдвигом, число каналов
+// выбирает вариант ядра. Выбор делается один раз на поток
+typedef void (*flac_float_fn)(const FLAC__int32* const buffer[], uint32_t blocksize,
+                              int channels, float scale, float* out);
+typedef void (*flac_s16_fn)(const FLAC__int32* const buffer[], uint32_t blocksize,
+                            int channels, int shift, int16_t* out);
+
 typedef struct {
     AudioData* audio;
     FLAC__StreamDecoder* decoder;
     uint32_t current_position;
-    float volume_scale;
+    uint32_t pcm_capacity;
+    
+    // Ядра под разрядность и число каналов текущего потока
+    int kernel_bits;
+    int kernel_channels;
+    flac_float_fn to_float;
+    flac_s16_fn to_s16;
+    
+    // Параллельный режим: поток декодирует отрезок [current_position, segment_end)
+    // в общий буфер out, кадр на границе обрезается
+    bool segmented;
+    uint32_t segment_end;
+    float* out;
+    const DecodeAllOptions* options;
+    
+    // Точки SEEKTABLE для разбиения файла на отрезки
+    uint64_t* seek_points;
+    uint32_t seek_point_count;
+    
+    // Потоковый режим: кадр декодируется в pending и отдается порциями
+    bool streaming;
+    float* pending;
+    uint32_t pending_len;
+    uint32_t pending_pos;
+    uint32_t pending_cap;
+    ReplayGainInfo replaygain;  // Из VORBIS_COMMENT, только в потоковом режиме
 } FlacDecodeState;
 
+// Скалярные варианты: любое число каналов и разрядность меньше 16
+
+static void float_any_scalar(const FLAC__int32* const buffer[], uint32_t blocksize,
+                             int channels, float scale, float* out) {
+    for (int channel = 0; channel < channels; channel++) {
+        const FLAC__int32* src = buffer[channel];
+        float* dst = out + channel;
+        for (uint32_t i = 0; i < blocksize; i++) dst[i * channels] = src[i] * scale;
+    }
+}
+
+static void s16_any_scalar(const FLAC__int32* const buffer[], uint32_t blocksize,
+                           int channels, int shift, int16_t* out) {
+    for (int channel = 0; channel < channels; channel++) {
+        const FLAC__int32* src = buffer[channel];
+        int16_t* dst = out + channel;
+        if (shift >= 0) {
+            for (uint32_t i = 0; i < blocksize; i++) dst[i * channels] = (int16_t)(src[i] >> shift);
+        } else {
+            for (uint32_t i = 0; i < blocksize; i++) dst[i * channels] = (int16_t)(src[i] * (1 << -shift));
+        }
+    }
+}
+
+#ifdef FLAC_X86
+
+__attribute__((target("sse2")))
+static void float_mono_sse2(const FLAC__int32* const buffer[], uint32_t blocksize,
+                            int channels, float scale, float* out) {
+    const FLAC__int32* src = buffer[0];
+    const __m128 k = _mm_set1_ps(scale);
+    uint32_t i = 0;
+    
+    for (; i + 4 <= blocksize; i += 4) {
+        __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(src + i)));
+        _mm_storeu_ps(out + i, _mm_mul_ps(v, k));
+    }
+    for (; i < blocksize; i++) out[i] = src[i] * scale;
+}
+
+__attribute__((target("sse2")))
+static void float_stereo_sse2(const FLAC__int32* const buffer[], uint32_t blocksize,
+                              int channels, float scale, float* out) {
+    const FLAC__int32* left = buffer[0];
+    const FLAC__int32* right = buffer[1];
+    const __m128 k = _mm_set1_ps(scale);
+    uint32_t i = 0;
+    
+    for (; i + 4 <= blocksize; i += 4) {
+        __m128 l = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(left + i))), k);
+        __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(right + i))), k);
+        _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+    for (; i < blocksize; i++) {
+        out[i * 2] = left[i] * scale;
+        out[i * 2 + 1] = right[i] * scale;
+    }
+}
+
+__attribute__((target("sse2")))
+static void s16_mono_sse2(const FLAC__int32* const buffer[], uint32_t blocksize,
+                          int channels, int shift, int16_t* out) {
+    const FLAC__int32* src = buffer[0];
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    uint32_t i = 0;
+    
+    for (; i + 8 <= blocksize; i += 8) {
+        __m128i a = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(src + i)), count);
+        __m128i b = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(src + i + 4)), count);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+    }
+    for (; i < blocksize; i++) out[i] = (int16_t)(src[i] >> shift);
+}
+
+__attribute__((target("sse2")))
+static void s16_stereo_sse2(const FLAC__int32* const buffer[], uint32_t blocksize,
+                            int channels, int shift, int16_t* out) {
+    const FLAC__int32* left = buffer[0];
+    const FLAC__int32* right = buffer[1];
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    uint32_t i = 0;
+    
+    for (; i + 4 <= blocksize; i += 4) {
+        __m128i l = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(left + i)), count);
+        __m128i r = _mm_sra_epi32(_mm_loadu_si128((const __m128i*)(right + i)), count);
+        // L0 R0 L1 R1 | L2 R2 L3 R3 -> 8 x int16
+        __m128i packed = _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r));
+        _mm_storeu_si128((__m128i*)(out + i * 2), packed);
+    }
+    for (; i < blocksize; i++) {
+        out[i * 2] = (int16_t)(left[i] >> shift);
+        out[i * 2 + 1] = (int16_t)(right[i] >> shift);
+    }
+}
+
+__attribute__((target("avx2")))
+static void float_mono_avx2(const FLAC__int32* const buffer[], uint32_t blocksize,
+                            int channels, float scale, float* out) {
+    const FLAC__int32* src = buffer[0];
+    const __m256 k = _mm256_set1_ps(scale);
+    uint32_t i = 0;
+    
+    for (; i + 8 <= blocksize; i += 8) {
+        __m256 v = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(src + i)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(v, k));
+    }
+    for (; i < blocksize; i++) out[i] = src[i] * scale;
+}
+
+__attribute__((target("avx2")))
+static void float_stereo_avx2(const FLAC__int32* const buffer[], uint32_t blocksize,
+                              int channels, float scale, float* out) {
+    const FLAC__int32* left = buffer[0];
+    const FLAC__int32* right = buffer[1];
+    const __m256 k = _mm256_set1_ps(scale);
+    uint32_t i = 0;
+    
+    for (; i + 8 <= blocksize; i += 8) {
+        __m256 l = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(left + i))), k);
+        __m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(right + i))), k);
+        // unpack работает по 128-битным половинам: [0 1 | 4 5] и [2 3 | 6 7]
+        __m256 lo = _mm256_unpacklo_ps(l, r);
+        __m256 hi = _mm256_unpackhi_ps(l, r);
+        _mm256_storeu_ps(out + i * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + i * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    for (; i < blocksize; i++) {
+        out[i * 2] = left[i] * scale;
+        out[i * 2 + 1] = right[i] * scale;
+    }
+}
+
+__attribute__((target("avx2")))
+static void s16_mono_avx2(const FLAC__int32* const buffer[], uint32_t blocksize,
+                          int channels, int shift, int16_t* out) {
+    const FLAC__int32* src = buffer[0];
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    uint32_t i = 0;
+    
+    for (; i + 16 <= blocksize; i += 16) {
+        __m256i a = _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)(src + i)), count);
+        __m256i b = _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)(src + i + 8)), count);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out + i), packed);
+    }
+    for (; i < blocksize; i++) out[i] = (int16_t)(src[i] >> shift);
+}
+
+__attribute__((target("avx2")))
+static void s16_stereo_avx2(const FLAC__int32* const buffer[], uint32_t blocksize,
+                            int channels, int shift, int16_t* out) {
+    const FLAC__int32* left = buffer[0];
+    const FLAC__int32* right = buffer[1];
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    uint32_t i = 0;
+    
+    for (; i + 8 <= blocksize; i += 8) {
+        __m256i l = _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)(left + i)), count);
+        __m256i r = _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)(right + i)), count);
+        // Перестановки по половинам в unpack и packs взаимно компенсируются
+        __m256i packed = _mm256_packs_epi32(_mm256_unpacklo_epi32(l, r), _mm256_unpackhi_epi32(l, r));
+        _mm256_storeu_si256((__m256i*)(out + i * 2), packed);
+    }
+    for (; i < blocksize; i++) {
+        out[i * 2] = (int16_t)(left[i] >> shift);
+        out[i * 2 + 1] = (int16_t)(right[i] >> shift);
+    }
+}
+
+#endif
+
+// Выбор ядер под поток: по числу каналов и возможностям процессора
+static void select_kernels(FlacDecodeState* state, int bits, int channels) {
+    state->kernel_bits = bits;
+    state->kernel_channels = channels;
+    state->to_float = float_any_scalar;
+    state->to_s16 = s16_any_scalar;
+
+#ifdef FLAC_X86
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool sse2 = __builtin_cpu_supports("sse2");
+    
+    if (channels == 1) {
+        if (avx2) state->to_float = float_mono_avx2;
+        else if (sse2) state->to_float = float_mono_sse2;
+    } else if (channels == 2) {
+        if (avx2) state->to_float = float_stereo_avx2;
+        else if (sse2) state->to_float = float_stereo_sse2;
+    }
+    
+    // Для 16 бит и выше сдвиг вправо, меньшие разрядности остаются скалярными
+    if (bits >= 16 && channels == 1) {
+        if (avx2) state->to_s16 = s16_mono_avx2;
+        else if (sse2) state->to_s16 = s16_mono_sse2;
+    } else if (bits >= 16 && channels == 2) {
+        if (avx2) state->to_s16 = s16_stereo_avx2;
+        else if (sse2) state->to_s16 = s16_stereo_sse2;
+    }
+#endif
+}
+
 static FLAC__StreamDecoderWriteStatus write_callback(
     const FLAC__StreamDecoder* decoder,
     const FLAC__Frame* frame,
@@ -27,44 +274,53 @@ static FLAC__StreamDecoderWriteStatus write_callback(
     FlacDecodeState* state = (FlacDecodeState*)client_data;
     AudioData* audio = state->audio;
     
-    uint32_t samples_needed = frame->header.blocksize * audio->channels;
-    
-    // Проверяем, нужно ли увеличить буфер
-    if (state->current_position + samples_needed > audio->samples_count) {
-        uint32_t new_size = state->current_position + samples_needed;
-        audio->pcm_data = realloc(audio->pcm_data, new_size * sizeof(int16_t));
-        audio->samples_count = new_size;
-    }
-    
-    // Определяем коэффициент масштабирования в зависимости от битности
-    int shift_bits = audio->bits_per_sample - 16;
-    float scale_factor = state->volume_scale;
-    
-    // Конвертируем FLAC samples в 16-bit PCM с нормализацией
-    for (uint32_t i = 0; i < frame->header.blocksize; i++) {
-        for (int channel = 0; channel < audio->channels; channel++) {
-            FLAC__int32 sample = buffer[channel][i];
-            
-            // Масштабируем с учетом битности и коэффициента громкости
-            float scaled_sample;
-            
-            if (shift_bits > 0) {
-                // Для 24-бит и выше: сдвигаем вправо и применяем коэффициент
-                scaled_sample = (sample >> shift_bits) * scale_factor;
-            } else if (shift_bits < 0) {
-                // Для менее чем 16 бит (маловероятно для FLAC): сдвигаем влево
-                scaled_sample = (sample << (-shift_bits)) * scale_factor;
-            } else {
-                // Для 16 бит: просто применяем коэффициент
-                scaled_sample = sample * scale_factor;
-            }
-            
-            // Ограничиваем диапазон
-            if (scaled_sample > 32767.0f) scaled_sample = 32767.0f;
-            else if (scaled_sample < -32768.0f) scaled_sample = -32768.0f;
-            
-            audio->pcm_data[state->current_position++] = (int16_t)scaled_sample;
+    uint32_t blocksize = frame->header.blocksize;
+    int channels = audio->channels;
+    int bits = frame->header.bits_per_sample;
+    uint32_t samples_needed = blocksize * channels;
+    
+    // STREAMINFO мог не прийти или разойтись с заголовком кадра
+    if (bits != state->kernel_bits || channels != state->kernel_channels || !state->to_float) {
+        select_kernels(state, bits, channels);
+    }
+    
+    if (state->streaming) {
+        // Кадр целиком помещается в pending, старое содержимое уже прочитано
+        if (samples_needed > state->pending_cap) {
+            uint32_t capacity = state->pending_cap * 2 > samples_needed ? state->pending_cap * 2 : samples_needed;
+            float* grown = realloc(state->pending, capacity * sizeof(float));
+            if (!grown) return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+            state->pending = grown;
+            state->pending_cap = capacity;
         }
+        state->pending_len = samples_needed;
+        state->pending_pos = 0;
+        
+        // Полная разрядность: нормируем к [-1, 1] одним множителем на кадр
+        state->to_float(buffer, blocksize, channels, 1.0f / (float)(1u << (bits - 1)), state->pending);
+    } else if (state->segmented) {
+        // Буфер уже выделен на весь файл, пишем только в свой отрезок
+        if (state->current_position >= state->segment_end) return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+        uint32_t room = (state->segment_end - state->current_position) / channels;
+        if (blocksize > room) blocksize = room;
+        
+        state->to_float(buffer, blocksize, channels, 1.0f / (float)(1u << (bits - 1)),
+                        state->out + state->current_position);
+        state->current_position += blocksize * channels;
+    } else {
+        // Длина в STREAMINFO бывает 0 или неверной (поток): растим буфер вдвое
+        if (state->current_position + samples_needed > state->pcm_capacity) {
+            uint32_t needed = state->current_position + samples_needed;
+            uint32_t capacity = state->pcm_capacity * 2 > needed ? state->pcm_capacity * 2 : needed;
+            int16_t* grown = realloc(audio->pcm_data, capacity * sizeof(int16_t));
+            if (!grown) return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+            audio->pcm_data = grown;
+            state->pcm_capacity = capacity;
+        }
+        
+        // Старый интерфейс отдает 16 бит: берем старшие разряды
+        state->to_s16(buffer, blocksize, channels, bits - 16, audio->pcm_data + state->current_position);
+        state->current_position += samples_needed;
     }
     
     return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
@@ -82,27 +338,70 @@ static void metadata_callback(
         audio->sample_rate = metadata->data.stream_info.sample_rate;
         audio->channels = metadata->data.stream_info.channels;
         audio->bits_per_sample = metadata->data.stream_info.bits_per_sample;
+        select_kernels(state, audio->bits_per_sample, audio->channels);
         
-        // Устанавливаем коэффициент громкости в зависимости от битности
-        if (audio->bits_per_sample > 16) {
-            // Для 24-бит уменьшаем громкость (24 бит = 144 dB динамического диапазона)
-            state->volume_scale = 0.5f; // Уменьшаем на 6 dB
-        } else {
-            // Для 16 бит оставляем нормальную громкость
-            state->volume_scale = 1.0f;
-        }
+        // В потоковом режиме весь файл в память не выделяем, отрезкам буфер дает вызывающий
+        if (state->streaming || state->segmented) return;
         
         // Предварительно выделяем память для PCM данных
         uint32_t total_samples = metadata->data.stream_info.total_samples * audio->channels;
-        audio->samples_count = total_samples;
         audio->pcm_data = malloc(total_samples * sizeof(int16_t));
+        state->pcm_capacity = audio->pcm_data ? total_samples : 0;
         
-        if (!audio->pcm_data) {
+        if (total_samples > 0 && !audio->pcm_data) {
             fprintf(stderr, "Memory allocation failed\n");
         }
+    } else if (metadata->type == FLAC__METADATA_TYPE_VORBIS_COMMENT && state->streaming) {
+        const FLAC__StreamMetadata_VorbisComment* comments = &metadata->data.vorbis_comment;
+        for (FLAC__uint32 i = 0; i < comments->num_comments; i++) {
+            replaygain_parse_comment((const char*)comments->comments[i].entry,
+                                     comments->comments[i].length, &state->replaygain);
+        }
+    } else if (metadata->type == FLAC__METADATA_TYPE_SEEKTABLE && !state->seek_points) {
+        const FLAC__StreamMetadata_SeekTable* table = &metadata->data.seek_table;
+        state->seek_points = malloc(table->num_points * sizeof(uint64_t));
+        if (!state->seek_points) return;
+        
+        for (uint32_t i = 0; i < table->num_points; i++) {
+            if (table->points[i].sample_number == FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER) continue;
+            state->seek_points[state->seek_point_count++] = table->points[i].sample_number;
+        }
     }
 }
 
+// Декодеры libFLAC переиспользуются между треками: после finish
+// их можно снова инициализировать другим файлом
+#define DECODER_POOL_SIZE 2
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FLAC__StreamDecoder* decoder_pool[DECODER_POOL_SIZE];
+static int decoder_pool_count = 0;
+
+static FLAC__StreamDecoder* acquire_decoder(void) {
+    FLAC__StreamDecoder* decoder = NULL;
+    
+    pthread_mutex_lock(&pool_mutex);
+    if (decoder_pool_count > 0) decoder = decoder_pool[--decoder_pool_count];
+    pthread_mutex_unlock(&pool_mutex);
+    
+    return decoder ? decoder : FLAC__stream_decoder_new();
+}
+
+static void release_decoder(FLAC__StreamDecoder* decoder) {
+    if (!decoder) return;
+    
+    FLAC__stream_decoder_finish(decoder);
+    
+    pthread_mutex_lock(&pool_mutex);
+    if (decoder_pool_count < DECODER_POOL_SIZE) {
+        decoder_pool[decoder_pool_count++] = decoder;
+        decoder = NULL;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    
+    if (decoder) FLAC__stream_decoder_delete(decoder);
+}
+
 static void error_callback(
     const FLAC__StreamDecoder* decoder,
     FLAC__StreamDecoderErrorStatus status,
@@ -111,6 +410,175 @@ static void error_callback(
     fprintf(stderr, "FLAC decoder error: %s\n", FLAC__StreamDecoderErrorStatusString[status]);
 }
 
+// Параллельное полное декодирование в float для decoder_decode_all. Кадры FLAC
+// независимы: файл режется на отрезки, каждый поток со своим декодером
+// перематывает на начало отрезка и пишет в свою часть общего буфера
+#define FLAC_MAX_WORKERS 8
+#define FLAC_MIN_SEGMENT_SECONDS 30     // Короче не делим: перемотка и запуск потока дороже
+
+typedef struct {
+    const char* filename;
+    float* pcm;
+    uint64_t start;                     // Границы отрезка во фреймах
+    uint64_t end;
+    uint32_t reached;                   // Докуда дописан буфер (отсчеты)
+    const DecodeAllOptions* options;
+    bool ok;
+} FlacSegment;
+
+static int flac_worker_count(const AudioData* audio, uint64_t total_frames, int threads) {
+    uint64_t min_frames = (uint64_t)audio->sample_rate * FLAC_MIN_SEGMENT_SECONDS;
+    if (threads <= 1 || total_frames == 0 || min_frames == 0) return 1;
+    
+    uint64_t workers = total_frames / min_frames;
+    if (workers > (uint64_t)threads) workers = threads;
+    if (workers > FLAC_MAX_WORKERS) workers = FLAC_MAX_WORKERS;
+    return workers > 1 ? (int)workers : 1;
+}
+
+// Равные отрезки, граница сдвигается назад к точке SEEKTABLE: тогда перемотка
+// попадает точно на начало кадра и не декодирует лишнего
+static void split_segments(const FlacDecodeState* state, uint64_t total_frames, int workers, uint64_t* bounds) {
+    bounds[0] = 0;
+    bounds[workers] = total_frames;
+    
+    for (int i = 1; i < workers; i++) {
+        uint64_t target = total_frames * i / workers;
+        bounds[i] = target;
+        for (uint32_t p = 0; p < state->seek_point_count; p++) {
+            uint64_t point = state->seek_points[p];
+            if (point > target) break;
+            if (point > bounds[i - 1]) bounds[i] = point;
+        }
+    }
+}
+
+static bool decode_cancelled(const DecodeAllOptions* options) {
+    return options->cancelled && options->cancelled(options->context);
+}
+
+// Декодирование до конца отрезка или потока. Отмена проверяется на каждом кадре
+static bool run_segment(FlacDecodeState* state) {
+    while (state->current_position < state->segment_end) {
+        if (decode_cancelled(state->options)) return false;
+        if (FLAC__stream_decoder_get_state(state->decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) break;
+        if (!FLAC__stream_decoder_process_single(state->decoder)) return false;
+    }
+    return true;
+}
+
+static void* segment_worker(void* arg) {
+    FlacSegment* segment = (FlacSegment*)arg;
+    AudioData audio = {0};
+    FlacDecodeState state = { .audio = &audio, .segmented = true, .out = segment->pcm,
+                              .options = segment->options };
+    
+    segment->ok = false;
+    state.decoder = acquire_decoder();
+    if (!state.decoder) return NULL;
+    
+    FLAC__StreamDecoderInitStatus init_status = FLAC__stream_decoder_init_file(
+        state.decoder, segment->filename, write_callback, metadata_callback,
+        error_callback, &state);
+    
+    if (init_status == FLAC__STREAM_DECODER_INIT_STATUS_OK &&
+        FLAC__stream_decoder_process_until_end_of_metadata(state.decoder) && audio.channels > 0) {
+        // Позиция задается до перемотки: seek_absolute сам отдает первый кадр в write_callback
+        state.current_position = segment->start * audio.channels;
+        state.segment_end = segment->end * audio.channels;
+        if (FLAC__stream_decoder_seek_absolute(state.decoder, segment->start)) {
+            segment->ok = run_segment(&state);
+        }
+    }
+    
+    segment->reached = state.current_position;
+    release_decoder(state.decoder);
+    return NULL;
+}
+
+static bool decode_parallel(FlacDecodeState* state, const char* filename, uint64_t total_frames, int workers) {
+    AudioData* audio = state->audio;
+    uint64_t bounds[FLAC_MAX_WORKERS + 1];
+    FlacSegment segments[FLAC_MAX_WORKERS];
+    pthread_t threads[FLAC_MAX_WORKERS];
+    bool started[FLAC_MAX_WORKERS] = {false};
+    
+    split_segments(state, total_frames, workers, bounds);
+    
+    for (int i = 1; i < workers; i++) {
+        segments[i] = (FlacSegment){
+            .filename = filename,
+            .pcm = state->out,
+            .start = bounds[i],
+            .end = bounds[i + 1],
+            .options = state->options
+        };
+        started[i] = pthread_create(&threads[i], NULL, segment_worker, &segments[i]) == 0;
+    }
+    
+    // Первый отрезок декодирует основной декодер, он уже стоит в начале потока
+    state->segmented = true;
+    state->segment_end = bounds[1] * audio->channels;
+    bool ok = run_segment(state);
+    uint32_t position = state->current_position;
+    
+    for (int i = 1; i < workers; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else segment_worker(&segments[i]);  // Поток не создался: декодируем здесь
+        
+        if (!segments[i].ok) ok = false;
+        
+        // Пустые отрезки в конце допустимы: STREAMINFO завысил длину.
+        // Но если после недобора предыдущего отрезка этот что-то декодировал,
+        // в середине файла дыра, и заполнять ее тишиной нельзя
+        uint32_t start = segments[i].start * audio->channels;
+        if (segments[i].reached > start) {
+            if (position < start) ok = false;
+            position = segments[i].reached;
+        }
+    }
+    
+    state->current_position = position;
+    return ok;
+}
+
+long decoder_decode_all(const char* filename, float* pcm, uint64_t frames, DecodeAllOptions* options) {
+    options->mode = DECODE_ALL_SERIAL;
+    AudioData audio = {0};
+    FlacDecodeState state = { .audio = &audio, .segmented = true, .out = pcm, .options = options };
+    
+    state.decoder = acquire_decoder();
+    if (!state.decoder) return -1;
+    
+    // SEEKTABLE нужна для разбиения на отрезки
+    FLAC__stream_decoder_set_metadata_respond(state.decoder, FLAC__METADATA_TYPE_SEEKTABLE);
+    
+    FLAC__StreamDecoderInitStatus init_status = FLAC__stream_decoder_init_file(
+        state.decoder, filename, write_callback, metadata_callback,
+        error_callback, &state);
+    
+    bool ok = init_status == FLAC__STREAM_DECODER_INIT_STATUS_OK &&
+              FLAC__stream_decoder_process_until_end_of_metadata(state.decoder) &&
+              audio.channels > 0;
+    
+    // Длина из STREAMINFO может быть неизвестна: тогда один отрезок до конца буфера
+    uint64_t total_frames = ok ? FLAC__stream_decoder_get_total_samples(state.decoder) : 0;
+    if (total_frames == 0 || total_frames > frames) total_frames = frames;
+    if (total_frames * audio.channels > UINT32_MAX) ok = false;
+    
+    if (ok) {
+        int workers = flac_worker_count(&audio, total_frames, options->threads);
+        if (workers > 1) options->mode = DECODE_ALL_PARALLEL;
+        ok = decode_parallel(&state, filename, total_frames, workers);
+    }
+    
+    release_decoder(state.decoder);
+    free(state.seek_points);
+    return ok ? (long)(state.current_position / audio.channels) : -1;
+}
+
+// Старый интерфейс: весь файл в 16 бит, последовательно
+
 AudioData* decode_flac(const char* filename) {
     FlacDecodeState state = {0};
     AudioData* audio = calloc(1, sizeof(AudioData));
@@ -118,10 +586,9 @@ AudioData* decode_flac(const char* filename) {
     
     state.audio = audio;
     state.current_position = 0;
-    state.volume_scale = 1.0f;
     
-    // Создаем декодер
-    state.decoder = FLAC__stream_decoder_new();
+    // Берем декодер из пула или создаем
+    state.decoder = acquire_decoder();
     if (!state.decoder) {
         free(audio);
         return NULL;
@@ -133,22 +600,25 @@ AudioData* decode_flac(const char* filename) {
         error_callback, &state);
     
     if (init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
-        FLAC__stream_decoder_delete(state.decoder);
+        release_decoder(state.decoder);
         free(audio);
         return NULL;
     }
     
-    // Запускаем декодирование
-    if (!FLAC__stream_decoder_process_until_end_of_stream(state.decoder)) {
-        FLAC__stream_decoder_delete(state.decoder);
+    // Декодируем весь файл
+    bool ok = FLAC__stream_decoder_process_until_end_of_stream(state.decoder);
+    
+    // Завершаем декодирование
+    release_decoder(state.decoder);
+    
+    if (!ok) {
         if (audio->pcm_data) free(audio->pcm_data);
         free(audio);
         return NULL;
     }
     
-    // Завершаем декодирование
-    FLAC__stream_decoder_finish(state.decoder);
-    FLAC__stream_decoder_delete(state.decoder);
+    // Фактическая длина, буфер мог вырасти с запасом
+    audio->samples_count = state.current_position;
     
     return audio;
 }
@@ -160,4 +630,127 @@ void free_audio_data(AudioData* audio) {
         }
         free(audio);
     }
-}
\ No newline at end of file
+}
+
+// Потоковый интерфейс
+
+struct DecoderStream {
+    FlacDecodeState state;
+    AudioData audio;
+    uint64_t total_frames;
+};
+
+DecoderStream* decoder_open(const char* filename, StreamInfo* info) {
+    DecoderStream* stream = calloc(1, sizeof(DecoderStream));
+    if (!stream) return NULL;
+    
+    stream->state.audio = &stream->audio;
+    stream->state.streaming = true;
+    replaygain_clear(&stream->state.replaygain);
+    
+    stream->state.decoder = acquire_decoder();
+    if (!stream->state.decoder) {
+        free(stream);
+        return NULL;
+    }
+    
+    // Теги ReplayGain приходят в VORBIS_COMMENT вместе с остальными метаданными
+    FLAC__stream_decoder_set_metadata_respond(stream->state.decoder, FLAC__METADATA_TYPE_VORBIS_COMMENT);
+    
+    FLAC__StreamDecoderInitStatus init_status = FLAC__stream_decoder_init_file(
+        stream->state.decoder, filename, write_callback, metadata_callback,
+        error_callback, &stream->state);
+    
+    if (init_status != FLAC__STREAM_DECODER_INIT_STATUS_OK ||
+        !FLAC__stream_decoder_process_until_end_of_metadata(stream->state.decoder) ||
+        stream->audio.channels <= 0) {
+        decoder_close(stream);
+        return NULL;
+    }
+    
+    stream->total_frames = FLAC__stream_decoder_get_total_samples(stream->state.decoder);
+    
+    info->sample_rate = stream->audio.sample_rate;
+    info->channels = stream->audio.channels;
+    info->total_frames = stream->total_frames;
+    
+    return stream;
+}
+
+long decoder_read(DecoderStream* stream, float* buffer, long frames) {
+    FlacDecodeState* state = &stream->state;
+    int channels = stream->audio.channels;
+    long done = 0;
+    
+    while (done < frames) {
+        if (state->pending_pos >= state->pending_len) {
+            // Декодируем следующий кадр
+            state->pending_len = 0;
+            state->pending_pos = 0;
+            if (FLAC__stream_decoder_get_state(state->decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) break;
+            if (!FLAC__stream_decoder_process_single(state->decoder)) {
+                if (done == 0) return -1;
+                break;
+            }
+            continue;
+        }
+        
+        uint32_t available = (state->pending_len - state->pending_pos) / channels;
+        uint32_t count = frames - done < available ? frames - done : available;
+        
+        memcpy(buffer + done * channels, state->pending + state->pending_pos,
+               count * channels * sizeof(float));
+        state->pending_pos += count * channels;
+        done += count;
+    }
+    
+    return done;
+}
+
+int decoder_seek(DecoderStream* stream, uint64_t frame) {
+    FlacDecodeState* state = &stream->state;
+    
+    if (stream->total_frames > 0 && frame >= stream->total_frames) return -1;
+    
+    // seek_absolute использует SEEKTABLE (libFLAC читает ее всегда) и двоичный поиск
+    // по кадрам, затем сам вызывает write_callback для кадра с нужной позицией
+    state->pending_len = 0;
+    state->pending_pos = 0;
+    if (FLAC__stream_decoder_seek_absolute(state->decoder, frame)) return 0;
+    
+    // После неудачной перемотки декодер нужно сбросить, иначе он не читает дальше
+    if (FLAC__stream_decoder_get_state(state->decoder) == FLAC__STREAM_DECODER_SEEK_ERROR) {
+        FLAC__stream_decoder_flush(state->decoder);
+    }
+    state->pending_len = 0;
+    return -1;
+}
+
+void decoder_close(DecoderStream* stream) {
+    if (!stream) return;
+    
+    release_decoder(stream->state.decoder);
+    free(stream->state.pending);
+    free(stream);
+}
+
+int decoder_replaygain(DecoderStream* stream, ReplayGainInfo* info) {
+    *info = stream->state.replaygain;
+    return replaygain_result(info);
+}
+
+void decoder_shutdown(void) {
+    pthread_mutex_lock(&pool_mutex);
+    while (decoder_pool_count > 0) FLAC__stream_decoder_delete(decoder_pool[--decoder_pool_count]);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+int decoder_probe(const unsigned char* header, size_t size, const char* filename) {
+    if (size >= 4 && memcmp(header, "fLaC", 4) == 0) return 100;
+    
+    // FLAC с ID3 тегом впереди: сигнатура дальше заголовка, решаем по расширению
+    const char* ext = strrchr(filename, '.');
+    if (size >= 3 && memcmp(header, "ID3", 3) == 0 && ext && strcasecmp(ext, ".flac") == 0) return 95;
+    
+    return 0;
+}
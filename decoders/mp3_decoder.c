@@ -1,33 +1,324 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <mpg123.h>
 #include "mp3_decoder.h"
+#include "decoder_api.h"
+#include "replaygain_tags.h"
 
-AudioData* decode_mp3(const char* filename) {
-    int err;
-    mpg123_handle *mh = NULL;
-    
-    // Инициализация библиотеки
-    err = mpg123_init();
+#define HANDLE_POOL_SIZE 2  // Текущий трек и предзагруженный следующий
+
+// Дескрипторы mpg123 переиспользуются между треками: создание нового
+// выделяет буферы и таблицы синтеза, а переоткрытие файла - нет
+static pthread_once_t library_once = PTHREAD_ONCE_INIT;
+static int library_ready = 0;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mpg123_handle* handle_pool[HANDLE_POOL_SIZE];
+static int handle_pool_count = 0;
+
+static void library_init(void) {
+    int err = mpg123_init();
     if (err != MPG123_OK) {
         fprintf(stderr, "mpg123_init failed: %s\n", mpg123_plain_strerror(err));
-        return NULL;
+        return;
     }
+    library_ready = 1;
+}
+
+static mpg123_handle* acquire_handle(void) {
+    pthread_once(&library_once, library_init);
+    if (!library_ready) return NULL;
+    
+    mpg123_handle* mh = NULL;
+    pthread_mutex_lock(&pool_mutex);
+    if (handle_pool_count > 0) mh = handle_pool[--handle_pool_count];
+    pthread_mutex_unlock(&pool_mutex);
     
-    // Создание дескриптора
-    mh = mpg123_new(NULL, &err);
     if (!mh) {
-        fprintf(stderr, "mpg123_new failed: %s\n", mpg123_plain_strerror(err));
-        mpg123_exit();
-        return NULL;
+        int err;
+        mh = mpg123_new(NULL, &err);
+        if (!mh) {
+            fprintf(stderr, "mpg123_new failed: %s\n", mpg123_plain_strerror(err));
+            return NULL;
+        }
+    }
+    
+    // Прошлый трек мог ограничить выходной формат
+    mpg123_format_all(mh);
+    return mh;
+}
+
+static void release_handle(mpg123_handle* mh) {
+    if (!mh) return;
+    
+    mpg123_close(mh);
+    
+    pthread_mutex_lock(&pool_mutex);
+    if (handle_pool_count < HANDLE_POOL_SIZE) {
+        handle_pool[handle_pool_count++] = mh;
+        mh = NULL;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    
+    if (mh) mpg123_delete(mh);
+}
+
+// Параллельное полное декодирование в float для decoder_decode_all. Поток режется
+// на отрезки по границам MPEG фреймов из индекса mpg123, каждый отрезок декодирует
+// свой дескриптор. После перемотки mpg123 декодирует впустую MPG123_PREFRAMES
+// фреймов перед целевым: этого хватает, чтобы восстановить bit reservoir,
+// перекрытие IMDCT и состояние синтез-фильтра. Совпадение стыка с последовательным
+// декодированием проверяется: отрезок декодирует еще MP3_SEAM_CHECK_FRAMES за своей
+// границей, и они должны побитно совпасть с началом следующего отрезка
+#define MP3_MAX_WORKERS 8
+#define MP3_MIN_SEGMENT_SECONDS 30
+#define MP3_OVERLAP_FRAMES 16   // Reservoir до 511 байт - до ~10 коротких фреймов, плюс запас на фильтры
+#define MP3_SEAM_CHECK_FRAMES 2304  // Два фрейма MPEG-1 Layer III
+#define MP3_READ_CHUNK_FRAMES 65536 // Порция decoder_decode_all между проверками отмены
+
+typedef struct {
+    const char* filename;
+    long sample_rate;
+    int channels;
+    off_t* index;               // Общий индекс смещений фреймов, строится один раз
+    off_t index_step;
+    size_t index_fill;
+    float* pcm;
+    off_t start;                // Границы отрезка во фреймах PCM
+    off_t end;
+    off_t reached;
+    float* tail;                // Фреймы за границей отрезка, NULL у последнего
+    off_t tail_reached;
+    const DecodeAllOptions* options;
+    int ok;
+} Mp3Segment;
+
+static int mp3_worker_count(long sample_rate, off_t length, int threads) {
+    off_t min_frames = (off_t)sample_rate * MP3_MIN_SEGMENT_SECONDS;
+    if (threads <= 1 || length <= 0 || min_frames <= 0) return 1;
+    
+    off_t workers = length / min_frames;
+    if (workers > threads) workers = threads;
+    if (workers > MP3_MAX_WORKERS) workers = MP3_MAX_WORKERS;
+    return workers > 1 ? (int)workers : 1;
+}
+
+static int decode_cancelled(const DecodeAllOptions* options) {
+    return options->cancelled && options->cancelled(options->context);
+}
+
+// Чтение до count фреймов подряд в out. 0 при успехе, конец потока не ошибка.
+// Читается порциями, чтобы между ними проверять отмену
+static int read_frames(mpg123_handle* mh, float* out, int channels, off_t count, off_t* got,
+                       const DecodeAllOptions* options) {
+    size_t frame_bytes = channels * sizeof(float);
+    off_t position = 0;
+    int err = MPG123_OK;
+    
+    while (position < count) {
+        if (decode_cancelled(options)) {
+            err = MPG123_ERR;
+            break;
+        }
+        off_t chunk = count - position;
+        if (chunk > MP3_READ_CHUNK_FRAMES) chunk = MP3_READ_CHUNK_FRAMES;
+        size_t done = 0;
+        err = mpg123_read(mh, (unsigned char*)(out + position * channels), chunk * frame_bytes, &done);
+        position += done / frame_bytes;
+        
+        if (err == MPG123_DONE) {
+            err = MPG123_OK;
+            break;
+        }
+        if (err == MPG123_NEW_FORMAT) continue;
+        if (err != MPG123_OK || done == 0) break;
+    }
+    
+    *got = position;
+    return err == MPG123_OK ? 0 : -1;
+}
+
+// Отрезок с текущей позиции дескриптора и, если отрезок не последний, хвост за его границей
+static int decode_segment(mpg123_handle* mh, Mp3Segment* segment) {
+    off_t got = 0;
+    int ok = read_frames(mh, segment->pcm + segment->start * segment->channels, segment->channels,
+                         segment->end - segment->start, &got, segment->options) == 0;
+    segment->reached = segment->start + got;
+    segment->tail_reached = 0;
+    
+    if (ok && segment->tail && segment->reached == segment->end) {
+        ok = read_frames(mh, segment->tail, segment->channels, MP3_SEAM_CHECK_FRAMES, &segment->tail_reached,
+                         segment->options) == 0;
+    }
+    return ok;
+}
+
+static void* segment_worker(void* arg) {
+    Mp3Segment* segment = (Mp3Segment*)arg;
+    segment->ok = 0;
+    segment->reached = segment->start;
+    segment->tail_reached = 0;
+    
+    mpg123_handle* mh = acquire_handle();
+    if (!mh) return NULL;
+    
+    // Дескриптор вернется в пул: запоминаем настройку, чтобы восстановить
+    long preframes = 0;
+    double unused;
+    mpg123_getparam(mh, MPG123_PREFRAMES, &preframes, &unused);
+    mpg123_param(mh, MPG123_PREFRAMES, MP3_OVERLAP_FRAMES, 0);
+    
+    mpg123_format_none(mh);
+    mpg123_format(mh, segment->sample_rate, segment->channels, MPG123_ENC_FLOAT_32);
+    
+    // Индекс берем готовый, без повторного сканирования файла
+    if (mpg123_open(mh, segment->filename) == MPG123_OK &&
+        mpg123_set_index(mh, segment->index, segment->index_step, segment->index_fill) == MPG123_OK &&
+        mpg123_seek(mh, segment->start, SEEK_SET) >= 0) {
+        segment->ok = decode_segment(mh, segment);
+    }
+    
+    mpg123_param(mh, MPG123_PREFRAMES, preframes, 0);
+    release_handle(mh);
+    return NULL;
+}
+
+// Стык совпадает, если хвост предыдущего отрезка побитно равен началу следующего.
+// Пустой следующий отрезок - поток кончился раньше оценки длины, стыка нет
+static int seam_matches(const Mp3Segment* previous, const Mp3Segment* next) {
+    if (next->reached == next->start) return 1;
+    // Предыдущий оборвался до границы, а дальше данные есть: дыра в середине
+    if (previous->reached < previous->end) return 0;
+    
+    off_t count = next->reached - next->start;
+    if (count > previous->tail_reached) count = previous->tail_reached;
+    return memcmp(previous->tail, next->pcm + next->start * next->channels,
+                  count * next->channels * sizeof(float)) == 0;
+}
+
+// Декодирует length фреймов отрезками в pcm. Возвращает число фреймов или -1,
+// в том числе если стык разошелся с последовательным декодированием
+static long decode_parallel(mpg123_handle* mh, const char* filename, long sample_rate, int channels,
+                            float* pcm, off_t length, int workers, const DecodeAllOptions* options) {
+    off_t* index;
+    off_t index_step;
+    size_t index_fill;
+    if (mpg123_index(mh, &index, &index_step, &index_fill) != MPG123_OK) return -1;
+    
+    // Границы кратны шагу индекса: отрезок начинается с проиндексированного фрейма
+    int spf = mpg123_spf(mh);
+    off_t unit = spf > 0 ? spf * index_step : 1;
+    off_t bounds[MP3_MAX_WORKERS + 1];
+    bounds[0] = 0;
+    bounds[workers] = length;
+    for (int i = 1; i < workers; i++) bounds[i] = length * i / workers / unit * unit;
+    
+    Mp3Segment segments[MP3_MAX_WORKERS];
+    pthread_t threads[MP3_MAX_WORKERS];
+    int started[MP3_MAX_WORKERS] = {0};
+    int ok = 1;
+    
+    for (int i = 0; i < workers; i++) {
+        segments[i] = (Mp3Segment){
+            .filename = filename,
+            .sample_rate = sample_rate,
+            .channels = channels,
+            .index = index,
+            .index_step = index_step,
+            .index_fill = index_fill,
+            .pcm = pcm,
+            .start = bounds[i],
+            .end = bounds[i + 1],
+            .options = options
+        };
+        if (i + 1 < workers) {
+            segments[i].tail = malloc(MP3_SEAM_CHECK_FRAMES * channels * sizeof(float));
+            if (!segments[i].tail) ok = 0;
+        }
+    }
+    
+    for (int i = 1; i < workers && ok; i++) {
+        started[i] = pthread_create(&threads[i], NULL, segment_worker, &segments[i]) == 0;
+    }
+    
+    // Первый отрезок декодирует основной дескриптор. Его индекс нужен
+    // остальным, поэтому он остается открытым до конца
+    if (ok) ok = mpg123_seek(mh, 0, SEEK_SET) >= 0 && decode_segment(mh, &segments[0]);
+    off_t position = segments[0].reached;
+    
+    for (int i = 1; i < workers; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else if (ok) segment_worker(&segments[i]);  // Поток не создался: декодируем здесь
+        
+        if (!ok || !segments[i].ok || !seam_matches(&segments[i - 1], &segments[i])) ok = 0;
+        if (segments[i].reached > segments[i].start) position = segments[i].reached;
+    }
+    
+    for (int i = 0; i < workers; i++) free(segments[i].tail);
+    return ok ? (long)position : -1;
+}
+
+long decoder_decode_all(const char* filename, float* pcm, uint64_t frames, DecodeAllOptions* options) {
+    options->mode = DECODE_ALL_SERIAL;
+    mpg123_handle* mh = acquire_handle();
+    if (!mh) return -1;
+    
+    // Индекс всех фреймов: по нему режется файл на отрезки
+    mpg123_param(mh, MPG123_INDEX_SIZE, -1000, 0);
+    
+    long sample_rate;
+    int channels, encoding;
+    if (mpg123_open(mh, filename) != MPG123_OK ||
+        mpg123_getformat(mh, &sample_rate, &channels, &encoding) != MPG123_OK) {
+        release_handle(mh);
+        return -1;
     }
     
+    // Тот же формат, что в decoder_open: отсчеты совпадают с потоковым чтением
+    mpg123_format_none(mh);
+    if (mpg123_format(mh, sample_rate, channels, MPG123_ENC_FLOAT_32) != MPG123_OK) {
+        release_handle(mh);
+        return -1;
+    }
+    
+    // Полное сканирование дает точную длину и индекс фреймов
+    int workers = mp3_worker_count(sample_rate, mpg123_length(mh), options->threads);
+    if (workers > 1 && mpg123_scan(mh) != MPG123_OK) workers = 1;
+    
+    off_t length = mpg123_length(mh);
+    if (length <= 0 || (uint64_t)length > frames) length = frames;
+    
+    long decoded = -1;
+    if (workers > 1) {
+        decoded = decode_parallel(mh, filename, sample_rate, channels, pcm, length, workers, options);
+        if (decoded >= 0) options->mode = DECODE_ALL_PARALLEL;
+        else if (!decode_cancelled(options)) options->mode = DECODE_ALL_FALLBACK;
+    }
+    
+    // Один поток, ошибка в отрезке или расхождение на стыке: декодируем подряд.
+    // После отмены заново не декодируем
+    if (decoded < 0 && !decode_cancelled(options) && mpg123_seek(mh, 0, SEEK_SET) >= 0) {
+        off_t got = 0;
+        if (read_frames(mh, pcm, channels, length, &got, options) == 0) decoded = (long)got;
+    }
+    
+    release_handle(mh);
+    return decoded;
+}
+
+// Старый интерфейс: весь файл в 16 бит, последовательно
+
+AudioData* decode_mp3(const char* filename) {
+    mpg123_handle *mh = acquire_handle();
+    if (!mh) return NULL;
+    
     // Открытие файла
     if (mpg123_open(mh, filename) != MPG123_OK) {
         fprintf(stderr, "mpg123_open failed: %s\n", mpg123_strerror(mh));
-        mpg123_delete(mh);
-        mpg123_exit();
+        release_handle(mh);
         return NULL;
     }
     
@@ -36,9 +327,7 @@ AudioData* decode_mp3(const char* filename) {
     int channels, encoding;
     if (mpg123_getformat(mh, &sample_rate, &channels, &encoding) != MPG123_OK) {
         fprintf(stderr, "mpg123_getformat failed: %s\n", mpg123_strerror(mh));
-        mpg123_close(mh);
-        mpg123_delete(mh);
-        mpg123_exit();
+        release_handle(mh);
         return NULL;
     }
     
@@ -50,9 +339,7 @@ AudioData* decode_mp3(const char* filename) {
     AudioData* audio = malloc(sizeof(AudioData));
     if (!audio) {
         fprintf(stderr, "Memory allocation failed for AudioData\n");
-        mpg123_close(mh);
-        mpg123_delete(mh);
-        mpg123_exit();
+        release_handle(mh);
         return NULL;
     }
     
@@ -64,9 +351,7 @@ AudioData* decode_mp3(const char* filename) {
     if (length == MPG123_ERR) {
         fprintf(stderr, "mpg123_length failed: %s\n", mpg123_strerror(mh));
         free(audio);
-        mpg123_close(mh);
-        mpg123_delete(mh);
-        mpg123_exit();
+        release_handle(mh);
         return NULL;
     }
     
@@ -77,9 +362,7 @@ AudioData* decode_mp3(const char* filename) {
     if (!audio->pcm_data) {
         fprintf(stderr, "Memory allocation failed for PCM data\n");
         free(audio);
-        mpg123_close(mh);
-        mpg123_delete(mh);
-        mpg123_exit();
+        release_handle(mh);
         return NULL;
     }
     
@@ -108,9 +391,7 @@ AudioData* decode_mp3(const char* filename) {
         fprintf(stderr, "MP3 decoding error: %s\n", mpg123_strerror(mh));
         free(audio->pcm_data);
         free(audio);
-        mpg123_close(mh);
-        mpg123_delete(mh);
-        mpg123_exit();
+        release_handle(mh);
         return NULL;
     }
     
@@ -118,9 +399,7 @@ AudioData* decode_mp3(const char* filename) {
     audio->samples_count = decoded_size;
     
     // Очистка
-    mpg123_close(mh);
-    mpg123_delete(mh);
-    mpg123_exit();
+    release_handle(mh);
     
     return audio;
 }
@@ -131,3 +410,154 @@ void free_audio_data(AudioData* audio) {
         free(audio);
     }
 }
+
+// Потоковый интерфейс
+
+struct DecoderStream {
+    mpg123_handle* mh;
+    int channels;
+    int scanned;
+};
+
+DecoderStream* decoder_open(const char* filename, StreamInfo* info) {
+    DecoderStream* stream = calloc(1, sizeof(DecoderStream));
+    if (!stream) return NULL;
+    
+    stream->mh = acquire_handle();
+    if (!stream->mh) {
+        free(stream);
+        return NULL;
+    }
+    
+    // Отрицательный размер: индекс растет и хранит смещение каждого MPEG фрейма
+    mpg123_param(stream->mh, MPG123_INDEX_SIZE, -1000, 0);
+    
+    if (mpg123_open(stream->mh, filename) != MPG123_OK) {
+        fprintf(stderr, "mpg123_open failed: %s\n", mpg123_strerror(stream->mh));
+        decoder_close(stream);
+        return NULL;
+    }
+    
+    long sample_rate;
+    int channels, encoding;
+    if (mpg123_getformat(stream->mh, &sample_rate, &channels, &encoding) != MPG123_OK) {
+        fprintf(stderr, "mpg123_getformat failed: %s\n", mpg123_strerror(stream->mh));
+        decoder_close(stream);
+        return NULL;
+    }
+    
+    // Фиксируем формат, чтобы он не поменялся посреди потока.
+    // float отдает синтез-фильтр mpg123 без округления до 16 бит
+    mpg123_format_none(stream->mh);
+    if (mpg123_format(stream->mh, sample_rate, channels, MPG123_ENC_FLOAT_32) != MPG123_OK) {
+        fprintf(stderr, "mpg123_format failed: %s\n", mpg123_strerror(stream->mh));
+        decoder_close(stream);
+        return NULL;
+    }
+    
+    stream->channels = channels;
+    
+    off_t length = mpg123_length(stream->mh);
+    info->sample_rate = sample_rate;
+    info->channels = channels;
+    info->total_frames = length == MPG123_ERR ? 0 : (uint64_t)length;
+    
+    return stream;
+}
+
+long decoder_read(DecoderStream* stream, float* buffer, long frames) {
+    size_t frame_bytes = stream->channels * sizeof(float);
+    size_t wanted = frames * frame_bytes;
+    size_t total = 0;
+    
+    while (total < wanted) {
+        size_t done = 0;
+        int err = mpg123_read(stream->mh, (unsigned char*)buffer + total, wanted - total, &done);
+        total += done;
+        
+        if (err == MPG123_DONE) break;
+        if (err == MPG123_NEW_FORMAT) continue;
+        if (err != MPG123_OK) {
+            fprintf(stderr, "MP3 decoding error: %s\n", mpg123_strerror(stream->mh));
+            if (total == 0) return -1;
+            break;
+        }
+    }
+    
+    return total / frame_bytes;
+}
+
+int decoder_seek(DecoderStream* stream, uint64_t frame) {
+    // Полный индекс строится один раз при первой перемотке, а не при открытии,
+    // чтобы не задерживать старт. Дальше mpg123_seek ищет фрейм по индексу
+    if (!stream->scanned) {
+        if (mpg123_scan(stream->mh) != MPG123_OK) {
+            fprintf(stderr, "mpg123_scan failed: %s\n", mpg123_strerror(stream->mh));
+        }
+        stream->scanned = 1;
+    }
+    
+    return mpg123_seek(stream->mh, (off_t)frame, SEEK_SET) < 0 ? -1 : 0;
+}
+
+void decoder_close(DecoderStream* stream) {
+    if (!stream) return;
+    
+    // Дескриптор возвращается в пул для следующего трека
+    release_handle(stream->mh);
+    free(stream);
+}
+
+// ReplayGain в ID3v2 лежит в пользовательских кадрах TXXX
+int decoder_replaygain(DecoderStream* stream, ReplayGainInfo* info) {
+    replaygain_clear(info);
+    
+    mpg123_id3v1* v1;
+    mpg123_id3v2* v2;
+    if (!(mpg123_meta_check(stream->mh) & MPG123_ID3) ||
+        mpg123_id3(stream->mh, &v1, &v2) != MPG123_OK || !v2) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < v2->extras; i++) {
+        const mpg123_text* extra = &v2->extra[i];
+        if (!extra->description.p || !extra->text.p) continue;
+        replaygain_parse(extra->description.p, strlen(extra->description.p), extra->text.p, info);
+    }
+    return replaygain_result(info);
+}
+
+int decoder_init(void) {
+    pthread_once(&library_once, library_init);
+    return library_ready ? 0 : -1;
+}
+
+void decoder_shutdown(void) {
+    pthread_mutex_lock(&pool_mutex);
+    while (handle_pool_count > 0) mpg123_delete(handle_pool[--handle_pool_count]);
+    pthread_mutex_unlock(&pool_mutex);
+    
+    if (library_ready) mpg123_exit();
+}
+
+// Заголовок MPEG audio: синхрослово 11 бит, допустимые слой, битрейт и частота
+static int is_mpeg_frame_header(const unsigned char* p) {
+    return p[0] == 0xFF && (p[1] & 0xE0) == 0xE0 &&
+           ((p[1] >> 1) & 3) != 0 &&       // layer
+           ((p[2] >> 4) & 0xF) != 0xF &&   // bitrate
+           ((p[2] >> 2) & 3) != 3;         // sample rate
+}
+
+int decoder_probe(const unsigned char* header, size_t size, const char* filename) {
+    const char* ext = strrchr(filename, '.');
+    int has_extension = ext && strcasecmp(ext, ".mp3") == 0;
+    
+    if (size >= 3 && memcmp(header, "ID3", 3) == 0) {
+        // ID3 бывает и перед FLAC, поэтому без расширения не уверены
+        return has_extension ? 90 : 50;
+    }
+    if (size >= 4 && is_mpeg_frame_header(header)) return has_extension ? 90 : 60;
+    
+    // mpg123 сам ищет синхрослово после мусора в начале
+    return has_extension ? 20 : 0;
+}
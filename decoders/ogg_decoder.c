@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <vorbis/vorbisfile.h>
+#include "decoder_api.h"
+#include "replaygain_tags.h"
 
 typedef struct {
     int16_t* pcm_data;
@@ -37,7 +39,7 @@ AudioData* decode_ogg(const char* filename) {
     audio->sample_rate = vi->rate;
     audio->channels = vi->channels;
     audio->samples_count = ov_pcm_total(&vf, -1) * vi->channels;
-    
+
     // Выделение памяти под PCM данные
     audio->pcm_data = malloc(audio->samples_count * sizeof(int16_t));
     if (!audio->pcm_data) {
@@ -72,3 +74,106 @@ void free_audio_data(AudioData* audio) {
         free(audio);
     }
 }
+
+// Потоковый интерфейс
+
+struct DecoderStream {
+    OggVorbis_File vf;
+    int channels;
+};
+
+DecoderStream* decoder_open(const char* filename, StreamInfo* info) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    DecoderStream* stream = calloc(1, sizeof(DecoderStream));
+    if (!stream) {
+        fclose(file);
+        return NULL;
+    }
+
+    if (ov_open_callbacks(file, &stream->vf, NULL, 0, OV_CALLBACKS_DEFAULT) < 0) {
+        fclose(file);
+        free(stream);
+        return NULL;
+    }
+
+    vorbis_info* vi = ov_info(&stream->vf, -1);
+    if (!vi) {
+        decoder_close(stream);
+        return NULL;
+    }
+
+    ogg_int64_t total = ov_pcm_total(&stream->vf, -1);
+
+    stream->channels = vi->channels;
+    info->sample_rate = vi->rate;
+    info->channels = vi->channels;
+    info->total_frames = total > 0 ? (uint64_t)total : 0;
+
+    return stream;
+}
+
+long decoder_read(DecoderStream* stream, float* buffer, long frames) {
+    int channels = stream->channels;
+    long total = 0;
+    int current_section = 0;
+
+    while (total < frames) {
+        // ov_read_float отдает синтез без квантования, по отдельному массиву на канал
+        float** pcm;
+        long ret = ov_read_float(&stream->vf, &pcm, frames - total, &current_section);
+        if (ret == OV_HOLE) continue;  // Пропуск в потоке, продолжаем
+        if (ret < 0) {
+            if (total == 0) return -1;
+            break;
+        }
+        if (ret == 0) break;
+
+        float* out = buffer + total * channels;
+        for (int channel = 0; channel < channels; channel++) {
+            const float* src = pcm[channel];
+            for (long i = 0; i < ret; i++) out[i * channels + channel] = src[i];
+        }
+        total += ret;
+    }
+
+    return total;
+}
+
+int decoder_seek(DecoderStream* stream, uint64_t frame) {
+    // ov_pcm_seek точен до сэмпла: бисекция по страницам, затем декодирование до позиции
+    return ov_pcm_seek(&stream->vf, (ogg_int64_t)frame) == 0 ? 0 : -1;
+}
+
+int decoder_replaygain(DecoderStream* stream, ReplayGainInfo* info) {
+    replaygain_clear(info);
+
+    vorbis_comment* comments = ov_comment(&stream->vf, -1);
+    if (!comments) return -1;
+
+    for (int i = 0; i < comments->comments; i++) {
+        replaygain_parse_comment(comments->user_comments[i], comments->comment_lengths[i], info);
+    }
+    return replaygain_result(info);
+}
+
+void decoder_close(DecoderStream* stream) {
+    if (!stream) return;
+
+    ov_clear(&stream->vf);
+    free(stream);
+}
+
+int decoder_probe(const unsigned char* header, size_t size, const char* filename) {
+    (void)filename;
+    if (size < 4 || memcmp(header, "OggS", 4) != 0) return 0;
+
+    // Первая страница содержит заголовок кодека: у Vorbis это "\x01vorbis"
+    // сразу за таблицей сегментов
+    if (size >= 27) {
+        size_t offset = 27 + header[26];
+        if (offset + 7 <= size && memcmp(header + offset, "\x01vorbis", 7) == 0) return 100;
+    }
+    return 0;
+}
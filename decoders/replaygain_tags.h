@@ -0,0 +1,57 @@
+#ifndef REPLAYGAIN_TAGS_H
+#define REPLAYGAIN_TAGS_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "decoder_api.h"
+
+// Разбор тегов REPLAYGAIN_* (Vorbis comment, TXXX в ID3v2).
+// Нужен нескольким плагинам, поэтому целиком в заголовке
+
+static inline void replaygain_clear(ReplayGainInfo* info) {
+    info->track_gain = NAN;
+    info->track_peak = NAN;
+    info->album_gain = NAN;
+    info->album_peak = NAN;
+}
+
+// Ключ без учета регистра и значение вида "-6.52 dB" или "0.988525"
+static inline void replaygain_parse(const char* key, size_t key_length, const char* value, ReplayGainInfo* info) {
+    static const char prefix[] = "REPLAYGAIN_";
+    size_t prefix_length = sizeof(prefix) - 1;
+    if (key_length <= prefix_length || strncasecmp(key, prefix, prefix_length) != 0) return;
+
+    char* end;
+    float number = strtof(value, &end);
+    if (end == value || !isfinite(number)) return;
+
+    key += prefix_length;
+    key_length -= prefix_length;
+    if (key_length == 10 && strncasecmp(key, "TRACK_GAIN", 10) == 0) info->track_gain = number;
+    else if (key_length == 10 && strncasecmp(key, "TRACK_PEAK", 10) == 0) info->track_peak = number;
+    else if (key_length == 10 && strncasecmp(key, "ALBUM_GAIN", 10) == 0) info->album_gain = number;
+    else if (key_length == 10 && strncasecmp(key, "ALBUM_PEAK", 10) == 0) info->album_peak = number;
+}
+
+// Комментарий "KEY=value" длиной length, без завершающего нуля
+static inline void replaygain_parse_comment(const char* comment, size_t length, ReplayGainInfo* info) {
+    const char* separator = memchr(comment, '=', length);
+    if (!separator) return;
+
+    char value[32];
+    size_t value_length = length - (separator + 1 - comment);
+    if (value_length >= sizeof(value)) return;
+    memcpy(value, separator + 1, value_length);
+    value[value_length] = '\0';
+
+    replaygain_parse(comment, separator - comment, value, info);
+}
+
+// Результат для decoder_replaygain
+static inline int replaygain_result(const ReplayGainInfo* info) {
+    return isnan(info->track_gain) ? -1 : 0;
+}
+
+#endif
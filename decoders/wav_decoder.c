@@ -2,22 +2,17 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "decoder_api.h"
 
-typedef struct {
-    char     riff[4];
-    uint32_t file_size;
-    char     wave[4];
-    char     fmt[4];
-    uint32_t fmt_size;
-    uint16_t audio_format;
-    uint16_t num_channels;
-    uint32_t sample_rate;
-    uint32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample;
-    char     data[4];
-    uint32_t data_size;
-} WavHeader;
+#define WAVE_FORMAT_PCM        0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+#define WILLNEED_WINDOW (1 << 20)  // Сколько байт впереди просить у ядра заранее
 
 typedef struct {
     int16_t* pcm_data;
@@ -26,53 +21,342 @@ typedef struct {
     int channels;
 } AudioData;
 
-AudioData* decode_wav(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) return NULL;
+// Файл, отображенный в память целиком. PCM читается прямо из отображения
+typedef struct {
+    unsigned char* map;
+    size_t map_size;
+    const unsigned char* pcm;   // Начало чанка data внутри отображения
+    uint64_t data_size;
+    int format;                 // WAVE_FORMAT_PCM или WAVE_FORMAT_IEEE_FLOAT
+    int bits_per_sample;
+    int block_align;
+    int sample_rate;
+    int channels;
+    uint64_t total_frames;
+} WavFile;
 
-    WavHeader header;
-    if (fread(&header, sizeof(WavHeader), 1, file) != 1) {
-        fclose(file);
-        return NULL;
+static uint16_t read_le16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t read_le32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int wav_format_supported(int format, int bits) {
+    if (format == WAVE_FORMAT_PCM) {
+        return bits == 8 || bits == 16 || bits == 24 || bits == 32;
     }
+    if (format == WAVE_FORMAT_IEEE_FLOAT) {
+        return bits == 32 || bits == 64;
+    }
+    return 0;
+}
 
-    // Validate WAV format
-    if (memcmp(header.riff, "RIFF", 4) != 0 || 
-        memcmp(header.wave, "WAVE", 4) != 0 ||
-        memcmp(header.fmt, "fmt ", 4) != 0 ||
-        memcmp(header.data, "data", 4) != 0 ||
-        header.audio_format != 1) {
-        fclose(file);
-        return NULL;
+// Просим ядро заранее подгрузить окно данных начиная с offset
+static void wav_advise(const WavFile* wav, uint64_t offset) {
+    if (offset >= wav->data_size) return;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)(wav->pcm + offset) & ~(uintptr_t)(page - 1);
+    uintptr_t end = (uintptr_t)(wav->map + wav->map_size);
+    size_t length = end - start < WILLNEED_WINDOW ? end - start : WILLNEED_WINDOW;
+    madvise((void*)start, length, MADV_WILLNEED);
+}
+
+static void wav_unmap(WavFile* wav) {
+    if (wav->map) munmap(wav->map, wav->map_size);
+    wav->map = NULL;
+}
+
+// Отображение файла и разбор RIFF чанков. 0 при успехе
+static int wav_map(const char* filename, WavFile* wav) {
+    memset(wav, 0, sizeof(WavFile));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+        close(fd);
+        return -1;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    wav->map = map;
+    wav->map_size = st.st_size;
+    madvise(wav->map, wav->map_size, MADV_SEQUENTIAL);
+
+    const unsigned char* p = wav->map;
+    const unsigned char* end = wav->map + wav->map_size;
+
+    if (memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+        wav_unmap(wav);
+        return -1;
+    }
+
+    // Обходим чанки: LIST, fact, bext и прочие просто пропускаем
+    int have_fmt = 0;
+    p += 12;
+    while (end - p >= 8) {
+        uint32_t chunk_size = read_le32(p + 4);
+        const unsigned char* body = p + 8;
+        uint64_t available = end - body;
+
+        if (memcmp(p, "fmt ", 4) == 0 && chunk_size >= 16 && available >= 16) {
+            wav->format = read_le16(body);
+            wav->channels = read_le16(body + 2);
+            wav->sample_rate = read_le32(body + 4);
+            wav->block_align = read_le16(body + 12);
+            wav->bits_per_sample = read_le16(body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE: настоящий формат в первых байтах SubFormat GUID
+            if (wav->format == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40 && available >= 40) {
+                wav->format = read_le16(body + 24);
+            }
+            have_fmt = 1;
+        } else if (memcmp(p, "data", 4) == 0) {
+            wav->pcm = body;
+            // Размер 0 или 0xFFFFFFFF пишут при записи потоком: данные до конца файла
+            wav->data_size = (chunk_size == 0 || chunk_size > available) ? available : chunk_size;
+            break;
+        }
+
+        uint64_t step = 8 + (uint64_t)chunk_size + (chunk_size & 1);
+        if (step > (uint64_t)(end - p)) break;
+        p += step;
+    }
+
+    if (!have_fmt || !wav->pcm || wav->channels <= 0 || wav->sample_rate <= 0 ||
+        !wav_format_supported(wav->format, wav->bits_per_sample) ||
+        wav->block_align != wav->channels * (wav->bits_per_sample / 8)) {
+        wav_unmap(wav);
+        return -1;
+    }
+
+    wav->total_frames = wav->data_size / wav->block_align;
+
+    // Начало данных понадобится сразу
+    wav_advise(wav, 0);
+
+    return 0;
+}
+
+// 16-бит PCM на little-endian машине можно отдавать без преобразования
+static int wav_is_native_s16(const WavFile* wav) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return wav->format == WAVE_FORMAT_PCM && wav->bits_per_sample == 16 &&
+           ((uintptr_t)wav->pcm & 1) == 0;
+#else
+    return 0;
+#endif
+}
+
+// Преобразование samples отсчетов из формата файла в int16
+static void wav_convert(const WavFile* wav, const unsigned char* src, int16_t* dst, size_t samples) {
+    size_t i;
+
+    if (wav->format == WAVE_FORMAT_IEEE_FLOAT) {
+        for (i = 0; i < samples; i++) {
+            double value;
+            if (wav->bits_per_sample == 32) {
+                float f;
+                memcpy(&f, src + i * 4, 4);
+                value = f;
+            } else {
+                memcpy(&value, src + i * 8, 8);
+            }
+
+            value *= 32768.0;
+            if (value > 32767.0) value = 32767.0;
+            else if (value < -32768.0) value = -32768.0;
+            dst[i] = (int16_t)value;
+        }
+        return;
     }
 
-    AudioData* audio = malloc(sizeof(AudioData));
-    if (!audio) {
-        fclose(file);
+    switch (wav->bits_per_sample) {
+        case 8:
+            for (i = 0; i < samples; i++) dst[i] = (int16_t)((src[i] - 128) * 256);
+            break;
+        case 16:
+            for (i = 0; i < samples; i++) dst[i] = (int16_t)read_le16(src + i * 2);
+            break;
+        case 24:
+            // Берем старшие 16 бит
+            for (i = 0; i < samples; i++) dst[i] = (int16_t)read_le16(src + i * 3 + 1);
+            break;
+        case 32:
+            for (i = 0; i < samples; i++) dst[i] = (int16_t)read_le16(src + i * 4 + 2);
+            break;
+    }
+}
+
+// То же в float [-1, 1] для потокового чтения, без потери разрядности
+static void wav_convert_float(const WavFile* wav, const unsigned char* src, float* dst, size_t samples) {
+    size_t i;
+
+    if (wav->format == WAVE_FORMAT_IEEE_FLOAT) {
+        if (wav->bits_per_sample == 32) {
+            memcpy(dst, src, samples * sizeof(float));
+        } else {
+            for (i = 0; i < samples; i++) {
+                double value;
+                memcpy(&value, src + i * 8, 8);
+                dst[i] = (float)value;
+            }
+        }
+        return;
+    }
+
+    switch (wav->bits_per_sample) {
+        case 8:
+            for (i = 0; i < samples; i++) dst[i] = (src[i] - 128) * (1.0f / 128);
+            break;
+        case 16:
+            for (i = 0; i < samples; i++) dst[i] = (int16_t)read_le16(src + i * 2) * (1.0f / 32768);
+            break;
+        case 24:
+            // Собираем 24 бита в старших разрядах int32, знак получается сам
+            for (i = 0; i < samples; i++) {
+                const unsigned char* p = src + i * 3;
+                int32_t value = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+                dst[i] = value * (1.0f / 2147483648.0f);
+            }
+            break;
+        case 32:
+            for (i = 0; i < samples; i++) dst[i] = (int32_t)read_le32(src + i * 4) * (1.0f / 2147483648.0f);
+            break;
+    }
+}
+
+// Полное декодирование. 16-бит PCM не копируется: pcm_data указывает в отображение
+typedef struct {
+    AudioData audio;    // Первым полем: плеер видит только AudioData
+    WavFile wav;
+    int owns_pcm;
+} WavAudioData;
+
+AudioData* decode_wav(const char* filename) {
+    WavAudioData* data = calloc(1, sizeof(WavAudioData));
+    if (!data) return NULL;
+
+    if (wav_map(filename, &data->wav) != 0) {
+        free(data);
         return NULL;
     }
 
-    audio->sample_rate = header.sample_rate;
-    audio->channels = header.num_channels;
-    audio->samples_count = header.data_size / (header.bits_per_sample/8);
-    
-    audio->pcm_data = malloc(header.data_size);
+    WavFile* wav = &data->wav;
+    AudioData* audio = &data->audio;
+    size_t samples = wav->total_frames * wav->channels;
+
+    audio->sample_rate = wav->sample_rate;
+    audio->channels = wav->channels;
+    audio->samples_count = samples;
+
+    if (wav_is_native_s16(wav)) {
+        audio->pcm_data = (int16_t*)wav->pcm;
+        data->owns_pcm = 0;
+        return audio;
+    }
+
+    audio->pcm_data = malloc(samples * sizeof(int16_t));
     if (!audio->pcm_data) {
-        free(audio);
-        fclose(file);
+        wav_unmap(wav);
+        free(data);
         return NULL;
     }
 
-    fseek(file, sizeof(WavHeader), SEEK_SET);
-    fread(audio->pcm_data, 1, header.data_size, file);
-    fclose(file);
+    wav_convert(wav, wav->pcm, audio->pcm_data, samples);
+    data->owns_pcm = 1;
 
+    // Данные скопированы, отображение больше не нужно
+    wav_unmap(wav);
     return audio;
 }
 
 void free_audio_data(AudioData* audio) {
     if (audio) {
-        free(audio->pcm_data);
-        free(audio);
+        WavAudioData* data = (WavAudioData*)audio;
+        if (data->owns_pcm) free(audio->pcm_data);
+        wav_unmap(&data->wav);
+        free(data);
     }
 }
+
+// Потоковый интерфейс
+
+struct DecoderStream {
+    WavFile wav;
+    uint64_t position;      // Текущий фрейм
+    uint64_t advised;       // До какого байта данных уже запрошен WILLNEED
+};
+
+DecoderStream* decoder_open(const char* filename, StreamInfo* info) {
+    DecoderStream* stream = calloc(1, sizeof(DecoderStream));
+    if (!stream) return NULL;
+
+    if (wav_map(filename, &stream->wav) != 0) {
+        free(stream);
+        return NULL;
+    }
+
+    stream->advised = WILLNEED_WINDOW;
+
+    info->sample_rate = stream->wav.sample_rate;
+    info->channels = stream->wav.channels;
+    info->total_frames = stream->wav.total_frames;
+
+    return stream;
+}
+
+long decoder_read(DecoderStream* stream, float* buffer, long frames) {
+    WavFile* wav = &stream->wav;
+    uint64_t left = wav->total_frames - stream->position;
+    if ((uint64_t)frames > left) frames = left;
+    if (frames <= 0) return 0;
+
+    uint64_t offset = stream->position * wav->block_align;
+    const unsigned char* src = wav->pcm + offset;
+
+    // Подсказываем ядру следующее окно, пока играет текущее
+    if (offset + frames * wav->block_align > stream->advised) {
+        wav_advise(wav, stream->advised);
+        stream->advised += WILLNEED_WINDOW;
+    }
+
+    wav_convert_float(wav, src, buffer, frames * wav->channels);
+
+    stream->position += frames;
+    return frames;
+}
+
+int decoder_seek(DecoderStream* stream, uint64_t frame) {
+    if (frame > stream->wav.total_frames) frame = stream->wav.total_frames;
+    stream->position = frame;
+    stream->advised = frame * stream->wav.block_align;
+    wav_advise(&stream->wav, stream->advised);
+    stream->advised += WILLNEED_WINDOW;
+    return 0;
+}
+
+void decoder_close(DecoderStream* stream) {
+    if (!stream) return;
+
+    wav_unmap(&stream->wav);
+    free(stream);
+}
+
+int decoder_probe(const unsigned char* header, size_t size, const char* filename) {
+    (void)filename;
+    if (size >= 12 && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0) return 100;
+    return 0;
+}
+
+// Отсчеты берутся из отображенного в память файла
+int decoder_flags(void) {
+    return DECODER_FLAG_DIRECT;
+}
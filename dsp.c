@@ -0,0 +1,346 @@
+#include <string.h>
+#include <math.h>
+#include "dsp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DSP_X86 1
+#endif
+
+// Ядра: count отсчетов, громкость gain для первого и +step на каждый следующий.
+// Выбираются один раз при запуске по возможностям процессора
+
+typedef void (*gain_f32_fn)(const float* src, float* dst, size_t count, float gain, float step);
+typedef void (*dither_s16_fn)(DitherState* state, const float* src, int16_t* dst, size_t count);
+typedef void (*convert_s32_fn)(const float* src, int32_t* dst, size_t count);
+typedef void (*mix_f32_fn)(const float* a, const float* b, float* dst, size_t count,
+                           float gain_a, float step_a, float gain_b, float step_b);
+
+#define S32_MAX_FLOAT 2147483520.0f  // Наибольший float меньше 2^31
+
+static void gain_f32_scalar(const float* src, float* dst, size_t count, float gain, float step) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = src[i] * (gain + step * i);
+    }
+}
+
+static void mix_f32_scalar(const float* a, const float* b, float* dst, size_t count,
+                           float gain_a, float step_a, float gain_b, float step_b) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = a[i] * (gain_a + step_a * i) + b[i] * (gain_b + step_b * i);
+    }
+}
+
+// xorshift32: шум не должен быть качественным, только дешевым и без периода на слух
+static inline uint32_t dither_next(uint32_t* x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+// Равномерное число [0, 1) из старших 23 бит
+static inline float dither_uniform(uint32_t bits) {
+    union { uint32_t u; float f; } v = { (bits >> 9) | 0x3F800000u };
+    return v.f - 1.0f;
+}
+
+static void dither_s16_scalar(DitherState* state, const float* src, int16_t* dst, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t* x = &state->state[i & 7];
+        // Разность двух равномерных дает треугольное распределение (-1, 1)
+        float noise = dither_uniform(dither_next(x)) - dither_uniform(dither_next(x));
+        float value = src[i] * 32768.0f + noise;
+        if (value > 32767.0f) value = 32767.0f;
+        else if (value < -32768.0f) value = -32768.0f;
+        dst[i] = (int16_t)lrintf(value);
+    }
+}
+
+static void convert_s32_scalar(const float* src, int32_t* dst, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float value = src[i] * 2147483648.0f;
+        if (value > S32_MAX_FLOAT) value = S32_MAX_FLOAT;
+        else if (value < -2147483648.0f) value = -2147483648.0f;
+        dst[i] = (int32_t)lrintf(value);
+    }
+}
+
+#ifdef DSP_X86
+
+// SSE2 есть на любом x86_64, но на i386 его тоже проверяем
+__attribute__((target("sse2")))
+static void gain_f32_sse2(const float* src, float* dst, size_t count, float gain, float step) {
+    __m128 g = _mm_setr_ps(gain, gain + step, gain + step * 2, gain + step * 3);
+    __m128 g_inc = _mm_set1_ps(step * 4);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        g = _mm_add_ps(g, g_inc);
+    }
+    gain_f32_scalar(src + i, dst + i, count - i, gain + step * i, step);
+}
+
+__attribute__((target("sse2")))
+static void mix_f32_sse2(const float* a, const float* b, float* dst, size_t count,
+                         float gain_a, float step_a, float gain_b, float step_b) {
+    __m128 ga = _mm_setr_ps(gain_a, gain_a + step_a, gain_a + step_a * 2, gain_a + step_a * 3);
+    __m128 gb = _mm_setr_ps(gain_b, gain_b + step_b, gain_b + step_b * 2, gain_b + step_b * 3);
+    __m128 ga_inc = _mm_set1_ps(step_a * 4);
+    __m128 gb_inc = _mm_set1_ps(step_b * 4);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 va = _mm_mul_ps(_mm_loadu_ps(a + i), ga);
+        __m128 vb = _mm_mul_ps(_mm_loadu_ps(b + i), gb);
+        _mm_storeu_ps(dst + i, _mm_add_ps(va, vb));
+        ga = _mm_add_ps(ga, ga_inc);
+        gb = _mm_add_ps(gb, gb_inc);
+    }
+    mix_f32_scalar(a + i, b + i, dst + i, count - i,
+                   gain_a + step_a * i, step_a, gain_b + step_b * i, step_b);
+}
+
+__attribute__((target("avx2")))
+static void gain_f32_avx2(const float* src, float* dst, size_t count, float gain, float step) {
+    __m256 ramp = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 g = _mm256_add_ps(_mm256_set1_ps(gain), _mm256_mul_ps(ramp, _mm256_set1_ps(step)));
+    __m256 g_inc = _mm256_set1_ps(step * 8);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+        g = _mm256_add_ps(g, g_inc);
+    }
+    gain_f32_sse2(src + i, dst + i, count - i, gain + step * i, step);
+}
+
+__attribute__((target("avx2")))
+static void mix_f32_avx2(const float* a, const float* b, float* dst, size_t count,
+                         float gain_a, float step_a, float gain_b, float step_b) {
+    __m256 ramp = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 ga = _mm256_add_ps(_mm256_set1_ps(gain_a), _mm256_mul_ps(ramp, _mm256_set1_ps(step_a)));
+    __m256 gb = _mm256_add_ps(_mm256_set1_ps(gain_b), _mm256_mul_ps(ramp, _mm256_set1_ps(step_b)));
+    __m256 ga_inc = _mm256_set1_ps(step_a * 8);
+    __m256 gb_inc = _mm256_set1_ps(step_b * 8);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 va = _mm256_mul_ps(_mm256_loadu_ps(a + i), ga);
+        __m256 vb = _mm256_mul_ps(_mm256_loadu_ps(b + i), gb);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(va, vb));
+        ga = _mm256_add_ps(ga, ga_inc);
+        gb = _mm256_add_ps(gb, gb_inc);
+    }
+    mix_f32_sse2(a + i, b + i, dst + i, count - i,
+                 gain_a + step_a * i, step_a, gain_b + step_b * i, step_b);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i dither_next_sse2(__m128i* x) {
+    *x = _mm_xor_si128(*x, _mm_slli_epi32(*x, 13));
+    *x = _mm_xor_si128(*x, _mm_srli_epi32(*x, 17));
+    *x = _mm_xor_si128(*x, _mm_slli_epi32(*x, 5));
+    return *x;
+}
+
+__attribute__((target("sse2")))
+static inline __m128 dither_tpdf_sse2(__m128i* x) {
+    const __m128i one = _mm_set1_epi32(0x3F800000);
+    __m128 a = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(dither_next_sse2(x), 9), one));
+    __m128 b = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(dither_next_sse2(x), 9), one));
+    return _mm_sub_ps(a, b);
+}
+
+__attribute__((target("sse2")))
+static void dither_s16_sse2(DitherState* state, const float* src, int16_t* dst, size_t count) {
+    __m128i x_lo = _mm_loadu_si128((const __m128i*)state->state);
+    __m128i x_hi = _mm_loadu_si128((const __m128i*)(state->state + 4));
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 max = _mm_set1_ps(32767.0f);
+    const __m128 min = _mm_set1_ps(-32768.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128 lo = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), dither_tpdf_sse2(&x_lo));
+        __m128 hi = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), dither_tpdf_sse2(&x_hi));
+        // Ограничиваем до перевода в int32, иначе большие значения станут INT_MIN
+        lo = _mm_max_ps(_mm_min_ps(lo, max), min);
+        hi = _mm_max_ps(_mm_min_ps(hi, max), min);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+        _mm_storeu_si128((__m128i*)(dst + i), packed);
+    }
+
+    _mm_storeu_si128((__m128i*)state->state, x_lo);
+    _mm_storeu_si128((__m128i*)(state->state + 4), x_hi);
+    dither_s16_scalar(state, src + i, dst + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void convert_s32_sse2(const float* src, int32_t* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(2147483648.0f);
+    const __m128 max = _mm_set1_ps(S32_MAX_FLOAT);
+    const __m128 min = _mm_set1_ps(-2147483648.0f);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        v = _mm_max_ps(_mm_min_ps(v, max), min);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_cvtps_epi32(v));
+    }
+    convert_s32_scalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 dither_tpdf_avx2(__m256i* x) {
+    const __m256i one = _mm256_set1_epi32(0x3F800000);
+    __m256 r[2];
+
+    for (int k = 0; k < 2; k++) {
+        *x = _mm256_xor_si256(*x, _mm256_slli_epi32(*x, 13));
+        *x = _mm256_xor_si256(*x, _mm256_srli_epi32(*x, 17));
+        *x = _mm256_xor_si256(*x, _mm256_slli_epi32(*x, 5));
+        r[k] = _mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(*x, 9), one));
+    }
+    return _mm256_sub_ps(r[0], r[1]);
+}
+
+__attribute__((target("avx2")))
+static void dither_s16_avx2(DitherState* state, const float* src, int16_t* dst, size_t count) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)state->state);
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 max = _mm256_set1_ps(32767.0f);
+    const __m256 min = _mm256_set1_ps(-32768.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), dither_tpdf_avx2(&x));
+        v = _mm256_max_ps(_mm256_min_ps(v, max), min);
+        __m256i wide = _mm256_cvtps_epi32(v);
+        __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(wide), _mm256_extracti128_si256(wide, 1));
+        _mm_storeu_si128((__m128i*)(dst + i), packed);
+    }
+
+    _mm256_storeu_si256((__m256i*)state->state, x);
+    dither_s16_scalar(state, src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void convert_s32_avx2(const float* src, int32_t* dst, size_t count) {
+    const __m256 scale = _mm256_set1_ps(2147483648.0f);
+    const __m256 max = _mm256_set1_ps(S32_MAX_FLOAT);
+    const __m256 min = _mm256_set1_ps(-2147483648.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+        v = _mm256_max_ps(_mm256_min_ps(v, max), min);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_cvtps_epi32(v));
+    }
+    convert_s32_sse2(src + i, dst + i, count - i);
+}
+
+#endif
+
+static gain_f32_fn gain_f32 = gain_f32_scalar;
+static dither_s16_fn dither_s16 = dither_s16_scalar;
+static convert_s32_fn convert_s32 = convert_s32_scalar;
+static mix_f32_fn mix_f32_kernel = mix_f32_scalar;
+
+__attribute__((constructor))
+static void dsp_select_kernels(void) {
+#ifdef DSP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        gain_f32 = gain_f32_avx2;
+        dither_s16 = dither_s16_avx2;
+        convert_s32 = convert_s32_avx2;
+        mix_f32_kernel = mix_f32_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        gain_f32 = gain_f32_sse2;
+        dither_s16 = dither_s16_sse2;
+        convert_s32 = convert_s32_sse2;
+        mix_f32_kernel = mix_f32_sse2;
+    }
+#endif
+}
+
+void gain_init(GainState* state, float volume, int sample_rate, int channels) {
+    float ramp_samples = (float)sample_rate * channels * GAIN_RAMP_MS / 1000.0f;
+    state->current = volume;
+    state->step = ramp_samples > 0 ? 1.0f / ramp_samples : 1.0f;
+}
+
+void gain_scale_f32(float* buffer, size_t count, float gain) {
+    gain_f32(buffer, buffer, count, gain, 0.0f);
+}
+
+int gain_is_unity(const GainState* state, float target) {
+    return state->current == 1.0f && target == 1.0f;
+}
+
+// Длина перехода к target в отсчетах и шаг на отсчет.
+// Полный переход 0 -> 1 длится GAIN_RAMP_MS, меньшие изменения быстрее
+static size_t gain_ramp(const GainState* state, float target, float* step) {
+    float delta = target - state->current;
+    if (delta == 0.0f) {
+        *step = 0.0f;
+        return 0;
+    }
+
+    size_t samples = (size_t)ceilf(fabsf(delta) / state->step);
+    if (samples == 0) samples = 1;
+
+    *step = delta / samples;
+    return samples;
+}
+
+void gain_apply_f32(GainState* state, const float* src, float* dst, size_t count, float target) {
+    float step;
+    size_t ramp = gain_ramp(state, target, &step);
+
+    if (ramp > count) {
+        gain_f32(src, dst, count, state->current + step, step);
+        state->current += step * count;
+        return;
+    }
+
+    if (ramp > 0) {
+        gain_f32(src, dst, ramp, state->current + step, step);
+    }
+    state->current = target;
+
+    if (target == 1.0f) {
+        if (dst != src) memcpy(dst + ramp, src + ramp, (count - ramp) * sizeof(float));
+    } else {
+        gain_f32(src + ramp, dst + ramp, count - ramp, target, 0.0f);
+    }
+}
+
+void dither_init(DitherState* state, uint32_t seed) {
+    // Нулевое состояние xorshift не выходит из нуля
+    for (int i = 0; i < 8; i++) {
+        state->state[i] = (seed + i) * 2654435761u | 1;
+    }
+}
+
+void convert_f32_s16(DitherState* state, const float* src, int16_t* dst, size_t count) {
+    dither_s16(state, src, dst, count);
+}
+
+void convert_f32_s32(const float* src, int32_t* dst, size_t count) {
+    convert_s32(src, dst, count);
+}
+
+void mix_f32(const float* a, const float* b, float* dst, size_t count,
+             float gain_a, float step_a, float gain_b, float step_b) {
+    mix_f32_kernel(a, b, dst, count, gain_a, step_a, gain_b, step_b);
+}
+
+void crossfade_gains(float x, float* out_gain, float* in_gain) {
+    if (x < 0.0f) x = 0.0f;
+    else if (x > 1.0f) x = 1.0f;
+    *out_gain = cosf(x * (float)M_PI_2);
+    *in_gain = sinf(x * (float)M_PI_2);
+}
@@ -0,0 +1,51 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GAIN_RAMP_MS 20  // Длительность плавного перехода громкости
+
+// Состояние громкости потока. Смена громкости растягивается на
+// GAIN_RAMP_MS, чтобы не было щелчков
+typedef struct {
+    float current;      // Громкость последнего обработанного отсчета
+    float step;         // Максимальное изменение на один отсчет
+} GainState;
+
+void gain_init(GainState* state, float volume, int sample_rate, int channels);
+
+// Умножение count отсчетов на громкость с переходом к target.
+// src и dst могут совпадать
+void gain_apply_f32(GainState* state, const float* src, float* dst, size_t count, float target);
+
+// Умножение на постоянный множитель без перехода
+void gain_scale_f32(float* buffer, size_t count, float gain);
+
+// Громкость уже равна target и не требует умножения
+int gain_is_unity(const GainState* state, float target);
+
+// Генераторы шума для дизеринга, по одному на каждую полосу SIMD
+typedef struct {
+    uint32_t state[8];
+} DitherState;
+
+void dither_init(DitherState* state, uint32_t seed);
+
+// float -> int16 с треугольным (TPDF) дизерингом в 1 младший разряд и насыщением.
+// Нужен, только если устройство не принимает float или int32
+void convert_f32_s16(DitherState* state, const float* src, int16_t* dst, size_t count);
+
+// float -> int32 с насыщением, дизеринг на 32 битах не нужен
+void convert_f32_s32(const float* src, int32_t* dst, size_t count);
+
+// Сведение двух потоков: dst = a * gain_a + b * gain_b, громкости меняются
+// на step_a и step_b за отсчет. dst может совпадать с a или b
+void mix_f32(const float* a, const float* b, float* dst, size_t count,
+             float gain_a, float step_a, float gain_b, float step_b);
+
+// Громкости наплыва с постоянной мощностью в точке x из [0, 1]:
+// уходящий cos, входящий sin четверти периода, сумма квадратов всегда 1
+void crossfade_gains(float x, float* out_gain, float* in_gain);
+
+#endif
@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include "events.h"
+
+enum { SLOT_INPUT, SLOT_TIMER, SLOT_WAKE, SLOT_SIGNAL, SLOT_COUNT };
+
+static struct pollfd slots[SLOT_COUNT] = {
+    [SLOT_INPUT] = { .fd = -1 },
+    [SLOT_TIMER] = { .fd = -1 },
+    [SLOT_WAKE] = { .fd = -1 },
+    [SLOT_SIGNAL] = { .fd = -1 }
+};
+
+bool events_init(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    // Маска наследуется потоками, созданными после этого вызова
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) return false;
+
+    slots[SLOT_INPUT].fd = STDIN_FILENO;
+    slots[SLOT_TIMER].fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    slots[SLOT_WAKE].fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    slots[SLOT_SIGNAL].fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        slots[i].events = POLLIN;
+        if (slots[i].fd < 0) {
+            events_shutdown();
+            return false;
+        }
+    }
+    return true;
+}
+
+void events_shutdown(void) {
+    for (int i = SLOT_TIMER; i < SLOT_COUNT; i++) {
+        if (slots[i].fd >= 0) close(slots[i].fd);
+        slots[i].fd = -1;
+    }
+    slots[SLOT_INPUT].fd = -1;
+}
+
+void events_notify(void) {
+    uint64_t one = 1;
+    // Счетчик eventfd переполниться не может, а EAGAIN значит, что цикл и так разбужен
+    if (slots[SLOT_WAKE].fd >= 0) {
+        ssize_t written = write(slots[SLOT_WAKE].fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void events_set_timer(int interval_ms) {
+    static int armed_ms = 0;
+    if (slots[SLOT_TIMER].fd < 0 || interval_ms == armed_ms) return;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (long)(interval_ms % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    timerfd_settime(slots[SLOT_TIMER].fd, 0, &spec, NULL);
+    armed_ms = interval_ms;
+}
+
+void events_ignore_input(void) {
+    slots[SLOT_INPUT].fd = -1;
+}
+
+// Вычитывает fd, чтобы poll снова ждал, а не возвращался сразу
+static void drain(int fd, size_t size) {
+    char buffer[sizeof(struct signalfd_siginfo)];
+    while (read(fd, buffer, size) > 0) {
+    }
+}
+
+unsigned events_wait(void) {
+    while (poll(slots, SLOT_COUNT, -1) < 0) {
+        if (errno != EINTR) return 0;
+    }
+
+    unsigned events = 0;
+    if (slots[SLOT_INPUT].revents) events |= EVENT_INPUT;
+    if (slots[SLOT_TIMER].revents & POLLIN) {
+        drain(slots[SLOT_TIMER].fd, sizeof(uint64_t));
+        events |= EVENT_TIMER;
+    }
+    if (slots[SLOT_WAKE].revents & POLLIN) {
+        drain(slots[SLOT_WAKE].fd, sizeof(uint64_t));
+        events |= EVENT_PLAYBACK;
+    }
+    if (slots[SLOT_SIGNAL].revents & POLLIN) {
+        drain(slots[SLOT_SIGNAL].fd, sizeof(struct signalfd_siginfo));
+        events |= EVENT_RESIZE;
+    }
+    return events;
+}
@@ -0,0 +1,34 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdbool.h>
+
+// Ожидание событий главного цикла: один poll на stdin, таймер обновления
+// интерфейса (timerfd), пробуждения от потоков воспроизведения (eventfd)
+// и SIGWINCH (signalfd). Пока ничего не происходит, поток спит в poll.
+
+// Биты результата events_wait
+#define EVENT_INPUT    (1u << 0)   // В stdin есть данные или он закрыт
+#define EVENT_TIMER    (1u << 1)   // Тик обновления интерфейса
+#define EVENT_PLAYBACK (1u << 2)   // Поток воспроизведения что-то сообщил
+#define EVENT_RESIZE   (1u << 3)   // Изменился размер терминала
+
+// Вызывается до запуска любых потоков: SIGWINCH блокируется во всех
+// потоках и приходит только через signalfd
+bool events_init(void);
+void events_shutdown(void);
+
+// Будит главный цикл. Можно из любого потока, без блокировок.
+// Что именно произошло, цикл узнает по состоянию воспроизведения
+void events_notify(void);
+
+// Период тика интерфейса, 0 - таймер выключен
+void events_set_timer(int interval_ms);
+
+// stdin закрыт, больше его не ждем
+void events_ignore_input(void);
+
+// Блокируется до первого события и возвращает все случившиеся
+unsigned events_wait(void);
+
+#endif
@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include "filelist.h"
+
+#define FILE_LIST_INITIAL 256       // Начальная емкость, дальше растет вдвое
+#define POOL_INITIAL 16384
+#define KEY_MAX_DIGITS 255          // Длина числа в ключе хранится одним байтом
+#define SORT_INSERTION_MAX 12       // Короткие отрезки досортировываются вставками
+
+// Первый байт ключа задает группу: ".." выше папок, папки выше файлов
+enum { RANK_PARENT = 1, RANK_DIRECTORY, RANK_FILE };
+
+void file_list_clear(FileList* list) {
+    list->count = 0;
+    list->pool_size = 0;
+}
+
+void file_list_free(FileList* list) {
+    free(list->entries);
+    free(list->pool);
+    memset(list, 0, sizeof(*list));
+}
+
+// Место под size байт в пуле, смещение или -1. Старые смещения остаются верными
+static long pool_reserve(FileList* list, size_t size) {
+    if (list->pool_size + size > UINT32_MAX) return -1;
+
+    if (list->pool_size + size > list->pool_capacity) {
+        size_t capacity = list->pool_capacity ? list->pool_capacity : POOL_INITIAL;
+        while (capacity < list->pool_size + size) capacity *= 2;
+        char* grown = realloc(list->pool, capacity);
+        if (!grown) return -1;
+        list->pool = grown;
+        list->pool_capacity = capacity;
+    }
+
+    long offset = (long)list->pool_size;
+    list->pool_size += size;
+    return offset;
+}
+
+// Ключ естественной сортировки: ASCII без учета регистра, как strcasecmp,
+// а каждое число - байт с количеством цифр без ведущих нулей и сами цифры,
+// поэтому короткое число всегда меньше длинного. Нулевых байтов в ключе нет.
+// Возвращает длину. Число из n цифр занимает n + 2 байта, так что худший
+// случай - одиночные цифры через разделитель: key должен вмещать 2 + 2 * strlen(name) байт
+static size_t build_sort_key(const char* name, unsigned flags, unsigned char* key) {
+    size_t length = 0;
+    key[length++] = (flags & FILE_PARENT) ? RANK_PARENT :
+                    (flags & FILE_DIRECTORY) ? RANK_DIRECTORY : RANK_FILE;
+
+    const unsigned char* p = (const unsigned char*)name;
+    while (*p) {
+        if (*p >= '0' && *p <= '9') {
+            while (*p == '0' && p[1] >= '0' && p[1] <= '9') p++;
+            const unsigned char* digits = p;
+            while (*p >= '0' && *p <= '9') p++;
+
+            size_t count = p - digits;
+            if (count > KEY_MAX_DIGITS) count = KEY_MAX_DIGITS;
+            // Маркер '0' сохраняет место чисел среди остальных символов
+            key[length++] = '0';
+            key[length++] = (unsigned char)count;
+            memcpy(key + length, digits, count);
+            length += count;
+        } else {
+            unsigned char c = *p++;
+            key[length++] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+        }
+    }
+    return length;
+}
+
+bool file_list_add(FileList* list, const char* dir, const char* name, unsigned flags) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : FILE_LIST_INITIAL;
+        FileEntry* grown = realloc(list->entries, capacity * sizeof(FileEntry));
+        if (!grown) return false;
+        list->entries = grown;
+        list->capacity = capacity;
+    }
+
+    size_t dir_length = dir ? strlen(dir) + 1 : 0;
+    size_t name_length = strlen(name);
+    size_t path_size = dir_length + name_length + 1;
+    size_t key_max = 2 + 2 * name_length;
+    if (dir_length > UINT16_MAX || key_max > UINT16_MAX) return false;
+
+    long path = pool_reserve(list, path_size + key_max);
+    if (path < 0) return false;
+
+    char* text = list->pool + path;
+    if (dir) {
+        memcpy(text, dir, dir_length - 1);
+        text[dir_length - 1] = '/';
+    }
+    memcpy(text + dir_length, name, name_length + 1);
+
+    unsigned char* key = (unsigned char*)text + path_size;
+    size_t key_length = build_sort_key(name, flags, key);
+    // Неиспользованный хвост резерва возвращается в пул
+    list->pool_size -= key_max - key_length;
+
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; i++) {
+        prefix = (prefix << 8) | (i < key_length ? key[i] : 0);
+    }
+
+    FileEntry* entry = &list->entries[list->count++];
+    entry->key_prefix = prefix;
+    entry->path = (uint32_t)path;
+    entry->key = (uint32_t)(path + path_size);
+    entry->name = (uint16_t)dir_length;
+    entry->key_length = (uint16_t)key_length;
+    atomic_init(&entry->flags, (uint8_t)flags);
+    return true;
+}
+
+// Байт ключа на глубине depth, 0 за концом ключа. Первые 8 берутся из записи
+static inline unsigned key_byte(const char* pool, const FileEntry* entry, size_t depth) {
+    if (depth < 8) return (entry->key_prefix >> (56 - 8 * depth)) & 0xFF;
+    return depth < entry->key_length ? (unsigned char)pool[entry->key + depth] : 0;
+}
+
+static inline void swap_entries(FileEntry* a, FileEntry* b) {
+    FileEntry tmp;
+    memcpy(&tmp, a, sizeof(tmp));
+    memcpy(a, b, sizeof(tmp));
+    memcpy(b, &tmp, sizeof(tmp));
+}
+
+// Сравнение с позиции depth, где ключи уже совпали
+static int compare_from(const char* pool, const FileEntry* a, const FileEntry* b, size_t depth) {
+    if (depth < 8) {
+        if (a->key_prefix != b->key_prefix) return a->key_prefix < b->key_prefix ? -1 : 1;
+        depth = 8;
+    }
+    size_t length = a->key_length < b->key_length ? a->key_length : b->key_length;
+    if (length > depth) {
+        int result = memcmp(pool + a->key + depth, pool + b->key + depth, length - depth);
+        if (result != 0) return result;
+    }
+    return (int)a->key_length - (int)b->key_length;
+}
+
+// Трехпутевая поразрядная быстрая сортировка (Бентли - Седжвик): общий префикс
+// имен вроде "Artist - Track " просматривается один раз, а не в каждом сравнении
+static void sort_range(const char* pool, FileEntry* entries, size_t count, size_t depth) {
+    while (count > SORT_INSERTION_MAX) {
+        unsigned pivot = key_byte(pool, &entries[count / 2], depth);
+        size_t lt = 0, i = 0, gt = count;
+        while (i < gt) {
+            unsigned c = key_byte(pool, &entries[i], depth);
+            if (c < pivot) swap_entries(&entries[lt++], &entries[i++]);
+            else if (c > pivot) swap_entries(&entries[i], &entries[--gt]);
+            else i++;
+        }
+
+        sort_range(pool, entries, lt, depth);
+        sort_range(pool, entries + gt, count - gt, depth);
+        // Ключи закончились - равная часть уже упорядочена
+        if (pivot == 0) return;
+        entries += lt;
+        count = gt - lt;
+        depth++;
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        for (size_t j = i; j > 0 && compare_from(pool, &entries[j - 1], &entries[j], depth) > 0; j--) {
+            swap_entries(&entries[j - 1], &entries[j]);
+        }
+    }
+}
+
+void file_list_sort(FileList* list) {
+    sort_range(list->pool, list->entries, list->count, 0);
+}
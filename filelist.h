@@ -0,0 +1,89 @@
+#ifndef FILELIST_H
+#define FILELIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+typedef enum {
+    FORMAT_UNKNOWN,
+    FORMAT_PENDING,     // Сигнатура еще не прочитана фоновым потоком
+    FORMAT_WAV,
+    FORMAT_AIFF,
+    FORMAT_OGG,
+    FORMAT_MP3,
+    FORMAT_FLAC
+} AudioFormat;
+
+// Биты FileEntry.flags, формат занимает старшие
+#define FILE_DIRECTORY    0x01
+#define FILE_PARENT       0x02  // ".." - переход наверх
+#define FILE_AUDIO        0x04
+#define FILE_FORMAT_SHIFT 3
+#define FILE_FORMAT_MASK  (0x07 << FILE_FORMAT_SHIFT)
+
+// Запись списка файлов. Строки лежат в общем пуле и адресуются смещениями,
+// так что запись занимает 24 байта вместо полутора килобайт
+typedef struct {
+    uint64_t key_prefix;    // Первые 8 байт ключа сортировки, первый байт старший
+    uint32_t path;          // Смещение полного пути в пуле
+    uint32_t key;           // Смещение ключа сортировки в пуле
+    uint16_t name;          // Начало имени внутри пути
+    uint16_t key_length;
+    _Atomic uint8_t flags;  // FILE_* и формат; формат дописывает фоновый поток
+} FileEntry;
+
+typedef struct {
+    FileEntry* entries;
+    int count;
+    int capacity;
+    char* pool;             // Пути и ключи сортировки подряд
+    size_t pool_size;
+    size_t pool_capacity;
+} FileList;
+
+// Сброс списка с сохранением памяти под следующий каталог
+void file_list_clear(FileList* list);
+void file_list_free(FileList* list);
+
+// Добавляет dir/name, без dir путь равен имени. false если не хватило памяти
+bool file_list_add(FileList* list, const char* dir, const char* name, unsigned flags);
+
+// Папки сверху, ".." первой, внутри группы естественный порядок без учета
+// регистра: "track 2" раньше "track 10". Сортируются готовые ключи побайтно
+void file_list_sort(FileList* list);
+
+static inline const char* file_list_path(const FileList* list, const FileEntry* entry) {
+    return list->pool + entry->path;
+}
+
+static inline const char* file_list_name(const FileList* list, const FileEntry* entry) {
+    return list->pool + entry->path + entry->name;
+}
+
+static inline bool file_is_directory(const FileEntry* entry) {
+    return atomic_load_explicit(&entry->flags, memory_order_relaxed) & FILE_DIRECTORY;
+}
+
+static inline bool file_is_parent(const FileEntry* entry) {
+    return atomic_load_explicit(&entry->flags, memory_order_relaxed) & FILE_PARENT;
+}
+
+static inline bool file_is_audio(const FileEntry* entry) {
+    return atomic_load_explicit(&entry->flags, memory_order_relaxed) & FILE_AUDIO;
+}
+
+static inline AudioFormat file_format(const FileEntry* entry) {
+    uint8_t flags = atomic_load_explicit(&entry->flags, memory_order_relaxed);
+    return (AudioFormat)((flags & FILE_FORMAT_MASK) >> FILE_FORMAT_SHIFT);
+}
+
+// Единственный писатель после сортировки - поток определения форматов
+static inline void file_set_format(FileEntry* entry, AudioFormat format) {
+    uint8_t flags = atomic_load_explicit(&entry->flags, memory_order_relaxed);
+    flags = (flags & ~FILE_FORMAT_MASK) | (format << FILE_FORMAT_SHIFT);
+    atomic_store_explicit(&entry->flags, flags, memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,429 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "loudness.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOUDNESS_X86 1
+#endif
+
+#define SUBBLOCK_MS 100             // Блок 400 мс собирается из четырех подблоков по 100 мс
+#define BLOCK_SUBBLOCKS 4
+#define RELATIVE_GATE_LU 10.0
+#define LANES 4                     // Каналы идут группами по 4 в одном векторе
+#define PEAK_FACTOR 4               // Передискретизация для true peak
+#define PEAK_TAPS 12                // Отводов на фазу, 48 всего
+#define PEAK_MAX_RATE 96000         // Начиная с этой частоты true peak берется по отсчетам
+#define HISTOGRAM_STEP 0.1
+
+typedef struct {
+    float b0, b1, b2, a1, a2;
+} Biquad;
+
+struct LoudnessAnalyzer {
+    int channels;
+    int groups;                     // Групп по LANES каналов, последняя дополнена нулями
+    float* weights;                 // Вес канала в сумме, у LFE 0
+    Biquad shelf;                   // Первая ступень K-фильтра: полка +4 дБ на ВЧ
+    Biquad highpass;                // Вторая: срез НЧ (RLB)
+    float* state;                   // На группу: z1, z2 полки и z1, z2 среза по LANES
+
+    size_t subblock_frames;
+    size_t subblock_pos;
+    float* subblock_energy;         // Сумма квадратов текущего подблока по каналам
+    double recent[BLOCK_SUBBLOCKS]; // Взвешенные средние квадраты последних подблоков
+    size_t subblock_count;
+
+    double* blocks;                 // Энергия каждого блока 400 мс
+    size_t block_count;
+    size_t block_capacity;
+
+    bool oversample;
+    float peak_coeffs[PEAK_TAPS][PEAK_FACTOR];  // По отводу истории: коэффициенты всех фаз
+    float* peak_history;            // На канал 2 * PEAK_TAPS, запись дублируется
+    int peak_pos;
+    float peak;
+};
+
+// Ядра: K-фильтр с накоплением суммы квадратов в subblock_energy
+// и максимум модуля после передискретизации. Выбираются при запуске
+
+typedef void (*kweight_fn)(LoudnessAnalyzer* analyzer, const float* src, size_t frames);
+typedef float (*true_peak_fn)(LoudnessAnalyzer* analyzer, const float* src, size_t frames, float peak);
+
+static void kweight_scalar(LoudnessAnalyzer* analyzer, const float* src, size_t frames) {
+    const Biquad* s = &analyzer->shelf;
+    const Biquad* h = &analyzer->highpass;
+    int channels = analyzer->channels;
+
+    for (int c = 0; c < channels; c++) {
+        float* z = analyzer->state + (c / LANES) * LANES * 4 + c % LANES;
+        float s1 = z[0], s2 = z[LANES], h1 = z[LANES * 2], h2 = z[LANES * 3];
+        float sum = 0.0f;
+
+        // Транспонированная прямая форма II, обе ступени подряд
+        for (size_t i = 0; i < frames; i++) {
+            float x = src[i * channels + c];
+            float y = s->b0 * x + s1;
+            s1 = s->b1 * x - s->a1 * y + s2;
+            s2 = s->b2 * x - s->a2 * y;
+
+            float out = h->b0 * y + h1;
+            h1 = h->b1 * y - h->a1 * out + h2;
+            h2 = h->b2 * y - h->a2 * out;
+            sum += out * out;
+        }
+
+        z[0] = s1;
+        z[LANES] = s2;
+        z[LANES * 2] = h1;
+        z[LANES * 3] = h2;
+        analyzer->subblock_energy[c] += sum;
+    }
+}
+
+static float true_peak_scalar(LoudnessAnalyzer* analyzer, const float* src, size_t frames, float peak) {
+    int channels = analyzer->channels;
+
+    for (size_t i = 0; i < frames; i++) {
+        int pos = analyzer->peak_pos;
+        for (int c = 0; c < channels; c++) {
+            float* history = analyzer->peak_history + c * PEAK_TAPS * 2;
+            float x = src[i * channels + c];
+            history[pos] = x;
+            history[pos + PEAK_TAPS] = x;
+            if (fabsf(x) > peak) peak = fabsf(x);
+
+            // Окно от старого отсчета к новому
+            const float* window = history + pos + 1;
+            for (int phase = 0; phase < PEAK_FACTOR; phase++) {
+                float value = 0.0f;
+                for (int j = 0; j < PEAK_TAPS; j++) value += analyzer->peak_coeffs[j][phase] * window[j];
+                if (fabsf(value) > peak) peak = fabsf(value);
+            }
+        }
+        analyzer->peak_pos = (pos + 1) % PEAK_TAPS;
+    }
+    return peak;
+}
+
+#ifdef LOUDNESS_X86
+
+// Каналы группы в полосы вектора, недостающие полосы нулевые
+__attribute__((target("sse2")))
+static inline __m128 load_lanes_sse2(const float* p, int count) {
+    switch (count) {
+        case 1: return _mm_load_ss(p);
+        case 2: return _mm_castpd_ps(_mm_load_sd((const double*)p));
+        case 3: return _mm_setr_ps(p[0], p[1], p[2], 0.0f);
+        default: return _mm_loadu_ps(p);
+    }
+}
+
+// Рекурсия не векторизуется по времени, поэтому вектор идет по каналам:
+// все каналы группы фильтруются одними инструкциями
+__attribute__((target("sse2")))
+static void kweight_sse2(LoudnessAnalyzer* analyzer, const float* src, size_t frames) {
+    const Biquad* s = &analyzer->shelf;
+    const Biquad* h = &analyzer->highpass;
+    __m128 sb0 = _mm_set1_ps(s->b0), sb1 = _mm_set1_ps(s->b1), sb2 = _mm_set1_ps(s->b2);
+    __m128 sa1 = _mm_set1_ps(s->a1), sa2 = _mm_set1_ps(s->a2);
+    __m128 hb0 = _mm_set1_ps(h->b0), hb1 = _mm_set1_ps(h->b1), hb2 = _mm_set1_ps(h->b2);
+    __m128 ha1 = _mm_set1_ps(h->a1), ha2 = _mm_set1_ps(h->a2);
+    int channels = analyzer->channels;
+
+    for (int g = 0; g < analyzer->groups; g++) {
+        int count = channels - g * LANES < LANES ? channels - g * LANES : LANES;
+        float* z = analyzer->state + g * LANES * 4;
+        __m128 s1 = _mm_loadu_ps(z), s2 = _mm_loadu_ps(z + LANES);
+        __m128 h1 = _mm_loadu_ps(z + LANES * 2), h2 = _mm_loadu_ps(z + LANES * 3);
+        __m128 sum = _mm_setzero_ps();
+        const float* p = src + g * LANES;
+
+        for (size_t i = 0; i < frames; i++) {
+            __m128 x = load_lanes_sse2(p + i * channels, count);
+            __m128 y = _mm_add_ps(_mm_mul_ps(sb0, x), s1);
+            s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb1, x), _mm_mul_ps(sa1, y)), s2);
+            s2 = _mm_sub_ps(_mm_mul_ps(sb2, x), _mm_mul_ps(sa2, y));
+
+            __m128 out = _mm_add_ps(_mm_mul_ps(hb0, y), h1);
+            h1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(hb1, y), _mm_mul_ps(ha1, out)), h2);
+            h2 = _mm_sub_ps(_mm_mul_ps(hb2, y), _mm_mul_ps(ha2, out));
+            sum = _mm_add_ps(sum, _mm_mul_ps(out, out));
+        }
+
+        _mm_storeu_ps(z, s1);
+        _mm_storeu_ps(z + LANES, s2);
+        _mm_storeu_ps(z + LANES * 2, h1);
+        _mm_storeu_ps(z + LANES * 3, h2);
+
+        float sums[LANES];
+        _mm_storeu_ps(sums, sum);
+        for (int l = 0; l < count; l++) analyzer->subblock_energy[g * LANES + l] += sums[l];
+    }
+}
+
+// Все четыре фазы сразу: полосы вектора - фазы, отвод истории размножается
+__attribute__((target("sse2")))
+static float true_peak_sse2(LoudnessAnalyzer* analyzer, const float* src, size_t frames, float peak) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 max = _mm_set1_ps(peak);
+    int channels = analyzer->channels;
+
+    for (size_t i = 0; i < frames; i++) {
+        int pos = analyzer->peak_pos;
+        for (int c = 0; c < channels; c++) {
+            float* history = analyzer->peak_history + c * PEAK_TAPS * 2;
+            float x = src[i * channels + c];
+            history[pos] = x;
+            history[pos + PEAK_TAPS] = x;
+
+            const float* window = history + pos + 1;
+            __m128 acc = _mm_andnot_ps(sign, _mm_set1_ps(x));
+            __m128 value = _mm_setzero_ps();
+            for (int j = 0; j < PEAK_TAPS; j++) {
+                value = _mm_add_ps(value, _mm_mul_ps(_mm_loadu_ps(analyzer->peak_coeffs[j]), _mm_set1_ps(window[j])));
+            }
+            acc = _mm_max_ps(acc, _mm_andnot_ps(sign, value));
+            max = _mm_max_ps(max, acc);
+        }
+        analyzer->peak_pos = (pos + 1) % PEAK_TAPS;
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, max);
+    for (int l = 0; l < 4; l++) {
+        if (lanes[l] > peak) peak = lanes[l];
+    }
+    return peak;
+}
+
+#endif
+
+static kweight_fn kweight = kweight_scalar;
+static true_peak_fn true_peak = true_peak_scalar;
+
+__attribute__((constructor))
+static void loudness_select_kernels(void) {
+#ifdef LOUDNESS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kweight = kweight_sse2;
+        true_peak = true_peak_sse2;
+    }
+#endif
+}
+
+// Коэффициенты K-фильтра для любой частоты: билинейное преобразование
+// аналоговых прототипов BS.1770 (для 48 кГц совпадает с таблицей стандарта)
+static void kweight_design(int sample_rate, Biquad* shelf, Biquad* highpass) {
+    double f0 = 1681.974450955533;
+    double gain_db = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / sample_rate);
+    double vh = pow(10.0, gain_db / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+
+    shelf->b0 = (vh + vb * k / q + k * k) / a0;
+    shelf->b1 = 2.0 * (k * k - vh) / a0;
+    shelf->b2 = (vh - vb * k / q + k * k) / a0;
+    shelf->a1 = 2.0 * (k * k - 1.0) / a0;
+    shelf->a2 = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / sample_rate);
+    a0 = 1.0 + k / q + k * k;
+
+    highpass->b0 = 1.0f;
+    highpass->b1 = -2.0f;
+    highpass->b2 = 1.0f;
+    highpass->a1 = 2.0 * (k * k - 1.0) / a0;
+    highpass->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+// Интерполятор для true peak: sinc с окном Ханна на 48 отводов,
+// каждая фаза нормирована к единичному усилению на постоянном токе
+static void true_peak_design(LoudnessAnalyzer* analyzer) {
+    int length = PEAK_TAPS * PEAK_FACTOR;
+    double center = (length - 1) / 2.0;
+    double taps[PEAK_TAPS * PEAK_FACTOR];
+    double sums[PEAK_FACTOR] = {0};
+
+    for (int n = 0; n < length; n++) {
+        double t = (n - center) / PEAK_FACTOR;
+        double sinc = t == 0.0 ? 1.0 : sin(M_PI * t) / (M_PI * t);
+        double window = 0.5 - 0.5 * cos(2.0 * M_PI * (n + 1) / (length + 1));
+        taps[n] = sinc * window;
+        sums[n % PEAK_FACTOR] += taps[n];
+    }
+
+    // Отвод j окна - отсчет x[m - (PEAK_TAPS - 1 - j)]
+    for (int j = 0; j < PEAK_TAPS; j++) {
+        for (int phase = 0; phase < PEAK_FACTOR; phase++) {
+            int n = (PEAK_TAPS - 1 - j) * PEAK_FACTOR + phase;
+            analyzer->peak_coeffs[j][phase] = taps[n] / sums[phase];
+        }
+    }
+}
+
+LoudnessAnalyzer* loudness_create(int sample_rate, int channels) {
+    if (sample_rate <= 0 || channels <= 0) return NULL;
+
+    LoudnessAnalyzer* analyzer = calloc(1, sizeof(LoudnessAnalyzer));
+    if (!analyzer) return NULL;
+
+    analyzer->channels = channels;
+    analyzer->groups = (channels + LANES - 1) / LANES;
+    analyzer->weights = calloc(analyzer->groups * LANES, sizeof(float));
+    analyzer->state = calloc(analyzer->groups * LANES * 4, sizeof(float));
+    analyzer->subblock_energy = calloc(analyzer->groups * LANES, sizeof(float));
+    analyzer->peak_history = calloc(channels * PEAK_TAPS * 2, sizeof(float));
+    if (!analyzer->weights || !analyzer->state || !analyzer->subblock_energy || !analyzer->peak_history) {
+        loudness_destroy(analyzer);
+        return NULL;
+    }
+
+    // Порядок каналов 5.0/5.1: L R C (LFE) Ls Rs. Тыловые +1.5 дБ, LFE не учитывается
+    for (int c = 0; c < channels; c++) analyzer->weights[c] = 1.0f;
+    if (channels == 5) {
+        analyzer->weights[3] = analyzer->weights[4] = 1.41f;
+    } else if (channels == 6) {
+        analyzer->weights[3] = 0.0f;
+        analyzer->weights[4] = analyzer->weights[5] = 1.41f;
+    }
+
+    kweight_design(sample_rate, &analyzer->shelf, &analyzer->highpass);
+    analyzer->subblock_frames = (size_t)sample_rate * SUBBLOCK_MS / 1000;
+    analyzer->oversample = sample_rate < PEAK_MAX_RATE;
+    true_peak_design(analyzer);
+    return analyzer;
+}
+
+void loudness_destroy(LoudnessAnalyzer* analyzer) {
+    if (!analyzer) return;
+
+    free(analyzer->weights);
+    free(analyzer->state);
+    free(analyzer->subblock_energy);
+    free(analyzer->peak_history);
+    free(analyzer->blocks);
+    free(analyzer);
+}
+
+static double energy_to_lufs(double energy) {
+    return -0.691 + 10.0 * log10(energy);
+}
+
+static double lufs_to_energy(double lufs) {
+    return pow(10.0, (lufs + 0.691) / 10.0);
+}
+
+// Подблок готов: взвешенная сумма средних квадратов каналов.
+// Каждый следующий подблок после третьего замыкает новый блок 400 мс
+static void finish_subblock(LoudnessAnalyzer* analyzer) {
+    double energy = 0.0;
+    for (int c = 0; c < analyzer->channels; c++) {
+        energy += analyzer->weights[c] * (double)analyzer->subblock_energy[c];
+        analyzer->subblock_energy[c] = 0.0f;
+    }
+    analyzer->recent[analyzer->subblock_count % BLOCK_SUBBLOCKS] = energy / analyzer->subblock_frames;
+    analyzer->subblock_count++;
+    analyzer->subblock_pos = 0;
+
+    if (analyzer->subblock_count < BLOCK_SUBBLOCKS) return;
+
+    if (analyzer->block_count == analyzer->block_capacity) {
+        size_t capacity = analyzer->block_capacity ? analyzer->block_capacity * 2 : 1024;
+        double* grown = realloc(analyzer->blocks, capacity * sizeof(double));
+        if (!grown) return;
+        analyzer->blocks = grown;
+        analyzer->block_capacity = capacity;
+    }
+
+    double block = 0.0;
+    for (int i = 0; i < BLOCK_SUBBLOCKS; i++) block += analyzer->recent[i];
+    analyzer->blocks[analyzer->block_count++] = block / BLOCK_SUBBLOCKS;
+}
+
+void loudness_add(LoudnessAnalyzer* analyzer, const float* frames, size_t count) {
+    while (count > 0) {
+        size_t n = analyzer->subblock_frames - analyzer->subblock_pos;
+        if (n > count) n = count;
+
+        kweight(analyzer, frames, n);
+        if (analyzer->oversample) {
+            analyzer->peak = true_peak(analyzer, frames, n, analyzer->peak);
+        } else {
+            for (size_t i = 0; i < n * analyzer->channels; i++) {
+                if (fabsf(frames[i]) > analyzer->peak) analyzer->peak = fabsf(frames[i]);
+            }
+        }
+
+        analyzer->subblock_pos += n;
+        frames += n * analyzer->channels;
+        count -= n;
+        if (analyzer->subblock_pos == analyzer->subblock_frames) finish_subblock(analyzer);
+    }
+}
+
+void loudness_finish(LoudnessAnalyzer* analyzer, LoudnessResult* result) {
+    double absolute = lufs_to_energy(LOUDNESS_SILENCE_LUFS);
+    double sum = 0.0;
+    size_t count = 0;
+
+    memset(result->histogram, 0, sizeof(result->histogram));
+    for (size_t i = 0; i < analyzer->block_count; i++) {
+        double energy = analyzer->blocks[i];
+        if (energy <= absolute) continue;
+
+        sum += energy;
+        count++;
+
+        int bin = (int)((energy_to_lufs(energy) - LOUDNESS_SILENCE_LUFS) / HISTOGRAM_STEP);
+        if (bin >= LOUDNESS_HISTOGRAM_BINS) bin = LOUDNESS_HISTOGRAM_BINS - 1;
+        result->histogram[bin]++;
+    }
+
+    result->true_peak = analyzer->peak;
+    result->integrated = LOUDNESS_SILENCE_LUFS;
+    if (count == 0) return;
+
+    // Относительный порог: на 10 LU ниже средней громкости блоков над абсолютным
+    double relative = lufs_to_energy(energy_to_lufs(sum / count) - RELATIVE_GATE_LU);
+    double gated = 0.0;
+    size_t gated_count = 0;
+    for (size_t i = 0; i < analyzer->block_count; i++) {
+        if (analyzer->blocks[i] > absolute && analyzer->blocks[i] > relative) {
+            gated += analyzer->blocks[i];
+            gated_count++;
+        }
+    }
+    result->integrated = energy_to_lufs(gated / gated_count);
+}
+
+float loudness_from_histogram(const uint32_t* histogram) {
+    double sum = 0.0;
+    uint64_t count = 0;
+
+    for (int bin = 0; bin < LOUDNESS_HISTOGRAM_BINS; bin++) {
+        if (!histogram[bin]) continue;
+        sum += lufs_to_energy(LOUDNESS_SILENCE_LUFS + (bin + 0.5) * HISTOGRAM_STEP) * histogram[bin];
+        count += histogram[bin];
+    }
+    if (count == 0) return LOUDNESS_SILENCE_LUFS;
+
+    double relative = energy_to_lufs(sum / count) - RELATIVE_GATE_LU;
+    double gated = 0.0;
+    uint64_t gated_count = 0;
+    for (int bin = 0; bin < LOUDNESS_HISTOGRAM_BINS; bin++) {
+        double lufs = LOUDNESS_SILENCE_LUFS + (bin + 0.5) * HISTOGRAM_STEP;
+        if (!histogram[bin] || lufs <= relative) continue;
+        gated += lufs_to_energy(lufs) * histogram[bin];
+        gated_count += histogram[bin];
+    }
+    return gated_count ? energy_to_lufs(gated / gated_count) : LOUDNESS_SILENCE_LUFS;
+}
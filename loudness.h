@@ -0,0 +1,39 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Измерение громкости по EBU R128 / ITU-R BS.1770: K-взвешивание,
+// блоки 400 мс с перекрытием 75%, абсолютный порог -70 LUFS и
+// относительный -10 LU. True peak - по сигналу с 4-кратной передискретизацией.
+// Вход - interleaved float
+
+#define LOUDNESS_REFERENCE_LUFS -18.0f  // Опорная громкость ReplayGain 2.0
+#define LOUDNESS_SILENCE_LUFS -70.0f    // Абсолютный порог: все тише считается тишиной
+
+// Гистограмма громкости блоков с шагом 0.1 LU от -70 до +5 LUFS.
+// Гистограммы треков складываются, из суммы считается громкость альбома
+#define LOUDNESS_HISTOGRAM_BINS 750
+
+typedef struct {
+    float integrated;       // LUFS, LOUDNESS_SILENCE_LUFS если блоков выше порога нет
+    float true_peak;        // Линейный, 1.0 - полная шкала
+    uint32_t histogram[LOUDNESS_HISTOGRAM_BINS];
+} LoudnessResult;
+
+typedef struct LoudnessAnalyzer LoudnessAnalyzer;
+
+LoudnessAnalyzer* loudness_create(int sample_rate, int channels);
+void loudness_destroy(LoudnessAnalyzer* analyzer);
+
+// Следующие frames фреймов трека
+void loudness_add(LoudnessAnalyzer* analyzer, const float* frames, size_t count);
+
+// Итог по всему, что было передано в loudness_add
+void loudness_finish(LoudnessAnalyzer* analyzer, LoudnessResult* result);
+
+// Громкость по гистограмме с теми же порогами, для альбома
+float loudness_from_histogram(const uint32_t* histogram);
+
+#endif
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "output.h"
+#include "pcm_pool.h"
+#include "wav_writer.h"
+
+// Выводы без звуковой карты для серверов и CI: null отбрасывает данные,
+// file пишет их в WAV (float 32). Свой поток забирает данные у источника
+// порциями по minreq и выдерживает темп реального времени, если не задан
+// режим unthrottled. Тогда весь конвейер декодер -> DSP -> вывод работает
+// с той же синхронизацией, что и со звуковой картой
+
+#define SINK_RETRY_NSEC 1000000         // Повторный запрос, если у источника не было данных
+#define SINK_DEFAULT_FILE "output.wav"
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool running;
+    bool paused;
+    bool ended;
+    bool flowing;                       // Источник уже отдавал данные с момента старта
+
+    output_fill_fn fill;
+    output_done_fn done;
+    void* userdata;
+
+    int sample_rate;
+    int channels;
+    size_t period_frames;
+    float* buffer;
+    struct timespec deadline;           // Когда отдать следующую порцию
+
+    const char* path;                   // Только у file, WAV открывается при первом треке
+    WavWriter* wav;
+    OutputConfig config;
+} Sink;
+
+static Sink sink = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+static atomic_uint sink_underruns = 0;
+
+static void timespec_add_nsec(struct timespec* ts, uint64_t nsec) {
+    nsec += ts->tv_nsec;
+    ts->tv_sec += nsec / 1000000000;
+    ts->tv_nsec = nsec % 1000000000;
+}
+
+static bool timespec_before(const struct timespec* a, const struct timespec* b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void* sink_worker(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&sink.mutex);
+
+    while (sink.running) {
+        if (!sink.fill || sink.paused || sink.ended) {
+            pthread_cond_wait(&sink.cond, &sink.mutex);
+            continue;
+        }
+
+        long got = sink.fill(sink.userdata, sink.buffer, sink.period_frames);
+
+        if (got == OUTPUT_END) {
+            sink.ended = true;
+            if (sink.wav) wav_writer_sync(sink.wav);
+            if (sink.done) sink.done(sink.userdata);
+            continue;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        if (got <= 0) {
+            // Декодер не успел: для реального темпа это опустошение буфера
+            if (sink.flowing) atomic_fetch_add(&sink_underruns, 1);
+            sink.flowing = false;
+            sink.deadline = now;
+            timespec_add_nsec(&now, SINK_RETRY_NSEC);
+            pthread_cond_timedwait(&sink.cond, &sink.mutex, &now);
+            continue;
+        }
+
+        sink.flowing = true;
+        if (sink.wav) wav_writer_write(sink.wav, sink.buffer, got);
+
+        if (sink.config.unthrottled) continue;
+
+        // Темп реального времени: следующая порция, когда проиграна бы эта
+        timespec_add_nsec(&sink.deadline, (uint64_t)got * 1000000000 / sink.sample_rate);
+        if (timespec_before(&now, &sink.deadline)) {
+            pthread_cond_timedwait(&sink.cond, &sink.mutex, &sink.deadline);
+        } else {
+            sink.deadline = now;
+        }
+    }
+
+    pthread_mutex_unlock(&sink.mutex);
+    return NULL;
+}
+
+static bool sink_init(const OutputConfig* config, const char* path) {
+    sink.config = *config;
+    sink.running = true;
+    sink.path = path;
+    atomic_store(&sink_underruns, 0);
+
+    // Ожидания по монотонным часам: перевод системного времени не сбивает темп
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sink.cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&sink.thread, NULL, sink_worker, NULL) != 0) {
+        pthread_cond_destroy(&sink.cond);
+        return false;
+    }
+    return true;
+}
+
+static bool null_init(const OutputConfig* config) {
+    return sink_init(config, NULL);
+}
+
+static bool file_init(const OutputConfig* config) {
+    return sink_init(config, config->device ? config->device : SINK_DEFAULT_FILE);
+}
+
+static void sink_shutdown(void) {
+    pthread_mutex_lock(&sink.mutex);
+    sink.running = false;
+    pthread_cond_signal(&sink.cond);
+    pthread_mutex_unlock(&sink.mutex);
+    pthread_join(sink.thread, NULL);
+    pthread_cond_destroy(&sink.cond);
+
+    wav_writer_close(sink.wav);
+    sink.wav = NULL;
+    pcm_pool_free(sink.buffer);
+    sink.buffer = NULL;
+}
+
+static bool sink_start(int sample_rate, int channels, output_fill_fn fill,
+                       output_done_fn done, void* userdata, OutputFormat* format) {
+    pthread_mutex_lock(&sink.mutex);
+
+    // В одном WAV формат не меняется
+    if (sink.wav && (sample_rate != sink.sample_rate || channels != sink.channels)) {
+        pthread_mutex_unlock(&sink.mutex);
+        fprintf(stderr, "Output file already has %d Hz, %d channels\n", sink.sample_rate, sink.channels);
+        return false;
+    }
+
+    int period_ms = sink.config.minreq_ms > 0 ? sink.config.minreq_ms : OUTPUT_DEFAULT_MINREQ_MS;
+    size_t period_frames = (size_t)sample_rate * period_ms / 1000;
+    if (period_frames < 64) period_frames = 64;
+
+    if (!sink.buffer || period_frames * channels > sink.period_frames * sink.channels) {
+        pcm_pool_free(sink.buffer);
+        sink.buffer = pcm_pool_alloc(period_frames * channels * sizeof(float));
+    }
+    if (sink.path && !sink.wav) {
+        sink.wav = wav_writer_open(sink.path, sample_rate, channels, OUTPUT_FORMAT_FLOAT32);
+    }
+    if (!sink.buffer || (sink.path && !sink.wav)) {
+        pthread_mutex_unlock(&sink.mutex);
+        return false;
+    }
+
+    sink.sample_rate = sample_rate;
+    sink.channels = channels;
+    sink.period_frames = period_frames;
+    sink.fill = fill;
+    sink.done = done;
+    sink.userdata = userdata;
+    sink.paused = false;
+    sink.ended = false;
+    sink.flowing = false;
+    clock_gettime(CLOCK_MONOTONIC, &sink.deadline);
+
+    *format = OUTPUT_FORMAT_FLOAT32;
+    pthread_cond_signal(&sink.cond);
+    pthread_mutex_unlock(&sink.mutex);
+    return true;
+}
+
+static void sink_stop(void) {
+    pthread_mutex_lock(&sink.mutex);
+    sink.fill = NULL;
+    sink.done = NULL;
+    sink.userdata = NULL;
+    if (sink.wav) wav_writer_sync(sink.wav);
+    pthread_mutex_unlock(&sink.mutex);
+}
+
+static void sink_pause(bool paused) {
+    pthread_mutex_lock(&sink.mutex);
+    sink.paused = paused;
+    clock_gettime(CLOCK_MONOTONIC, &sink.deadline);
+    pthread_cond_signal(&sink.cond);
+    pthread_mutex_unlock(&sink.mutex);
+}
+
+// Буфера нет, сбрасывать нечего: следующая порция идет сразу
+static void sink_flush(void) {
+    pthread_mutex_lock(&sink.mutex);
+    clock_gettime(CLOCK_MONOTONIC, &sink.deadline);
+    pthread_cond_signal(&sink.cond);
+    pthread_mutex_unlock(&sink.mutex);
+}
+
+static uint64_t sink_latency_usec(void) {
+    return 0;
+}
+
+static unsigned sink_underruns_count(void) {
+    return atomic_load(&sink_underruns);
+}
+
+const OutputBackend null_output = {
+    .name = "null",
+    .init = null_init,
+    .shutdown = sink_shutdown,
+    .start = sink_start,
+    .stop = sink_stop,
+    .pause = sink_pause,
+    .flush = sink_flush,
+    .latency_usec = sink_latency_usec,
+    .underruns = sink_underruns_count
+};
+
+const OutputBackend file_output = {
+    .name = "file",
+    .init = file_init,
+    .shutdown = sink_shutdown,
+    .start = sink_start,
+    .stop = sink_stop,
+    .pause = sink_pause,
+    .flush = sink_flush,
+    .latency_usec = sink_latency_usec,
+    .underruns = sink_underruns_count
+};
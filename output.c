@@ -0,0 +1,61 @@
+#include <string.h>
+#include "output.h"
+
+static const OutputBackend* const backends[] = {
+    &pulse_output,
+    &alsa_output,
+    &null_output,
+    &file_output
+};
+
+static const OutputBackend* backend = &pulse_output;
+static bool initialized = false;
+
+bool output_select(const char* name) {
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(backends[i]->name, name) == 0) {
+            backend = backends[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* output_name(void) {
+    return backend->name;
+}
+
+bool output_init(const OutputConfig* config) {
+    initialized = backend->init(config);
+    return initialized;
+}
+
+void output_shutdown(void) {
+    if (initialized) backend->shutdown();
+    initialized = false;
+}
+
+bool output_start(int sample_rate, int channels, output_fill_fn fill,
+                  output_done_fn done, void* userdata, OutputFormat* format) {
+    return initialized && backend->start(sample_rate, channels, fill, done, userdata, format);
+}
+
+void output_stop(void) {
+    if (initialized) backend->stop();
+}
+
+void output_pause(bool paused) {
+    if (initialized) backend->pause(paused);
+}
+
+void output_flush(void) {
+    if (initialized) backend->flush();
+}
+
+uint64_t output_latency_usec(void) {
+    return initialized ? backend->latency_usec() : 0;
+}
+
+unsigned output_underruns(void) {
+    return initialized ? backend->underruns() : 0;
+}
@@ -0,0 +1,86 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Выводы звука. Плеер работает с выбранным бэкендом через функции output_*,
+// бэкенд сам запрашивает данные у источника из своего потока. Источник
+// пишет фреймы сразу в формате устройства в буфер, который дает бэкенд.
+
+typedef enum {
+    OUTPUT_FORMAT_FLOAT32,
+    OUTPUT_FORMAT_S32,
+    OUTPUT_FORMAT_S16
+} OutputFormat;
+
+// Заполняет до frames фреймов в формате, который вернул output_start.
+// Возвращает число фреймов, 0 если данных пока нет (запрос повторится),
+// OUTPUT_END когда источник закончился
+typedef long (*output_fill_fn)(void* userdata, void* buffer, size_t frames);
+
+// Все отданные данные доиграны после OUTPUT_END, или устройство отказало
+typedef void (*output_done_fn)(void* userdata);
+
+#define OUTPUT_END (-1)
+
+// Параметры вывода. Длительности в миллисекундах, -1 - значение по умолчанию
+typedef struct {
+    int tlength_ms;         // Целевое заполнение буфера, задает задержку
+    int minreq_ms;          // Минимальная порция записи (период ALSA)
+    int prebuf_ms;          // Сколько накопить перед стартом и после опустошения
+    const char* device;     // ALSA: hw:0, plughw:0...; file: путь к WAV
+    bool unthrottled;       // null и file: не ждать реального времени
+} OutputConfig;
+
+#define OUTPUT_DEFAULT_TLENGTH_MS 200
+#define OUTPUT_DEFAULT_MINREQ_MS 20
+
+// Частота, на которой вывод открывается на весь сеанс. Треки с другой
+// частотой передискретизирует плеер, а не звуковой сервер
+#define OUTPUT_DEFAULT_RATE 48000
+
+typedef struct {
+    const char* name;
+    bool (*init)(const OutputConfig* config);
+    void (*shutdown)(void);
+    bool (*start)(int sample_rate, int channels, output_fill_fn fill,
+                  output_done_fn done, void* userdata, OutputFormat* format);
+    void (*stop)(void);
+    void (*pause)(bool paused);
+    void (*flush)(void);
+    uint64_t (*latency_usec)(void);
+    unsigned (*underruns)(void);
+} OutputBackend;
+
+extern const OutputBackend pulse_output;
+extern const OutputBackend alsa_output;
+extern const OutputBackend null_output;
+extern const OutputBackend file_output;
+
+// Выбор бэкенда по имени (pulse, alsa, null, file). false если имя неизвестно
+bool output_select(const char* name);
+const char* output_name(void);
+
+bool output_init(const OutputConfig* config);
+void output_shutdown(void);
+
+// Подключает источник. format получает формат устройства.
+// Устройство по возможности остается открытым между треками
+bool output_start(int sample_rate, int channels, output_fill_fn fill,
+                  output_done_fn done, void* userdata, OutputFormat* format);
+
+// Отключает источник и сбрасывает буфер. После возврата fill больше не вызывается
+void output_stop(void);
+
+// Пауза и сброс буфера при перемотке действуют сразу,
+// не дожидаясь проигрывания уже отданных данных
+void output_pause(bool paused);
+void output_flush(void);
+
+// Задержка от записи до динамика и число опустошений буфера с запуска
+uint64_t output_latency_usec(void);
+unsigned output_underruns(void);
+
+#endif
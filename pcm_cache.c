@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcm_cache.h"
+
+#define CACHE_MAGIC "OPCM"
+#define CACHE_VERSION 1
+#define CACHE_DATA_OFFSET 4096          // Данные с границы страницы
+#define CACHE_DROP_WINDOW (4 << 20)     // Сколько проигранных байт отдавать из page cache за раз
+#define CACHE_TEMP_SUFFIX ".pcm.XXXXXX"
+#define CACHE_TEMP_MAX_AGE 600          // Недописанный файл старше этого брошен упавшим процессом
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint64_t total_frames;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint32_t path_length;               // Путь исходника сразу за заголовком
+} PcmCacheHeader;
+
+struct DecoderStream {
+    int fd;
+    unsigned char* map;
+    size_t map_size;
+    const float* pcm;
+    int channels;
+    uint64_t total_frames;
+    uint64_t position;
+    uint64_t dropped;                   // До какого байта page cache уже освобожден
+};
+
+struct PcmCacheWriter {
+    FILE* file;
+    char temp_path[1040];
+    char final_path[1024];
+    PcmCacheHeader header;
+    char source[1024];
+};
+
+static char cache_dir[768] = "";
+static unsigned long long cache_budget = 0;
+
+static void cache_evict(const char* keep);
+
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Имя файла кэша и параметры исходника. false если исходник недоступен
+static bool cache_key(const char* filename, char* path, size_t path_size, struct stat* st) {
+    if (!cache_dir[0] || stat(filename, st) != 0) return false;
+
+    uint64_t hash = fnv1a(filename, strlen(filename), 0xcbf29ce484222325ULL);
+    hash = fnv1a(&st->st_size, sizeof(st->st_size), hash);
+    hash = fnv1a(&st->st_mtime, sizeof(st->st_mtime), hash);
+
+    snprintf(path, path_size, "%s/%016llx.pcm", cache_dir, (unsigned long long)hash);
+    return true;
+}
+
+bool pcm_cache_directory(char* path, size_t size) {
+    const char* base = getenv("XDG_CACHE_HOME");
+    char parent[640];
+
+    if (base && base[0]) {
+        snprintf(parent, sizeof(parent), "%s", base);
+    } else {
+        const char* home = getenv("HOME");
+        if (!home) return false;
+        snprintf(parent, sizeof(parent), "%s/.cache", home);
+    }
+
+    mkdir(parent, 0755);
+    snprintf(path, size, "%s/oplayer", parent);
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+bool pcm_cache_init(unsigned long long budget_bytes) {
+    if (!pcm_cache_directory(cache_dir, sizeof(cache_dir))) {
+        cache_dir[0] = '\0';
+        return false;
+    }
+
+    cache_budget = budget_bytes;
+    // Заодно убираем временные файлы, брошенные прошлыми запусками
+    cache_evict("");
+    return true;
+}
+
+// Чтение из кэша
+
+DecoderStream* pcm_cache_open(const char* filename, StreamInfo* info) {
+    char path[1024];
+    struct stat source;
+    if (!cache_key(filename, path, sizeof(path), &source)) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    PcmCacheHeader header;
+    char stored_path[1024];
+    if (fstat(fd, &st) != 0 || st.st_size < CACHE_DATA_OFFSET ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION ||
+        header.channels == 0 || header.path_length >= sizeof(stored_path) ||
+        pread(fd, stored_path, header.path_length, sizeof(header)) != header.path_length) {
+        close(fd);
+        return NULL;
+    }
+    stored_path[header.path_length] = '\0';
+
+    // Исходник изменился, или совпал хэш другого файла
+    uint64_t data_size = header.total_frames * header.channels * sizeof(float);
+    if (header.source_size != (uint64_t)source.st_size || header.source_mtime != source.st_mtime ||
+        strcmp(stored_path, filename) != 0 || (uint64_t)st.st_size != CACHE_DATA_OFFSET + data_size) {
+        close(fd);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    DecoderStream* stream = calloc(1, sizeof(DecoderStream));
+    if (!stream) {
+        munmap(map, st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    stream->fd = fd;
+    stream->map = map;
+    stream->map_size = st.st_size;
+    stream->pcm = (const float*)((unsigned char*)map + CACHE_DATA_OFFSET);
+    stream->channels = header.channels;
+    stream->total_frames = header.total_frames;
+    stream->dropped = CACHE_DATA_OFFSET;
+
+    // Время доступа для LRU: mtime самого файла кэша
+    futimens(fd, NULL);
+
+    info->sample_rate = header.sample_rate;
+    info->channels = header.channels;
+    info->total_frames = header.total_frames;
+    return stream;
+}
+
+long pcm_cache_read(DecoderStream* stream, float* buffer, long frames) {
+    uint64_t left = stream->total_frames - stream->position;
+    if ((uint64_t)frames > left) frames = left;
+    if (frames <= 0) return 0;
+
+    memcpy(buffer, stream->pcm + stream->position * stream->channels,
+           frames * stream->channels * sizeof(float));
+    stream->position += frames;
+
+    // Проигранное больше не нужно: отдаем страницы, чтобы кэш не вытеснял другие файлы
+    uint64_t offset = CACHE_DATA_OFFSET + stream->position * stream->channels * sizeof(float);
+    if (offset - stream->dropped >= CACHE_DROP_WINDOW) {
+        uint64_t length = (offset - stream->dropped) & ~(uint64_t)4095;
+        madvise(stream->map + stream->dropped, length, MADV_DONTNEED);
+        posix_fadvise(stream->fd, stream->dropped, length, POSIX_FADV_DONTNEED);
+        stream->dropped += length;
+    }
+
+    return frames;
+}
+
+int pcm_cache_seek(DecoderStream* stream, uint64_t frame) {
+    if (frame > stream->total_frames) frame = stream->total_frames;
+    stream->position = frame;
+
+    uint64_t offset = CACHE_DATA_OFFSET + frame * stream->channels * sizeof(float);
+    stream->dropped = offset & ~(uint64_t)4095;
+    return 0;
+}
+
+void pcm_cache_close(DecoderStream* stream) {
+    if (!stream) return;
+
+    munmap(stream->map, stream->map_size);
+    close(stream->fd);
+    free(stream);
+}
+
+// Запись в кэш
+
+PcmCacheWriter* pcm_cache_writer_open(const char* filename, int sample_rate, int channels) {
+    char path[1024];
+    struct stat source;
+    if (!cache_key(filename, path, sizeof(path), &source)) return NULL;
+    if (strlen(filename) >= CACHE_DATA_OFFSET - sizeof(PcmCacheHeader)) return NULL;
+
+    PcmCacheWriter* writer = calloc(1, sizeof(PcmCacheWriter));
+    if (!writer) return NULL;
+
+    snprintf(writer->final_path, sizeof(writer->final_path), "%s", path);
+    snprintf(writer->temp_path, sizeof(writer->temp_path), "%s.XXXXXX", path);
+    snprintf(writer->source, sizeof(writer->source), "%s", filename);
+
+    // Уникальное временное имя: один трек может писаться дважды (предзагрузка)
+    int fd = mkstemp(writer->temp_path);
+    if (fd < 0) {
+        free(writer);
+        return NULL;
+    }
+    writer->file = fdopen(fd, "wb");
+    if (!writer->file || fseek(writer->file, CACHE_DATA_OFFSET, SEEK_SET) != 0) {
+        if (writer->file) fclose(writer->file);
+        else close(fd);
+        unlink(writer->temp_path);
+        free(writer);
+        return NULL;
+    }
+
+    memcpy(writer->header.magic, CACHE_MAGIC, 4);
+    writer->header.version = CACHE_VERSION;
+    writer->header.sample_rate = sample_rate;
+    writer->header.channels = channels;
+    writer->header.source_size = source.st_size;
+    writer->header.source_mtime = source.st_mtime;
+    writer->header.path_length = strlen(filename);
+    return writer;
+}
+
+bool pcm_cache_writer_append(PcmCacheWriter* writer, const float* frames, long count) {
+    size_t samples = count * writer->header.channels;
+    if (fwrite(frames, sizeof(float), samples, writer->file) != samples) return false;
+
+    writer->header.total_frames += count;
+    return true;
+}
+
+void pcm_cache_writer_abort(PcmCacheWriter* writer) {
+    if (!writer) return;
+
+    fclose(writer->file);
+    unlink(writer->temp_path);
+    free(writer);
+}
+
+typedef struct {
+    char name[256];
+    time_t used;
+    off_t size;
+} CacheEntry;
+
+static int compare_entries(const void* a, const void* b) {
+    time_t ta = ((const CacheEntry*)a)->used;
+    time_t tb = ((const CacheEntry*)b)->used;
+    return (ta > tb) - (ta < tb);
+}
+
+// Временный файл записи: <hash>.pcm.XXXXXX
+static bool is_temp_name(const char* name, size_t len) {
+    size_t suffix = sizeof(CACHE_TEMP_SUFFIX) - 1;
+    return len > suffix && strncmp(name + len - suffix, ".pcm.", 5) == 0;
+}
+
+// Удаляем самые давно использованные записи, пока кэш не влезет в бюджет.
+// Временные файлы, которые еще пишутся, входят в бюджет, но не удаляются,
+// а брошенные после падения удаляются сразу
+static void cache_evict(const char* keep) {
+    DIR* dir = opendir(cache_dir);
+    if (!dir) return;
+
+    CacheEntry* entries = NULL;
+    size_t count = 0, capacity = 0;
+    unsigned long long total = 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        bool temp = is_temp_name(entry->d_name, len);
+        if (!temp && (len < 5 || strcmp(entry->d_name + len - 4, ".pcm") != 0)) continue;
+
+        char path[1536];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+        if (stat(path, &st) != 0) continue;
+
+        if (temp) {
+            if (time(NULL) - st.st_mtime > CACHE_TEMP_MAX_AGE) unlink(path);
+            else total += st.st_size;
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            CacheEntry* grown = realloc(entries, capacity * sizeof(CacheEntry));
+            if (!grown) break;
+            entries = grown;
+        }
+        snprintf(entries[count].name, sizeof(entries[count].name), "%s", entry->d_name);
+        entries[count].used = st.st_mtime;
+        entries[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    qsort(entries, count, sizeof(CacheEntry), compare_entries);
+    for (size_t i = 0; i < count && total > cache_budget; i++) {
+        char path[1536];
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, entries[i].name);
+        if (strcmp(path, keep) == 0) continue;
+        if (unlink(path) == 0) total -= entries[i].size;
+    }
+
+    free(entries);
+}
+
+void pcm_cache_writer_commit(PcmCacheWriter* writer) {
+    if (!writer) return;
+
+    // Заголовок пишется последним: недописанный файл никогда не выглядит готовым
+    bool ok = writer->header.total_frames > 0 &&
+              fseek(writer->file, 0, SEEK_SET) == 0 &&
+              fwrite(&writer->header, sizeof(writer->header), 1, writer->file) == 1 &&
+              fwrite(writer->source, 1, writer->header.path_length, writer->file) == writer->header.path_length;
+    ok = fclose(writer->file) == 0 && ok;
+
+    if (ok && rename(writer->temp_path, writer->final_path) == 0) {
+        cache_evict(writer->final_path);
+    } else {
+        unlink(writer->temp_path);
+    }
+    free(writer);
+}
@@ -0,0 +1,36 @@
+#ifndef PCM_CACHE_H
+#define PCM_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "decoders/decoder_api.h"
+
+// Кэш декодированного PCM на диске (~/.cache/oplayer).
+// Ключ - путь, mtime и размер исходного файла. Файл кэша - страница заголовка
+// и float фреймы за ней, поэтому воспроизводится прямо через mmap.
+// Самые давно использованные файлы удаляются при превышении бюджета.
+
+#define PCM_CACHE_BUDGET (1024ULL * 1024 * 1024)
+
+typedef struct PcmCacheWriter PcmCacheWriter;
+
+bool pcm_cache_init(unsigned long long budget_bytes);
+
+// Каталог кэшей плеера, создается при необходимости. Нужен и другим кэшам
+bool pcm_cache_directory(char* path, size_t size);
+
+// Потоковый интерфейс поверх файла кэша, те же сигнатуры, что у плагинов.
+// pcm_cache_open возвращает NULL, если готовой записи нет
+DecoderStream* pcm_cache_open(const char* filename, StreamInfo* info);
+long pcm_cache_read(DecoderStream* stream, float* buffer, long frames);
+int pcm_cache_seek(DecoderStream* stream, uint64_t frame);
+void pcm_cache_close(DecoderStream* stream);
+
+// Запись кэша по ходу декодирования. Фреймы должны идти подряд с начала трека;
+// commit публикует запись, abort удаляет недописанный файл
+PcmCacheWriter* pcm_cache_writer_open(const char* filename, int sample_rate, int channels);
+bool pcm_cache_writer_append(PcmCacheWriter* writer, const float* frames, long count);
+void pcm_cache_writer_commit(PcmCacheWriter* writer);
+void pcm_cache_writer_abort(PcmCacheWriter* writer);
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "pcm_pool.h"
+
+typedef struct {
+    unsigned char* base;
+    size_t size;
+    size_t blocks;
+    uint16_t* run_length;   // Для первого блока серии - ее длина, иначе 0
+    uint8_t* used;
+    bool locked;
+    pthread_mutex_t mutex;
+} PcmPool;
+
+static PcmPool pool = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static void* pool_map(size_t size, int flags) {
+    int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+    void* base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    // Явные huge pages есть, только если администратор их зарезервировал
+    if (flags & PCM_POOL_HUGEPAGES) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, mmap_flags | MAP_HUGETLB, -1, 0);
+    }
+#endif
+
+    if (base == MAP_FAILED) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, mmap_flags, -1, 0);
+        if (base == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(base, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    // MAP_POPULATE мог не сработать (лимиты), страницы трогаем сами
+    for (size_t offset = 0; offset < size; offset += 4096) {
+        ((volatile unsigned char*)base)[offset] = 0;
+    }
+
+    return base;
+}
+
+bool pcm_pool_init(size_t blocks, int flags) {
+    if (pool.base || blocks == 0) return false;
+
+    size_t size = blocks * PCM_BLOCK_SIZE;
+    pool.run_length = calloc(blocks, sizeof(uint16_t));
+    pool.used = calloc(blocks, sizeof(uint8_t));
+    pool.base = pool_map(size, flags);
+
+    if (!pool.run_length || !pool.used || !pool.base) {
+        if (pool.base) munmap(pool.base, size);
+        free(pool.run_length);
+        free(pool.used);
+        memset(&pool, 0, offsetof(PcmPool, mutex));
+        return false;
+    }
+
+    pool.size = size;
+    pool.blocks = blocks;
+    pool.locked = (flags & PCM_POOL_LOCK) && mlock(pool.base, size) == 0;
+    if ((flags & PCM_POOL_LOCK) && !pool.locked) {
+        fprintf(stderr, "mlock failed, PCM buffers may be swapped\n");
+    }
+
+    return true;
+}
+
+void pcm_pool_destroy(void) {
+    if (!pool.base) return;
+
+    if (pool.locked) munlock(pool.base, pool.size);
+    munmap(pool.base, pool.size);
+    free(pool.run_length);
+    free(pool.used);
+    memset(&pool, 0, offsetof(PcmPool, mutex));
+}
+
+static bool pool_owns(const void* ptr) {
+    const unsigned char* p = ptr;
+    return pool.base && p >= pool.base && p < pool.base + pool.size;
+}
+
+void* pcm_pool_alloc(size_t bytes) {
+    size_t needed = (bytes + PCM_BLOCK_SIZE - 1) / PCM_BLOCK_SIZE;
+    if (needed == 0) needed = 1;
+
+    void* result = NULL;
+
+    pthread_mutex_lock(&pool.mutex);
+    if (needed <= pool.blocks && needed <= UINT16_MAX) {
+        // Первая подходящая серия свободных блоков
+        size_t run = 0;
+        for (size_t i = 0; i < pool.blocks; i++) {
+            run = pool.used[i] ? 0 : run + 1;
+            if (run == needed) {
+                size_t first = i + 1 - needed;
+                memset(pool.used + first, 1, needed);
+                pool.run_length[first] = (uint16_t)needed;
+                result = pool.base + first * PCM_BLOCK_SIZE;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool.mutex);
+
+    return result ? result : malloc(bytes);
+}
+
+void pcm_pool_free(void* ptr) {
+    if (!ptr) return;
+
+    if (!pool_owns(ptr)) {
+        free(ptr);
+        return;
+    }
+
+    size_t first = ((unsigned char*)ptr - pool.base) / PCM_BLOCK_SIZE;
+
+    pthread_mutex_lock(&pool.mutex);
+    memset(pool.used + first, 0, pool.run_length[first]);
+    pool.run_length[first] = 0;
+    pthread_mutex_unlock(&pool.mutex);
+}
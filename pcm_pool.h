@@ -0,0 +1,25 @@
+#ifndef PCM_POOL_H
+#define PCM_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Пул PCM буферов: одна область памяти на все время работы, нарезанная на
+// блоки фиксированного размера. Кольца и буферы предзагрузки берут из нее
+// непрерывные серии блоков и возвращают обратно, поэтому смена треков
+// не трогает кучу и не вызывает новых page fault.
+
+#define PCM_BLOCK_SIZE (256 * 1024)
+#define PCM_POOL_BLOCKS 128             // 32 MB: кольцо и предзагрузка даже для 192 кГц 8 каналов
+
+#define PCM_POOL_HUGEPAGES 0x1          // MAP_HUGETLB, иначе прозрачные huge pages
+#define PCM_POOL_LOCK      0x2          // mlock: буферы не уходят в swap
+
+bool pcm_pool_init(size_t blocks, int flags);
+void pcm_pool_destroy(void);
+
+// Непрерывный буфер не меньше bytes. Если пул исчерпан, память берется из кучи
+void* pcm_pool_alloc(size_t bytes);
+void pcm_pool_free(void* ptr);
+
+#endif
@@ -1,8 +1,7 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dlfcn.h>
-#include <pulse/simple.h>
 #include <stdbool.h>
 #include <time.h>
 #include <unistd.h>
@@ -13,21 +12,37 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
 #include <errno.h>
 #include <ctype.h>  
+#include <stdatomic.h>
+#include "decoders/decoder_api.h"
+#include "ringbuffer.h"
+#include "dsp.h"
+#include "registry.h"
+#include "pcm_pool.h"
+#include "pcm_cache.h"
+#include "output.h"
+#include "wav_writer.h"
+#include "resample.h"
+#include "replaygain.h"
+#include "events.h"
+#include "screen.h"
+#include "filelist.h"
 
-#define MAX_FILES 1000
-#define MAX_FILENAME 512
 #define MAX_PATH 1024
-
-typedef enum {
-    FORMAT_UNKNOWN,
-    FORMAT_WAV,
-    FORMAT_AIFF,
-    FORMAT_OGG,
-    FORMAT_MP3,
-    FORMAT_FLAC
-} AudioFormat;
+#define FORMAT_SCAN_NOTIFY_MS 50   // Как часто фоновое определение форматов будит интерфейс
+#define PREFETCH_LEAD_SECONDS 10   // За сколько секунд до конца трека готовить следующий
+#define PREFETCH_PRIME_SECONDS 2   // Сколько секунд следующего трека декодировать заранее
+#define RING_SECONDS 1             // Емкость кольца между декодером и выводом
+#define MARKER_QUEUE_SIZE 16
+#define OUTPUT_BLOCK_SAMPLES 1024  // Блок громкости перед переводом в целые, помещается в L1
+#define RENDER_PERIOD_FRAMES 4096  // Порция, которую рендер забирает из кольца за раз
+#define RENDER_MAX_JOBS 64
+#define RENDER_WHOLE_TRACK_BYTES (512UL << 20) // Предел трека, который рендер декодирует в память целиком
+#define UI_TICK_MS 100            // Период обновления интерфейса во время игры
+#define RESAMPLE_CHUNK_FRAMES 4096 // Порция декодера перед передискретизацией
+#define CROSSFADE_SEGMENT_FRAMES 64 // Отрезок, на котором кривая наплыва заменяется прямой
 
 typedef enum {
     MODE_SEQUENTIAL,    // Проигрывать до конца списка
@@ -36,36 +51,91 @@ typedef enum {
 } PlayMode;
 
 typedef struct {
-    int16_t* pcm_data;
-    uint32_t samples_count;
+    const DecoderPlugin* plugin;
+    DecoderStream* stream;
+    decoder_read_fn read;
+    decoder_seek_fn seek;
+    decoder_close_fn close;
     int sample_rate;
     int channels;
-} AudioData;
+    uint64_t total_frames;
+    float* lead;            // Заранее декодированное начало трека
+    long lead_frames;
+    long lead_pos;
+    PcmCacheWriter* cache;  // Запись декодированного PCM на диск, NULL если не пишем
+    Resampler* resampler;   // Перевод на частоту вывода, NULL если частоты совпадают
+    float* resample_buf;    // Декодированные фреймы, еще не переданные в resampler
+    size_t resample_count;
+    size_t resample_pos;
+    float replaygain;       // Множитель громкости ReplayGain, 1.0 - без изменения
+} TrackDecoder;
 
+// Метка в потоке PCM: с позиции pos кольца начинается новый отрезок трека.
+// Декодер ставит метки при перемотке и переходе на следующий трек,
+// поток вывода применяет их, когда доходит до нужной позиции.
 typedef struct {
-    AudioData* audio;
-    bool playing;
-    bool paused;
-    bool seek_requested;
-    bool next_track_requested;
-    size_t current_sample;
-    int total_seconds;
-    pthread_mutex_t mutex;
-    pa_simple* pa;
+    size_t pos;
+    uint64_t frame;         // Позиция в треке на этой метке
+    uint64_t total_frames;
+    int track_id;
+    bool flush;             // Данные до pos устарели (перемотка)
+} StreamMarker;
+
+// Состояние воспроизведения. Декодер и вывод работают в разных потоках
+// и обмениваются только через кольцо и атомарные поля, без мьютекса.
+// Вывод читает кольцо из потока PulseAudio, когда сервер запрашивает данные.
+typedef struct {
+    TrackDecoder decoder;       // Принадлежит потоку декодирования
+    RingBuffer ring;            // PCM фреймы (float): декодер -> вывод
+    RingBuffer markers;         // StreamMarker: декодер -> вывод
+    int sample_rate;
+    int channels;
+    int track_id;               // Трек, который сейчас слышно (поток вывода)
+    GainState gain;             // Принадлежат потоку вывода
+    DitherState dither;
+    atomic_bool playing;
+    atomic_bool paused;
+    atomic_bool decode_done;
+    atomic_bool track_changed;  // Поток сам перешел на предзагруженный трек
+    _Atomic int64_t seek_target;  // -1 если перемотка не запрошена
+    _Atomic uint64_t current_frame;   // Позиция последнего отданного серверу фрейма
+    _Atomic uint64_t total_frames;
+    pthread_t decode_thread;
+    OutputFormat output_format;
+    int wake_fd;                // eventfd: декодер спит на нем, пока кольцо полно
+    atomic_bool decoder_waiting;  // Декодер ждет, читателю надо разбудить его
+    int ready_fd;               // eventfd: рендер спит на нем, пока кольцо пусто
+    atomic_bool reader_waiting; // Рендер ждет, декодеру надо разбудить его
+    uint64_t decode_frame;      // Позиция декодера в треке, фреймы кольца
+    TrackDecoder incoming;      // Следующий трек во время наплыва
+    bool fading;
+    uint64_t fade_pos;
+    uint64_t fade_length;
+    float* fade_buf;            // Порция входящего трека для сведения
 } ProgressData;
 
+// Предзагрузка следующего трека для бесшовного перехода
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    bool started;
+    bool ready;
+    int index;
+    char path[MAX_PATH];
+    TrackDecoder decoder;
+    char taken_path[MAX_PATH];  // Трек, который забрал поток воспроизведения
+    int taken_index;            // Его индекс в списке, -1 если список с тех пор сменился
+} Prefetch;
+
+// Определение форматов по сигнатуре в фоне, чтобы список появлялся сразу
 typedef struct {
-    char name[MAX_FILENAME];
-    char full_path[MAX_PATH];
-    bool is_directory;
-    bool is_parent_dir;
-    bool is_audio_file;
-    AudioFormat format;
-} FileEntry;
+    pthread_t thread;
+    bool started;
+    atomic_bool stop;
+} FormatScan;
 
 typedef struct {
-    FileEntry* files;
-    int file_count;
+    FileList list;
     int selected_index;
     int scroll_offset;
     char current_path[MAX_PATH];
@@ -73,48 +143,193 @@ typedef struct {
     bool show_help;
 } FileManager;
 
+// Пакетный рендер. Каждый поток берет файлы из своей очереди с головы,
+// а когда она кончается, крадет из чужих с хвоста - подальше от владельца
+typedef struct {
+    pthread_mutex_t mutex;
+    int head;
+    int tail;
+} RenderQueue;
+
+typedef struct {
+    char input[MAX_PATH];
+    char output[MAX_PATH];
+} RenderJob;
+
+typedef struct {
+    RenderJob* jobs;
+    RenderQueue queues[RENDER_MAX_JOBS];
+    int worker_count;
+    int decode_threads;         // Ядра на один файл, не занятые параллельным рендером
+    OutputFormat format;
+} RenderContext;
+
+typedef struct {
+    RenderContext* context;
+    int index;
+    pthread_t thread;
+    double audio_seconds;       // Итоги потока, читаются после join
+    int rendered;
+    int failed;
+    int fallbacks;              // Файлы, у которых параллельное декодирование не сошлось
+} RenderWorker;
+
 // Глобальные переменные для управления состоянием
 FileManager file_manager = {0};
 ProgressData* current_progress_data = NULL;
-pthread_t playback_thread = 0;
 bool global_playing = false;
 bool global_paused = false;
 char current_playing_file[MAX_PATH] = "";
+int current_playing_index = -1;
+Prefetch prefetch = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+FormatScan format_scan = {0};
 float global_volume = 0.7f;
+char status_message[128] = "";             // Отклик на последнюю команду, строка состояния
+int output_rate = OUTPUT_DEFAULT_RATE;     // 0 - вывод на частоте каждого трека
+ResampleQuality resample_quality = RESAMPLE_DEFAULT_QUALITY;
+ReplayGainMode replaygain_mode = REPLAYGAIN_OFF;
+int crossfade_seconds = 0;                 // 0 - бесшовный переход без наплыва
 
 // Прототипы функций
 AudioFormat detect_format(const char* filename);
 bool is_audio_file(const char* filename);
 void print_help(const char* program_name);
-void* progress_bar_thread(void* arg);
-void* playback_worker(void* arg);
-void* input_thread(void* arg);
+long fill_output(void* userdata, void* buffer, size_t frames);
+void output_finished(void* userdata);
+uint64_t playback_frame(ProgressData* data);
+ProgressData* create_progress_data(const TrackDecoder* decoder);
+void free_progress_data(ProgressData* data);
+void wake_decoder(ProgressData* data);
+void wake_reader(ProgressData* data);
+void* decode_worker(void* arg);
+size_t apply_stream_markers(ProgressData* data);
+void handle_input(void);
+void handle_playback(void);
 void display_interface();
 void display_progress_bar(int width, float progress, int elapsed_sec, int total_sec);
 void display_file_list(int width, int height);
-int get_console_width();
-int get_console_height();
+void set_status(const char* format, ...) __attribute__((format(printf, 1, 2)));
 void set_nonblocking_mode(bool enable);
-void clear_screen();
-void move_cursor(int row, int col);
 bool load_directory(const char* path);
-int compare_files(const void* a, const void* b);
+void start_format_scan();
+void stop_format_scan();
 void play_audio_file(const char* filename);
+bool open_track_decoder(const char* filename, TrackDecoder* decoder, const char** error);
+void close_track_decoder(TrackDecoder* decoder);
+long read_track_decoder(TrackDecoder* decoder, float* buffer, long frames);
+bool seek_track_decoder(TrackDecoder* decoder, uint64_t frame);
+bool prime_track_decoder(TrackDecoder* decoder, int seconds);
+bool load_whole_track(TrackDecoder* decoder, const char* filename, int threads, size_t max_bytes, int* mode);
+bool init_pcm_ring(RingBuffer* ring, int sample_rate, int channels);
+void* prefetch_worker(void* arg);
+void start_prefetch(int index);
+void reset_prefetch();
+bool take_prefetched_track(TrackDecoder* decoder, int sample_rate, int channels);
+bool take_prefetched_decoder(const char* filename, TrackDecoder* decoder);
+void update_prefetch();
+int find_file_index(const char* path);
+int find_next_track(int from, bool wrap);
 void stop_current_playback();
 void play_next_track();
 void play_previous_track();
 void seek_forward();
 void seek_backward();
+void seek_to_frame(uint64_t target);
+void seek_to_percent(int percent);
+int parse_time_string(const char* text);
 void toggle_pause();
 void adjust_volume(float change);
 const char* get_play_mode_name(PlayMode mode);
 const char* get_format_name(AudioFormat format);
+int run_render(const char* input, const char* output, int jobs, OutputFormat format);
 
 // Основная функция
 int main(int argc, char** argv) {
+    int pool_flags = PCM_POOL_HUGEPAGES;
+    bool use_cache = true;
+    bool rate_given = false;
+    OutputConfig output_config = {
+        .tlength_ms = OUTPUT_DEFAULT_TLENGTH_MS,
+        .minreq_ms = OUTPUT_DEFAULT_MINREQ_MS,
+        .prebuf_ms = -1,
+        .device = NULL,
+        .unthrottled = false
+    };
+    const char* render_input = NULL;
+    const char* render_output_path = NULL;
+    int render_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    OutputFormat render_format = OUTPUT_FORMAT_FLOAT32;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mlock") == 0) {
+            pool_flags |= PCM_POOL_LOCK;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = false;
+        } else if (strcmp(argv[i], "--tlength") == 0 && i + 1 < argc) {
+            output_config.tlength_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--minreq") == 0 && i + 1 < argc) {
+            output_config.minreq_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--prebuf") == 0 && i + 1 < argc) {
+            output_config.prebuf_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            if (!output_select(argv[++i])) {
+                fprintf(stderr, "Unknown output: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            output_config.device = argv[++i];
+        } else if (strcmp(argv[i], "--unthrottled") == 0) {
+            output_config.unthrottled = true;
+        } else if (strcmp(argv[i], "--crossfade") == 0 && i + 1 < argc) {
+            crossfade_seconds = atoi(argv[++i]);
+            if (crossfade_seconds < 0) crossfade_seconds = 0;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            output_rate = atoi(argv[++i]);
+            if (output_rate < 0) output_rate = 0;
+            rate_given = true;
+        } else if (strcmp(argv[i], "--resample-quality") == 0 && i + 1 < argc) {
+            if (!resample_quality_from_name(argv[++i], &resample_quality)) {
+                fprintf(stderr, "Unknown resample quality: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--replaygain") == 0 && i + 1 < argc) {
+            if (!replaygain_mode_from_name(argv[++i], &replaygain_mode)) {
+                fprintf(stderr, "Unknown ReplayGain mode: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--render") == 0 && i + 2 < argc) {
+            render_input = argv[++i];
+            render_output_path = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            render_jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--render-format") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "f32") == 0) render_format = OUTPUT_FORMAT_FLOAT32;
+            else if (strcmp(name, "s32") == 0) render_format = OUTPUT_FORMAT_S32;
+            else if (strcmp(name, "s16") == 0) render_format = OUTPUT_FORMAT_S16;
+            else {
+                fprintf(stderr, "Unknown render format: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_help(argv[0]);
+            return 0;
+        }
+    }
+    
+    // Все PCM буферы берутся из одной заранее выделенной области
+    if (!pcm_pool_init(PCM_POOL_BLOCKS, pool_flags)) {
+        fprintf(stderr, "PCM pool unavailable, using heap buffers\n");
+    }
+    
+    // Повторное воспроизведение сжатых треков идет из кэша без декодирования.
+    // Рендер всегда декодирует заново: он меряет скорость цепочки и не должен
+    // вытеснять кэш воспроизведения копиями всех конвертируемых файлов
+    if (use_cache && !render_input && !pcm_cache_init(PCM_CACHE_BUDGET)) {
+        fprintf(stderr, "PCM cache unavailable\n");
+    }
+    
     // Инициализация файлового менеджера
-    file_manager.files = malloc(MAX_FILES * sizeof(FileEntry));
-    file_manager.file_count = 0;
+    file_manager.list = (FileList){0}; // Растет при загрузке директории
     file_manager.selected_index = 0;
     file_manager.scroll_offset = 0;
     file_manager.play_mode = MODE_SEQUENTIAL;
@@ -125,114 +340,163 @@ int main(int argc, char** argv) {
         strcpy(file_manager.current_path, ".");
     }
     
+    // Плагины декодеров загружаются один раз на все время работы
+    if (registry_load(".") == 0) {
+        fprintf(stderr, "No decoder plugins found\n");
+    }
+    
+    // Пакетный рендер в файлы, без терминального интерфейса и звуковой карты
+    if (render_input) {
+        // Конвертация сохраняет частоту исходника, если ее не задали явно
+        if (!rate_given) output_rate = 0;
+        int status = run_render(render_input, render_output_path, render_jobs, render_format);
+        stop_format_scan();
+        replaygain_shutdown();
+        file_list_free(&file_manager.list);
+        return status;
+    }
+    
+    // До запуска потоков вывода: им не должен доставаться SIGWINCH
+    if (!events_init()) {
+        fprintf(stderr, "Error initializing event loop\n");
+        file_list_free(&file_manager.list);
+        return 1;
+    }
+    
+    // Вывод открывается один раз на все время работы и переживает смену треков
+    if (!output_init(&output_config)) {
+        fprintf(stderr, "Error initializing audio output: %s\n", output_name());
+        file_list_free(&file_manager.list);
+        return 1;
+    }
+    
     // Загружаем файлы текущей директории
     if (!load_directory(file_manager.current_path)) {
         fprintf(stderr, "Error loading directory: %s\n", file_manager.current_path);
-        free(file_manager.files);
+        file_list_free(&file_manager.list);
         return 1;
     }
     
     // Настраиваем терминал
     set_nonblocking_mode(true);
-    clear_screen();
-    
-    printf("Audio Player File Manager\n");
-    printf("Controls: j/k - navigate, Enter - play, Space - pause, ←/→ - seek, q - quit, r - change mode, h - help\n");
-    printf("Current mode: %s\n\n", get_play_mode_name(file_manager.play_mode));
-    
-    // Запускаем поток ввода
-    pthread_t input_thread_id;
-    pthread_create(&input_thread_id, NULL, input_thread, NULL);
+    if (!screen_init()) {
+        set_nonblocking_mode(false);
+        fprintf(stderr, "Error initializing screen\n");
+        file_list_free(&file_manager.list);
+        return 1;
+    }
     
-    // Основной цикл отрисовки
+    // Основной цикл: ввод, отрисовка и смена треков в одном потоке.
+    // Между событиями поток спит в poll, таймер тикает только во время игры
+    display_interface();
     while (1) {
-        display_interface();
-        usleep(50000); // 50ms
+        unsigned events = events_wait();
         
-        // Автоматическое воспроизведение следующего трека
-        if (global_playing && current_progress_data && !global_paused) {
-            pthread_mutex_lock(&current_progress_data->mutex);
-            bool track_finished = current_progress_data->current_sample >= 
-                                current_progress_data->audio->samples_count - 1000;
-            pthread_mutex_unlock(&current_progress_data->mutex);
-            
-            if (track_finished) {
-                if (file_manager.play_mode == MODE_SINGLE_LOOP) {
-                    // Перезапуск текущего трека
-                    stop_current_playback();
-                    play_audio_file(current_playing_file);
-                } else {
-                    // Следующий трек
-                    play_next_track();
-                }
-            }
+        if (events & EVENT_RESIZE) {
+            screen_resize();
         }
+        if (events & EVENT_INPUT) {
+            handle_input();
+        }
+        handle_playback();
+        
+        events_set_timer(global_playing && !global_paused ? UI_TICK_MS : 0);
+        display_interface();
     }
     
     // Завершение (эта часть никогда не выполняется в бесконечном цикле)
+    screen_shutdown();
     set_nonblocking_mode(false);
-    pthread_join(input_thread_id, NULL);
-    free(file_manager.files);
+    events_shutdown();
+    file_list_free(&file_manager.list);
     
     printf("\nGoodbye!\n");
     return 0;
 }
 
-// Функция сравнения для сортировки файлов
-int compare_files(const void* a, const void* b) {
-    const FileEntry* fileA = (const FileEntry*)a;
-    const FileEntry* fileB = (const FileEntry*)b;
-    
-    // Сначала папки, потом файлы
-    if (fileA->is_directory && !fileB->is_directory) return -1;
-    if (!fileA->is_directory && fileB->is_directory) return 1;
-    
-    // Затем ".." всегда в самом верху
-    if (fileA->is_parent_dir && !fileB->is_parent_dir) return -1;
-    if (!fileA->is_parent_dir && fileB->is_parent_dir) return 1;
-    
-    // Сортировка по имени для одинаковых типов
-    return strcasecmp(fileA->name, fileB->name);
+// Смена треков по состоянию потоков воспроизведения
+void handle_playback(void) {
+    // Автоматическое воспроизведение следующего трека
+    if (global_playing && current_progress_data && !global_paused) {
+        bool track_finished = !atomic_load(&current_progress_data->playing);
+        bool track_changed = atomic_exchange(&current_progress_data->track_changed, false);
+        
+        if (track_changed) {
+            // Поток воспроизведения уже перешел на предзагруженный трек
+            pthread_mutex_lock(&prefetch.mutex);
+            strcpy(current_playing_file, prefetch.taken_path);
+            int index = prefetch.taken_index;
+            pthread_mutex_unlock(&prefetch.mutex);
+            
+            // Каталог сменили после перехода: ищем трек в новом списке
+            if (index < 0) index = find_file_index(current_playing_file);
+            if (index >= 0) file_manager.selected_index = index;
+            current_playing_index = index;
+            reset_prefetch();
+        }
+        
+        if (!track_finished) {
+            update_prefetch();
+        } else {
+            if (file_manager.play_mode == MODE_SINGLE_LOOP) {
+                // Перезапуск текущего трека
+                stop_current_playback();
+                play_audio_file(current_playing_file);
+            } else {
+                // Следующий трек
+                play_next_track();
+            }
+        }
+    }
 }
 
-// Загрузка директории
+// Загрузка директории. Тип записи берется из d_type без stat, форматы
+// аудио файлов определяются потом в фоне, чтобы список появился сразу
 bool load_directory(const char* path) {
     DIR* dir = opendir(path);
     if (!dir) {
         return false;
     }
     
-    file_manager.file_count = 0;
+    // Индексы старого списка больше не действительны
+    stop_format_scan();
+    reset_prefetch();
+    current_playing_index = -1;
+    pthread_mutex_lock(&prefetch.mutex);
+    prefetch.taken_index = -1;
+    pthread_mutex_unlock(&prefetch.mutex);
+    
+    file_list_clear(&file_manager.list);
     file_manager.selected_index = 0;
     file_manager.scroll_offset = 0;
     
     // Добавляем ".." для перехода наверх
     if (strcmp(path, "/") != 0) {
-        FileEntry* entry = &file_manager.files[file_manager.file_count++];
-        strcpy(entry->name, "..");
-        strcpy(entry->full_path, "..");
-        entry->is_directory = true;
-        entry->is_parent_dir = true;
-        entry->is_audio_file = false;
-        entry->format = FORMAT_UNKNOWN;
+        file_list_add(&file_manager.list, NULL, "..", FILE_DIRECTORY | FILE_PARENT);
     }
     
+    int dir_fd = dirfd(dir);
     struct dirent* dp;
-    while ((dp = readdir(dir)) != NULL && file_manager.file_count < MAX_FILES) {
+    while ((dp = readdir(dir)) != NULL) {
         // Пропускаем скрытые файлы и специальные директории
         if (dp->d_name[0] == '.') {
             continue;
         }
         
-        char full_path[MAX_PATH];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, dp->d_name);
-        
-        struct stat statbuf;
-        if (stat(full_path, &statbuf) == -1) {
-            continue; // Пропускаем файлы без прав доступа
+        bool is_dir;
+        if (dp->d_type == DT_DIR) {
+            is_dir = true;
+        } else if (dp->d_type != DT_UNKNOWN && dp->d_type != DT_LNK) {
+            is_dir = false;
+        } else {
+            // Файловая система не сообщает тип или это ссылка: смотрим, куда она ведет
+            struct stat statbuf;
+            if (fstatat(dir_fd, dp->d_name, &statbuf, 0) == -1) {
+                continue; // Пропускаем файлы без прав доступа и битые ссылки
+            }
+            is_dir = S_ISDIR(statbuf.st_mode);
         }
         
-        bool is_dir = S_ISDIR(statbuf.st_mode);
         bool is_audio = !is_dir && is_audio_file(dp->d_name);
         
         // Показываем только папки и аудио файлы
@@ -240,26 +504,73 @@ bool load_directory(const char* path) {
             continue;
         }
         
-        FileEntry* entry = &file_manager.files[file_manager.file_count];
-        strncpy(entry->name, dp->d_name, MAX_FILENAME - 1);
-        strncpy(entry->full_path, full_path, MAX_PATH - 1);
-        entry->is_directory = is_dir;
-        entry->is_parent_dir = false;
-        entry->is_audio_file = is_audio;
-        entry->format = is_audio ? detect_format(full_path) : FORMAT_UNKNOWN;
-        
-        file_manager.file_count++;
+        unsigned flags = is_dir ? FILE_DIRECTORY : FILE_AUDIO | FORMAT_PENDING << FILE_FORMAT_SHIFT;
+        if (!file_list_add(&file_manager.list, path, dp->d_name, flags)) break;
     }
     
     closedir(dir);
     
     // Сортируем файлы: папки сверху, затем аудио файлы
-    qsort(file_manager.files, file_manager.file_count, sizeof(FileEntry), compare_files);
+    file_list_sort(&file_manager.list);
     
     strcpy(file_manager.current_path, path);
+    start_format_scan();
+    
+    // Громкость треков каталога измеряется в фоне, к воспроизведению обычно готова
+    if (replaygain_mode != REPLAYGAIN_OFF) {
+        const char** paths = malloc((file_manager.list.count + 1) * sizeof(const char*));
+        if (paths) {
+            int count = 0;
+            for (int i = 0; i < file_manager.list.count; i++) {
+                const FileEntry* entry = &file_manager.list.entries[i];
+                if (file_is_audio(entry)) paths[count++] = file_list_path(&file_manager.list, entry);
+            }
+            replaygain_scan(paths, count);
+            free(paths);
+        }
+    }
     return true;
 }
 
+// Фоновое определение форматов. Список не меняется, пока поток работает:
+// load_directory сначала останавливает его
+static void* format_scan_worker(void* arg) {
+    (void)arg;
+    struct timespec last, now;
+    clock_gettime(CLOCK_MONOTONIC, &last);
+    
+    for (int i = 0; i < file_manager.list.count && !atomic_load(&format_scan.stop); i++) {
+        FileEntry* entry = &file_manager.list.entries[i];
+        if (file_format(entry) != FORMAT_PENDING) continue;
+        
+        file_set_format(entry, detect_format(file_list_path(&file_manager.list, entry)));
+        
+        // Интерфейс перерисовывается пачками, а не на каждый файл
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed_ms = (now.tv_sec - last.tv_sec) * 1000 + (now.tv_nsec - last.tv_nsec) / 1000000;
+        if (elapsed_ms >= FORMAT_SCAN_NOTIFY_MS) {
+            events_notify();
+            last = now;
+        }
+    }
+    
+    events_notify();
+    return NULL;
+}
+
+void start_format_scan() {
+    atomic_store(&format_scan.stop, false);
+    format_scan.started = pthread_create(&format_scan.thread, NULL, format_scan_worker, NULL) == 0;
+}
+
+void stop_format_scan() {
+    if (!format_scan.started) return;
+    
+    atomic_store(&format_scan.stop, true);
+    pthread_join(format_scan.thread, NULL);
+    format_scan.started = false;
+}
+
 // Проверка является ли файл аудио
 bool is_audio_file(const char* filename) {
     const char* ext = strrchr(filename, '.');
@@ -300,15 +611,13 @@ AudioFormat detect_format(const char* filename) {
     return FORMAT_UNKNOWN;
 }
 
-// Отображение интерфейса
+// Отображение интерфейса. Кадр собирается в буфере экрана,
+// в терминал уходят только изменившиеся ячейки
 void display_interface() {
-    struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    int width = w.ws_col;
-    int height = w.ws_row;
+    int width = screen_width();
+    int height = screen_height();
     
-    clear_screen();
-    move_cursor(0, 0);
+    screen_clear();
     
     // Заголовок с информацией о состоянии
     const char* state_text = "";
@@ -318,17 +627,16 @@ void display_interface() {
         state_text = "STOPPED";
     }
     
-    printf("Audio Player - %s | Mode: %s | State: %s | Volume: %d%%\n", 
-           file_manager.current_path, 
-           get_play_mode_name(file_manager.play_mode),
-           state_text,
-           (int)(global_volume * 100));
+    screen_printf(0, 0, width, "Audio Player - %s | Mode: %s | State: %s | Volume: %d%%", 
+                  file_manager.current_path, 
+                  get_play_mode_name(file_manager.play_mode),
+                  state_text,
+                  (int)(global_volume * 100));
     
-    printf("Controls: j/k: Navigate | Enter: Play | Space: Pause | ←/→: Seek ±10s | +/-: Volume | m: Mute | r: Mode | n/p: Next/Prev | h: Help | q: Quit\n");
+    screen_put(1, 0, "Controls: j/k: Navigate | Enter: Play | Space: Pause | ←/→: Seek ±10s | 0-9: Seek % | g: Go to | +/-: Volume | m: Mute | r: Mode | n/p: Next/Prev | h: Help | q: Quit", width);
     
     // Разделительная линия
-    for (int i = 0; i < width; i++) printf("=");
-    printf("\n");
+    screen_fill(2, 0, width, '=');
     
     // Основное содержимое
     int content_height = height - 6; // Оставляем место для заголовка и прогресс-бара
@@ -338,35 +646,37 @@ void display_interface() {
     display_file_list(list_width, content_height);
     
     // Прогресс-бар и информация о текущем треке
-    move_cursor(content_height + 1, 0);
-    for (int i = 0; i < width; i++) printf("-");
-    printf("\n");
+    screen_fill(content_height + 1, 0, width, '-');
     
     if (global_playing && current_progress_data) {
-        pthread_mutex_lock(&current_progress_data->mutex);
-        int current_sec = current_progress_data->current_sample / 
-                         (current_progress_data->audio->sample_rate * current_progress_data->audio->channels);
-        float progress = (float)current_sec / current_progress_data->total_seconds;
-        bool paused = current_progress_data->paused;
-        pthread_mutex_unlock(&current_progress_data->mutex);
+        ProgressData* data = current_progress_data;
+        int current_sec = playback_frame(data) / data->sample_rate;
+        int total_seconds = atomic_load(&data->total_frames) / data->sample_rate;
+        float progress = total_seconds > 0 ? (float)current_sec / total_seconds : 0.0f;
+        bool paused = atomic_load(&data->paused);
         
-        display_progress_bar(progress_width, progress, current_sec, current_progress_data->total_seconds);
+        display_progress_bar(progress_width, progress, current_sec, total_seconds);
         
         // Информация о текущем треке
-        move_cursor(content_height + 3, list_width + 2);
         const char* filename = strrchr(current_playing_file, '/') ? 
                               strrchr(current_playing_file, '/') + 1 : current_playing_file;
-        printf("Now Playing: %s %s", filename, paused ? "[PAUSED]" : "");
+        screen_printf(content_height + 3, list_width + 2, width, "Now Playing: %s %s",
+                      filename, paused ? "[PAUSED]" : "");
         
         // Информация о перемотке
-        move_cursor(content_height + 4, list_width + 2);
-        printf("Use ← and → arrows to seek ±10 seconds");
+        screen_put(content_height + 4, list_width + 2, "Use ← and → arrows to seek ±10 seconds", width);
+        
+        // Обратная связь от сервера
+        screen_printf(content_height + 5, list_width + 2, width, "Latency: %d ms, underruns: %u",
+                      (int)(output_latency_usec() / 1000), output_underruns());
     } else {
-        move_cursor(content_height + 3, list_width + 2);
-        printf("No track playing");
+        screen_put(content_height + 3, list_width + 2, "No track playing", width);
     }
     
-    fflush(stdout);
+    // Отклик на последнюю команду
+    screen_put(content_height + 3, 0, status_message, list_width);
+    
+    screen_flush();
 }
 
 // Отображение списка файлов
@@ -380,45 +690,32 @@ void display_file_list(int width, int height) {
         file_manager.scroll_offset = file_manager.selected_index - visible_items + 1;
     }
     
-    // Отображаем файлы
-    for (int i = 0; i < visible_items && i + file_manager.scroll_offset < file_manager.file_count; i++) {
+    // Отображаем файлы, первая строка под разделителем заголовка
+    for (int i = 0; i < visible_items && i + file_manager.scroll_offset < file_manager.list.count; i++) {
         int idx = i + file_manager.scroll_offset;
-        FileEntry* entry = &file_manager.files[idx];
-        
-        // Очистка строки
-        printf("\r");
-        for (int j = 0; j < width; j++) printf(" ");
-        printf("\r");
-        
-        // Выделение выбранного элемента
-        if (idx == file_manager.selected_index) {
-            printf("> ");
-        } else {
-            printf("  ");
-        }
+        FileEntry* entry = &file_manager.list.entries[idx];
+        int row = 3 + i;
         
-        // Иконка типа файла
-        if (entry->is_directory) {
-            if (entry->is_parent_dir) {
-                printf("[UP] ");
-            } else {
-                printf("[DIR] ");
-            }
-        } else if (entry->is_audio_file) {
-            printf("[%s] ", get_format_name(entry->format));
+        // Выделение выбранного элемента и иконка типа файла
+        const char* marker = idx == file_manager.selected_index ? ">" : " ";
+        int col;
+        if (file_is_directory(entry)) {
+            col = screen_printf(row, 0, width, "%s %s ", marker, file_is_parent(entry) ? "[UP]" : "[DIR]");
+        } else if (file_is_audio(entry)) {
+            col = screen_printf(row, 0, width, "%s [%s] ", marker, get_format_name(file_format(entry)));
         } else {
-            printf("[   ] ");
+            col = screen_printf(row, 0, width, "%s [   ] ", marker);
         }
         
         // Имя файла (обрезаем если слишком длинное)
+        const char* name = file_list_name(&file_manager.list, entry);
         int max_name_len = width - 10;
-        if (strlen(entry->name) > max_name_len) {
-            printf("%.*s...", max_name_len - 3, entry->name);
+        if (screen_text_width(name) > max_name_len) {
+            col += screen_put(row, col, name, max_name_len - 3);
+            screen_put(row, col, "...", 3);
         } else {
-            printf("%s", entry->name);
+            screen_put(row, col, name, width - col);
         }
-        
-        printf("\n");
     }
 }
 
@@ -428,220 +725,928 @@ void display_progress_bar(int width, float progress, int elapsed_sec, int total_
     if (progress < 0.0f) progress = 0.0f;
     
     int bar_width = width - 20;
+    if (bar_width < 0) bar_width = 0;
     int pos = (int)(bar_width * progress);
     
-    printf("[");
+    // Полоса собирается целиком и кладется в кадр одним вызовом
+    char bar[bar_width + 3];
+    bar[0] = '[';
     for (int i = 0; i < bar_width; i++) {
-        if (i < pos) printf("=");
-        else if (i == pos) printf(">");
-        else printf(" ");
+        if (i < pos) bar[i + 1] = '=';
+        else if (i == pos) bar[i + 1] = '>';
+        else bar[i + 1] = ' ';
+    }
+    bar[bar_width + 1] = ']';
+    bar[bar_width + 2] = '\0';
+    
+    int row = screen_height() - 4;
+    int col = screen_put(row, 0, bar, bar_width + 2);
+    screen_printf(row, col, screen_width() - col, " %3d%% %d:%02d / %d:%02d",
+                  (int)(progress * 100),
+                  elapsed_sec / 60, elapsed_sec % 60,
+                  total_sec / 60, total_sec % 60);
+}
+
+// Открытие потокового декодера для файла. Причину отказа кладет в *error,
+// если он передан: печатать поверх интерфейса или из фонового потока нельзя
+bool open_track_decoder(const char* filename, TrackDecoder* decoder, const char** error) {
+    StreamInfo info = {0};
+    
+    // Трек уже декодировался раньше: читаем готовый PCM из кэша
+    DecoderStream* cached = pcm_cache_open(filename, &info);
+    if (cached) {
+        *decoder = (TrackDecoder){
+            .stream = cached,
+            .read = pcm_cache_read,
+            .seek = pcm_cache_seek,
+            .close = pcm_cache_close,
+            .sample_rate = info.sample_rate,
+            .channels = info.channels,
+            .total_frames = info.total_frames,
+            .replaygain = replaygain_factor(filename, replaygain_mode)
+        };
+        return true;
     }
-    printf("] %3d%% ", (int)(progress * 100));
     
-    printf("%d:%02d / %d:%02d", 
-           elapsed_sec / 60, elapsed_sec % 60,
-           total_sec / 60, total_sec % 60);
+    // Плагин выбирается по содержимому файла, библиотеки уже загружены
+    const DecoderPlugin* plugin = registry_find(filename);
+    if (!plugin) {
+        if (error) *error = "Unsupported format";
+        return false;
+    }
+    
+    *decoder = (TrackDecoder){
+        .plugin = plugin,
+        .read = plugin->read,
+        .seek = plugin->seek,
+        .close = plugin->close
+    };
+    
+    decoder->stream = plugin->open(filename, &info);
+    if (!decoder->stream || info.sample_rate <= 0 || info.channels <= 0) {
+        if (error) *error = "Error decoding audio file";
+        if (decoder->stream) decoder->close(decoder->stream);
+        decoder->stream = NULL;
+        return false;
+    }
+    
+    decoder->sample_rate = info.sample_rate;
+    decoder->channels = info.channels;
+    decoder->total_frames = info.total_frames;
+    decoder->replaygain = replaygain_factor(filename, replaygain_mode);
+    
+    // WAV и AIFF и так читаются через mmap, кэшировать имеет смысл только сжатые.
+    // Формат уже известен по плагину, выбранному registry_find
+    if (!(plugin->flags & DECODER_FLAG_DIRECT)) {
+        decoder->cache = pcm_cache_writer_open(filename, info.sample_rate, info.channels);
+    }
+    return true;
 }
 
-// Воспроизведение аудио файла
-void play_audio_file(const char* filename) {
-    stop_current_playback();
+void close_track_decoder(TrackDecoder* decoder) {
+    // Трек не дочитан до конца: неполная запись в кэш не нужна
+    pcm_cache_writer_abort(decoder->cache);
+    if (decoder->stream) decoder->close(decoder->stream);
+    pcm_pool_free(decoder->lead);
+    resampler_destroy(decoder->resampler);
+    pcm_pool_free(decoder->resample_buf);
+    decoder->stream = NULL;
+    decoder->plugin = NULL;
+    decoder->lead = NULL;
+    decoder->cache = NULL;
+    decoder->resampler = NULL;
+    decoder->resample_buf = NULL;
+}
+
+// Чтение из декодера с копией в кэш. Запись публикуется, когда трек дочитан
+static long decode_track_frames(TrackDecoder* decoder, float* buffer, long frames) {
+    long got = decoder->read(decoder->stream, buffer, frames);
+    if (!decoder->cache) return got;
     
-    AudioFormat format = detect_format(filename);
-    if (format == FORMAT_UNKNOWN) {
-        printf("Unsupported format: %s\n", filename);
-        return;
+    if (got > 0 && pcm_cache_writer_append(decoder->cache, buffer, got)) return got;
+    
+    if (got == 0) {
+        pcm_cache_writer_commit(decoder->cache);
+    } else {
+        pcm_cache_writer_abort(decoder->cache);
+    }
+    decoder->cache = NULL;
+    return got;
+}
+
+// Чтение фреймов: сначала заранее декодированное начало, затем декодер
+long read_track_decoder(TrackDecoder* decoder, float* buffer, long frames) {
+    if (decoder->lead_pos < decoder->lead_frames) {
+        long count = decoder->lead_frames - decoder->lead_pos;
+        if (count > frames) count = frames;
+        
+        memcpy(buffer, decoder->lead + decoder->lead_pos * decoder->channels,
+               count * decoder->channels * sizeof(float));
+        decoder->lead_pos += count;
+        return count;
     }
     
-    const char* libname;
-    const char* decode_func_name;
+    // Трек был декодирован целиком, и lead дочитан
+    if (!decoder->stream) return 0;
+    return decode_track_frames(decoder, buffer, frames);
+}
+
+// Перемотка. Кэш пишется только подряд от начала, после перемотки запись бросаем
+bool seek_track_decoder(TrackDecoder* decoder, uint64_t frame) {
+    // Трек целиком в памяти: перемотка внутри lead
+    if (!decoder->stream) {
+        decoder->lead_pos = frame < (uint64_t)decoder->lead_frames ? (long)frame : decoder->lead_frames;
+        return true;
+    }
     
-    switch (format) {
-        case FORMAT_WAV: libname = "./libwavdecoder.so"; decode_func_name = "decode_wav"; break;
-        case FORMAT_AIFF: libname = "./libaiffdecoder.so"; decode_func_name = "decode_aiff"; break;
-        case FORMAT_OGG: libname = "./liboggdecoder.so"; decode_func_name = "decode_ogg"; break;
-        case FORMAT_MP3: libname = "./libmp3decoder.so"; decode_func_name = "decode_mp3"; break;
-        case FORMAT_FLAC: libname = "./libflacdecoder.so"; decode_func_name = "decode_flac"; break;
-        default: return;
+    if (decoder->seek(decoder->stream, frame) != 0) return false;
+    
+    pcm_cache_writer_abort(decoder->cache);
+    decoder->cache = NULL;
+    decoder->lead_frames = 0;
+    return true;
+}
+
+// Декодирование начала трека заранее, чтобы переход не ждал декодер
+bool prime_track_decoder(TrackDecoder* decoder, int seconds) {
+    long frames = (long)decoder->sample_rate * seconds;
+    decoder->lead = pcm_pool_alloc(frames * decoder->channels * sizeof(float));
+    if (!decoder->lead) return false;
+    
+    long total = 0;
+    while (total < frames) {
+        long got = decode_track_frames(decoder, decoder->lead + total * decoder->channels, frames - total);
+        if (got <= 0) break;
+        total += got;
     }
     
-    void* decoder_lib = dlopen(libname, RTLD_LAZY);
-    if (!decoder_lib) {
-        printf("Error loading decoder: %s\n", dlerror());
-        return;
+    decoder->lead_frames = total;
+    decoder->lead_pos = 0;
+    return total > 0;
+}
+
+// Весь трек в lead параллельным декодированием плагина, если плагин это умеет.
+// Поток плагина после этого закрывается, фреймы и перемотка идут из памяти.
+// В *mode - DECODE_ALL_* от плагина. false - трек остался потоковым
+bool load_whole_track(TrackDecoder* decoder, const char* filename, int threads, size_t max_bytes, int* mode) {
+    const DecoderPlugin* plugin = decoder->plugin;
+    size_t frame_bytes = decoder->channels * sizeof(float);
+    if (!plugin || !plugin->decode_all || threads <= 1 || decoder->lead ||
+        decoder->total_frames == 0 || decoder->total_frames > max_bytes / frame_bytes) {
+        return false;
     }
     
-    AudioData* (*decode)(const char*) = dlsym(decoder_lib, decode_func_name);
-    void (*free_audio)(AudioData*) = dlsym(decoder_lib, "free_audio_data");
+    float* pcm = pcm_pool_alloc(decoder->total_frames * frame_bytes);
+    if (!pcm) return false;
     
-    if (!decode || !free_audio) {
-        printf("Error loading decoder functions: %s\n", dlerror());
-        dlclose(decoder_lib);
-        return;
+    DecodeAllOptions options = { .threads = threads };
+    long got = plugin->decode_all(filename, pcm, decoder->total_frames, &options);
+    *mode = options.mode;
+    if (got <= 0) {
+        pcm_pool_free(pcm);
+        return false;
     }
     
-    AudioData* audio = decode(filename);
-    if (!audio || audio->sample_rate <= 0 || audio->channels <= 0 || audio->samples_count == 0) {
-        printf("Error decoding audio file\n");
-        if (audio) free_audio(audio);
-        dlclose(decoder_lib);
-        return;
+    pcm_cache_writer_abort(decoder->cache);
+    decoder->close(decoder->stream);
+    decoder->stream = NULL;
+    decoder->cache = NULL;
+    decoder->lead = pcm;
+    decoder->lead_frames = got;
+    decoder->lead_pos = 0;
+    return true;
+}
+
+// Кольцо PCM между декодером и выводом, память берется из пула
+bool init_pcm_ring(RingBuffer* ring, int sample_rate, int channels) {
+    size_t capacity = ring_capacity_for((size_t)sample_rate * RING_SECONDS);
+    size_t item_size = channels * sizeof(float);
+    
+    void* data = pcm_pool_alloc(capacity * item_size);
+    if (!data) return false;
+    
+    ring_init_storage(ring, data, capacity, item_size);
+    return true;
+}
+
+// Индекс файла с полным путем path в текущем списке, -1 если его там нет
+int find_file_index(const char* path) {
+    for (int i = 0; i < file_manager.list.count; i++) {
+        if (strcmp(file_list_path(&file_manager.list, &file_manager.list.entries[i]), path) == 0) return i;
     }
+    return -1;
+}
+
+// Поиск следующего аудио файла в списке
+int find_next_track(int from, bool wrap) {
+    for (int i = from + 1; ; i++) {
+        if (i >= file_manager.list.count) {
+            if (!wrap) return -1;
+            i = 0;
+        }
+        if (i == from) return -1;
+        
+        FileEntry* entry = &file_manager.list.entries[i];
+        if (file_is_audio(entry) && !file_is_directory(entry)) {
+            return i;
+        }
+    }
+}
+
+// Поток предзагрузки: открывает следующий трек и декодирует его начало
+void* prefetch_worker(void* arg) {
+    (void)arg;
+    TrackDecoder decoder = {0};
     
-    pa_sample_spec ss = {
-        .format = PA_SAMPLE_S16LE,
-        .rate = (uint32_t)audio->sample_rate,
-        .channels = (uint8_t)audio->channels
-    };
+    bool ok = open_track_decoder(prefetch.path, &decoder, NULL); // Ошибку покажет play_audio_file
+    if (ok && !prime_track_decoder(&decoder, PREFETCH_PRIME_SECONDS)) {
+        close_track_decoder(&decoder);
+        ok = false;
+    }
     
-    if (!pa_sample_spec_valid(&ss)) {
-        printf("Invalid audio format\n");
-        free_audio(audio);
-        dlclose(decoder_lib);
-        return;
+    pthread_mutex_lock(&prefetch.mutex);
+    if (ok) {
+        prefetch.decoder = decoder;
+        prefetch.ready = true;
     }
+    pthread_mutex_unlock(&prefetch.mutex);
     
-    pa_simple* pa = pa_simple_new(NULL, "Player", PA_STREAM_PLAYBACK, 
-                                 NULL, "Audio", &ss, NULL, NULL, NULL);
-    if (!pa) {
-        printf("Error initializing audio\n");
-        free_audio(audio);
-        dlclose(decoder_lib);
-        return;
+    return NULL;
+}
+
+void start_prefetch(int index) {
+    if (prefetch.started) return;
+    
+    strcpy(prefetch.path, file_list_path(&file_manager.list, &file_manager.list.entries[index]));
+    prefetch.index = index;
+    prefetch.ready = false;
+    prefetch.started = true;
+    pthread_create(&prefetch.thread, NULL, prefetch_worker, NULL);
+}
+
+// Отмена предзагрузки и освобождение неиспользованного декодера
+void reset_prefetch() {
+    if (!prefetch.started) return;
+    
+    pthread_join(prefetch.thread, NULL);
+    
+    pthread_mutex_lock(&prefetch.mutex);
+    if (prefetch.ready) {
+        close_track_decoder(&prefetch.decoder);
+        prefetch.ready = false;
+    }
+    prefetch.started = false;
+    pthread_mutex_unlock(&prefetch.mutex);
+}
+
+// Вызывается потоком воспроизведения в конце трека: забирает следующий трек,
+// если он готов и совместим с открытым выводом. sample_rate 0 - подходит
+// любая частота, поток сам передискретизирует
+bool take_prefetched_track(TrackDecoder* decoder, int sample_rate, int channels) {
+    bool taken = false;
+    
+    pthread_mutex_lock(&prefetch.mutex);
+    if (prefetch.ready && (sample_rate == 0 || prefetch.decoder.sample_rate == sample_rate) &&
+        prefetch.decoder.channels == channels) {
+        *decoder = prefetch.decoder;
+        prefetch.ready = false;
+        strcpy(prefetch.taken_path, prefetch.path);
+        prefetch.taken_index = prefetch.index;
+        taken = true;
     }
+    pthread_mutex_unlock(&prefetch.mutex);
     
-    // Создаем структуру для прогресса
-    ProgressData* progress_data = malloc(sizeof(ProgressData));
-    int total_seconds = audio->samples_count / (audio->sample_rate * audio->channels);
+    return taken;
+}
+
+// Использование предзагруженного декодера при обычном запуске трека
+bool take_prefetched_decoder(const char* filename, TrackDecoder* decoder) {
+    if (!prefetch.started) return false;
+    
+    bool taken = false;
+    pthread_join(prefetch.thread, NULL);
+    
+    pthread_mutex_lock(&prefetch.mutex);
+    if (prefetch.ready && strcmp(prefetch.path, filename) == 0) {
+        *decoder = prefetch.decoder;
+        prefetch.ready = false;
+        taken = true;
+    } else if (prefetch.ready) {
+        close_track_decoder(&prefetch.decoder);
+        prefetch.ready = false;
+    }
+    prefetch.started = false;
+    pthread_mutex_unlock(&prefetch.mutex);
     
-    *progress_data = (ProgressData){
-        .audio = audio,
-        .playing = true,
-        .paused = false,
-        .seek_requested = false,
-        .next_track_requested = false,
-        .current_sample = 0,
-        .total_seconds = total_seconds,
-        .pa = pa
-    };
+    return taken;
+}
+
+// Запуск предзагрузки, когда до конца трека осталось немного
+void update_prefetch() {
+    if (prefetch.started || current_playing_index < 0) return;
+    
+    ProgressData* data = current_progress_data;
+    uint64_t total_frames = atomic_load(&data->total_frames);
+    // При наплыве следующий трек нужен раньше на длину наплыва
+    uint64_t lead = (uint64_t)(PREFETCH_LEAD_SECONDS + crossfade_seconds) * data->sample_rate;
+    bool near_end = total_frames == 0 ||
+                    atomic_load(&data->current_frame) + lead >= total_frames;
+    
+    if (!near_end) return;
+    
+    int next;
+    switch (file_manager.play_mode) {
+        case MODE_SINGLE_LOOP: next = current_playing_index; break;
+        case MODE_PLAYLIST_LOOP: next = find_next_track(current_playing_index, true); break;
+        default: next = find_next_track(current_playing_index, false); break;
+    }
+    
+    if (next >= 0) {
+        start_prefetch(next);
+    }
+}
+
+// Воспроизведение аудио файла
+void play_audio_file(const char* filename) {
+    stop_current_playback();
     
-    pthread_mutex_init(&progress_data->mutex, NULL);
+    TrackDecoder decoder = {0};
+    const char* error = NULL;
+    if (!take_prefetched_decoder(filename, &decoder) &&
+        !open_track_decoder(filename, &decoder, &error)) {
+        const char* name = strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
+        set_status("%s: %s", error, name);
+        return;
+    }
+    
+    ProgressData* progress_data = create_progress_data(&decoder);
+    if (!progress_data) {
+        set_status("Error initializing audio");
+        close_track_decoder(&decoder);
+        return;
+    }
     
     current_progress_data = progress_data;
     global_playing = true;
     global_paused = false;
     strcpy(current_playing_file, filename);
     
-    // Запускаем поток воспроизведения
-    pthread_create(&playback_thread, NULL, playback_worker, progress_data);
+    // Запоминаем позицию трека в списке для выбора следующего
+    current_playing_index = -1;
+    if (file_manager.selected_index < file_manager.list.count &&
+        strcmp(file_list_path(&file_manager.list, &file_manager.list.entries[file_manager.selected_index]),
+               filename) == 0) {
+        current_playing_index = file_manager.selected_index;
+    }
+    
+    // Декодер начинает заполнять кольцо, вывод забирает из него по запросу сервера
+    pthread_create(&progress_data->decode_thread, NULL, decode_worker, progress_data);
+    
+    if (!output_start(progress_data->sample_rate, progress_data->channels, fill_output,
+                      output_finished, progress_data, &progress_data->output_format)) {
+        set_status("Error initializing audio");
+        stop_current_playback();
+    }
 }
 
-// Поток воспроизведения
-void* playback_worker(void* arg) {
-    ProgressData* data = (ProgressData*)arg;
-    AudioData* audio = data->audio;
-    size_t total_samples = audio->samples_count;
-    size_t samples_per_second = audio->sample_rate * audio->channels;
-    size_t bytes_per_sample = sizeof(int16_t);
+// Позиции трека в фреймах кольца (на частоте вывода) и обратно
+static uint64_t to_stream_frames(const ProgressData* data, const TrackDecoder* decoder, uint64_t frames) {
+    int rate = decoder->sample_rate;
+    return rate == data->sample_rate ? frames : frames * data->sample_rate / rate;
+}
+
+static uint64_t to_track_frames(const ProgressData* data, const TrackDecoder* decoder, uint64_t frames) {
+    int rate = decoder->sample_rate;
+    return rate == data->sample_rate ? frames : frames * rate / data->sample_rate;
+}
+
+// Передискретизатор для трека, если его частота отличается от частоты вывода.
+// При ошибке то, что успели выделить, освобождает close_track_decoder
+static bool setup_resampler(TrackDecoder* decoder, int rate) {
+    if (decoder->sample_rate == rate) return true;
+    
+    decoder->resample_buf = pcm_pool_alloc(RESAMPLE_CHUNK_FRAMES * decoder->channels * sizeof(float));
+    decoder->resampler = resampler_create(decoder->sample_rate, rate, decoder->channels, resample_quality);
+    return decoder->resampler && decoder->resample_buf;
+}
+
+// Следующий трек той же частоты продолжает работу фильтра прошлого без сброса,
+// чтобы переход остался бесшовным. Вход прошлого трека к этому моменту весь забран
+static void hand_over_resampler(TrackDecoder* from, TrackDecoder* to) {
+    to->resampler = from->resampler;
+    to->resample_buf = from->resample_buf;
+    to->resample_count = 0;
+    to->resample_pos = 0;
+    from->resampler = NULL;
+    from->resample_buf = NULL;
+}
+
+// Будит декодер, если он ждет вывода. Без блокировок, можно из потока вывода;
+// системный вызов только когда декодер действительно спит
+void wake_decoder(ProgressData* data) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&data->decoder_waiting, false)) {
+        uint64_t one = 1;
+        ssize_t written = write(data->wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+// Будит рендер, если он ждет данных. Вызывается декодером после записи в кольцо
+// и в конце; звуковые серверы данные не ждут, для них это только атомарная операция
+void wake_reader(ProgressData* data) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&data->reader_waiting, false)) {
+        uint64_t one = 1;
+        ssize_t written = write(data->ready_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+// Состояние воспроизведения трека: кольцо, метки, громкость.
+// Декодер переходит во владение ProgressData
+ProgressData* create_progress_data(const TrackDecoder* decoder) {
+    ProgressData* data = calloc(1, sizeof(ProgressData));
+    if (!data) return NULL;
+    
+    data->decoder = *decoder;
+    data->sample_rate = output_rate > 0 ? output_rate : decoder->sample_rate;
+    data->channels = decoder->channels;
+    data->wake_fd = eventfd(0, EFD_CLOEXEC);
+    data->ready_fd = eventfd(0, EFD_CLOEXEC);
+    
+    if (data->wake_fd < 0 || data->ready_fd < 0 ||
+        !init_pcm_ring(&data->ring, data->sample_rate, data->channels) ||
+        !ring_init(&data->markers, MARKER_QUEUE_SIZE, sizeof(StreamMarker)) ||
+        !setup_resampler(&data->decoder, data->sample_rate)) {
+        // Декодер остается у вызывающего, забираем только выделенное здесь
+        resampler_destroy(data->decoder.resampler);
+        pcm_pool_free(data->decoder.resample_buf);
+        pcm_pool_free(data->ring.data);
+        ring_free(&data->markers);
+        if (data->wake_fd >= 0) close(data->wake_fd);
+        if (data->ready_fd >= 0) close(data->ready_fd);
+        free(data);
+        return NULL;
+    }
     
-    int error;
+    gain_init(&data->gain, global_volume, data->sample_rate, data->channels);
+    dither_init(&data->dither, (uint32_t)time(NULL));
+    atomic_init(&data->playing, true);
+    atomic_init(&data->paused, false);
+    atomic_init(&data->decode_done, false);
+    atomic_init(&data->track_changed, false);
+    atomic_init(&data->seek_target, -1);
+    atomic_init(&data->current_frame, 0);
+    atomic_init(&data->total_frames, to_stream_frames(data, decoder, decoder->total_frames));
+    atomic_init(&data->decoder_waiting, false);
+    atomic_init(&data->reader_waiting, false);
+    return data;
+}
+
+// Остановка потока декодирования и освобождение всего, что держит трек
+void free_progress_data(ProgressData* data) {
+    atomic_store(&data->playing, false);
+    wake_decoder(data);
+    pthread_join(data->decode_thread, NULL);
+    close(data->wake_fd);
+    close(data->ready_fd);
+    
+    close_track_decoder(&data->decoder);
+    if (data->fading) close_track_decoder(&data->incoming);
+    pcm_pool_free(data->fade_buf);
+    pcm_pool_free(data->ring.data);
+    ring_free(&data->markers);
+    free(data);
+}
+
+// Громкость трека выравнивается до передискретизации, тогда и хвост фильтра
+// уже с нужной громкостью. Кэш PCM хранит исходные отсчеты
+static void apply_replaygain(const TrackDecoder* decoder, float* buffer, long frames) {
+    if (decoder->replaygain != 1.0f) gain_scale_f32(buffer, frames * decoder->channels, decoder->replaygain);
+}
+
+// Фреймы трека на частоте вывода. 0 - декодер дочитан,
+// хвост фильтра еще в resampler
+static long read_stream(TrackDecoder* decoder, float* buffer, long frames) {
+    if (!decoder->resampler) {
+        long got = read_track_decoder(decoder, buffer, frames);
+        if (got > 0) apply_replaygain(decoder, buffer, got);
+        return got;
+    }
     
-    while (data->playing && data->current_sample < total_samples) {
-        pthread_mutex_lock(&data->mutex);
+    for (;;) {
+        if (decoder->resample_pos == decoder->resample_count) {
+            long got = read_track_decoder(decoder, decoder->resample_buf, RESAMPLE_CHUNK_FRAMES);
+            if (got <= 0) return 0;
+            apply_replaygain(decoder, decoder->resample_buf, got);
+            decoder->resample_count = got;
+            decoder->resample_pos = 0;
+        }
         
-        // Проверяем паузу
-        if (data->paused) {
-            pthread_mutex_unlock(&data->mutex);
-            usleep(100000); // 100ms при паузе
+        size_t consumed;
+        size_t produced = resampler_process(decoder->resampler,
+                                            decoder->resample_buf + decoder->resample_pos * decoder->channels,
+                                            decoder->resample_count - decoder->resample_pos,
+                                            &consumed, buffer, frames);
+        decoder->resample_pos += consumed;
+        if (produced > 0) return produced;
+    }
+}
+
+// Ровно frames фреймов для сведения: трек, хвост фильтра, дальше тишина
+static void fill_stream(TrackDecoder* decoder, float* buffer, long frames) {
+    long done = 0;
+    
+    while (done < frames) {
+        float* dst = buffer + done * decoder->channels;
+        long got = read_stream(decoder, dst, frames - done);
+        if (got <= 0 && decoder->resampler) got = resampler_drain(decoder->resampler, dst, frames - done);
+        if (got <= 0) break;
+        done += got;
+    }
+    memset(buffer + done * decoder->channels, 0, (frames - done) * decoder->channels * sizeof(float));
+}
+
+// Ожидание места в ring без опроса по таймеру: пока вывод не читает
+// (пауза, сервер не просит данных), поток декодера спит в read.
+// Будят его вывод после чтения, перемотка (если wake_on_seek) и остановка
+static void wait_for_output(ProgressData* data, RingBuffer* ring, size_t space, bool wake_on_seek) {
+    atomic_store(&data->decoder_waiting, true);
+    // Условие проверяется после флага: место, освобожденное раньше,
+    // чем вывод увидел флаг, иначе осталось бы без пробуждения
+    atomic_thread_fence(memory_order_seq_cst);
+    if (ring_writable(ring) < space && atomic_load(&data->playing) &&
+        !(wake_on_seek && atomic_load(&data->seek_target) >= 0)) {
+        uint64_t count;
+        ssize_t got = read(data->wake_fd, &count, sizeof(count));
+        (void)got;
+    }
+    atomic_store(&data->decoder_waiting, false);
+}
+
+static void push_marker(ProgressData* data, const StreamMarker* marker) {
+    while (!ring_push(&data->markers, marker) && atomic_load(&data->playing)) {
+        wait_for_output(data, &data->markers, 1, false);
+    }
+}
+
+// Хвост фильтра в кольцо в конце трека
+static void drain_resampler(ProgressData* data) {
+    Resampler* resampler = data->decoder.resampler;
+    if (!resampler) return;
+    
+    while (atomic_load(&data->playing)) {
+        void* region;
+        long space = ring_write_region(&data->ring, &region);
+        if (space == 0) {
+            wait_for_output(data, &data->ring, 1, false);
             continue;
         }
         
-        if (data->seek_requested) {
-            pa_simple_flush(data->pa, &error);
-            data->seek_requested = false;
-        }
+        size_t produced = resampler_drain(resampler, region, space);
+        if (produced == 0) break;
+        ring_commit_write(&data->ring, produced);
+        wake_reader(data);
+    }
+}
+
+// Переход на предзагруженный трек: он пишется в то же кольцо сразу за текущим.
+// При другой частоте сначала дописывается хвост фильтра прошлого трека
+static bool switch_to_next_track(ProgressData* data, TrackDecoder* next, int track_id) {
+    TrackDecoder* decoder = &data->decoder;
+    bool same_rate = next->sample_rate == decoder->sample_rate;
+    
+    if (same_rate) hand_over_resampler(decoder, next);
+    else drain_resampler(data);
+    close_track_decoder(decoder);
+    *decoder = *next;
+    data->decode_frame = 0;
+    if (!same_rate && !setup_resampler(decoder, data->sample_rate)) return false;
+    
+    StreamMarker marker = {
+        .pos = ring_write_position(&data->ring),
+        .frame = 0,
+        .total_frames = to_stream_frames(data, decoder, decoder->total_frames),
+        .track_id = track_id,
+        .flush = false
+    };
+    push_marker(data, &marker);
+    return true;
+}
+
+// Позиция текущего трека, с которой начинается наплыв
+static uint64_t crossfade_start(const ProgressData* data) {
+    uint64_t total = to_stream_frames(data, &data->decoder, data->decoder.total_frames);
+    uint64_t length = (uint64_t)crossfade_seconds * data->sample_rate;
+    return total > length ? total - length : 0;
+}
+
+// Наплыв начинается за crossfade_seconds до конца трека или позже, если
+// следующий трек еще не готов. Входящий трек с этого момента считается текущим
+static bool start_crossfade(ProgressData* data, int track_id) {
+    TrackDecoder* decoder = &data->decoder;
+    uint64_t total = to_stream_frames(data, decoder, decoder->total_frames);
+    if (crossfade_seconds <= 0 || total == 0 || data->decode_frame >= total ||
+        data->decode_frame < crossfade_start(data)) {
+        return false;
+    }
+    
+    TrackDecoder next;
+    if (!take_prefetched_track(&next, output_rate > 0 ? 0 : decoder->sample_rate, decoder->channels)) {
+        return false;
+    }
+    
+    // Порция сведения не длиннее порции декодера
+    if (!data->fade_buf) {
+        data->fade_buf = pcm_pool_alloc((size_t)(data->sample_rate / 20) * data->channels * sizeof(float));
+    }
+    if (!data->fade_buf || !setup_resampler(&next, data->sample_rate)) {
+        close_track_decoder(&next);
+        return false;
+    }
+    
+    data->incoming = next;
+    data->fading = true;
+    data->fade_pos = 0;
+    data->fade_length = total - data->decode_frame;
+    
+    StreamMarker marker = {
+        .pos = ring_write_position(&data->ring),
+        .frame = 0,
+        .total_frames = to_stream_frames(data, &next, next.total_frames),
+        .track_id = track_id,
+        .flush = false
+    };
+    push_marker(data, &marker);
+    return true;
+}
+
+// Порция наплыва прямо в кольцо: уходящий трек затихает, входящий нарастает
+// с постоянной суммарной мощностью. Кривая на коротких отрезках заменяется прямой
+static long crossfade_chunk(ProgressData* data, float* region, long frames) {
+    uint64_t left = data->fade_length - data->fade_pos;
+    if ((uint64_t)frames > left) frames = left;
+    
+    fill_stream(&data->decoder, region, frames);
+    fill_stream(&data->incoming, data->fade_buf, frames);
+    
+    for (long done = 0; done < frames; done += CROSSFADE_SEGMENT_FRAMES) {
+        long count = frames - done < CROSSFADE_SEGMENT_FRAMES ? frames - done : CROSSFADE_SEGMENT_FRAMES;
+        size_t samples = count * data->channels;
+        float out_start, in_start, out_end, in_end;
+        crossfade_gains((float)(data->fade_pos + done) / data->fade_length, &out_start, &in_start);
+        crossfade_gains((float)(data->fade_pos + done + count) / data->fade_length, &out_end, &in_end);
         
-        if (data->next_track_requested) {
-            data->next_track_requested = false;
-            pthread_mutex_unlock(&data->mutex);
-            break;
+        float* dst = region + done * data->channels;
+        mix_f32(dst, data->fade_buf + done * data->channels, dst, samples,
+                out_start, (out_end - out_start) / samples, in_start, (in_end - in_start) / samples);
+    }
+    
+    data->fade_pos += frames;
+    return frames;
+}
+
+// Конец наплыва: уходящий трек закрывается, входящий продолжает сам
+static void finish_crossfade(ProgressData* data) {
+    close_track_decoder(&data->decoder);
+    data->decoder = data->incoming;
+    data->decode_frame = data->fade_pos;
+    data->fading = false;
+    memset(&data->incoming, 0, sizeof(TrackDecoder));
+}
+
+// Поток воспроизведения
+void* decode_worker(void* arg) {
+    ProgressData* data = (ProgressData*)arg;
+    TrackDecoder* decoder = &data->decoder;
+    long chunk_frames = data->sample_rate / 20;
+    int track_id = 0;
+    
+    while (atomic_load(&data->playing)) {
+        // Перемотка: декодер переходит на новую позицию, вывод сбрасывает устаревшее.
+        // Пока метка не поставлена, seek_target не сбрасывается: вывод по нему
+        // понимает, что данные в кольце устарели
+        int64_t target = atomic_load(&data->seek_target);
+        
+        // Во время наплыва на экране уже входящий трек, перематывается он
+        if (target >= 0 && data->fading) finish_crossfade(data);
+        
+        if (target >= 0 && seek_track_decoder(decoder, to_track_frames(data, decoder, target))) {
+            if (decoder->resampler) resampler_reset(decoder->resampler);
+            decoder->resample_count = 0;
+            decoder->resample_pos = 0;
+            data->decode_frame = target;
+            
+            StreamMarker marker = {
+                .pos = ring_write_position(&data->ring),
+                .frame = target,
+                .total_frames = to_stream_frames(data, decoder, decoder->total_frames),
+                .track_id = track_id,
+                .flush = true
+            };
+            push_marker(data, &marker);
         }
         
-        size_t remaining_samples = total_samples - data->current_sample;
-        size_t chunk_samples = samples_per_second / 10;
-        if (chunk_samples > remaining_samples) {
-            chunk_samples = remaining_samples;
+        // Новая перемотка могла прийти, пока выполнялась эта
+        if (target >= 0) atomic_compare_exchange_strong(&data->seek_target, &target, -1);
+        
+        if (ring_writable(&data->ring) < (size_t)chunk_frames) {
+            wait_for_output(data, &data->ring, chunk_frames, true); // Кольцо заполнено, ждем вывод
+            continue;
         }
         
-        size_t chunk_size = chunk_samples * bytes_per_sample;
-        int16_t* chunk_data = audio->pcm_data + data->current_sample;
+        // Участок может быть короче порции только у конца буфера
+        void* region;
+        long space = ring_write_region(&data->ring, &region);
+        long count = space < chunk_frames ? space : chunk_frames;
         
-        // Применяем громкость
-        if (global_volume != 1.0f) {
-            int16_t* volume_adjusted = malloc(chunk_size);
-            for (size_t i = 0; i < chunk_samples; i++) {
-                volume_adjusted[i] = (int16_t)(chunk_data[i] * global_volume);
-            }
-            
-            if (pa_simple_write(data->pa, volume_adjusted, chunk_size, &error) < 0) {
-                data->playing = false;
+        if (!data->fading && start_crossfade(data, track_id + 1)) track_id++;
+        
+        // Порция обрывается там, где должен начаться наплыв
+        if (!data->fading && crossfade_seconds > 0) {
+            uint64_t fade_start = crossfade_start(data);
+            if (fade_start > data->decode_frame && fade_start - data->decode_frame < (uint64_t)count) {
+                count = fade_start - data->decode_frame;
             }
-            
-            free(volume_adjusted);
-        } else {
-            if (pa_simple_write(data->pa, chunk_data, chunk_size, &error) < 0) {
-                data->playing = false;
+        }
+        
+        // Декодируем прямо в кольцо
+        long frames = data->fading ? crossfade_chunk(data, region, count) : read_stream(decoder, region, count);
+        if (frames > 0) {
+            ring_commit_write(&data->ring, frames);
+            wake_reader(data);
+            if (!data->fading) data->decode_frame += frames;
+            else if (data->fade_pos == data->fade_length) finish_crossfade(data);
+            continue;
+        }
+        
+        TrackDecoder next;
+        if (take_prefetched_track(&next, output_rate > 0 ? 0 : decoder->sample_rate, decoder->channels)) {
+            if (!switch_to_next_track(data, &next, ++track_id)) {
+                atomic_store(&data->decode_done, true);
+                break;
             }
+            continue;
         }
         
-        data->current_sample += chunk_samples;
-        pthread_mutex_unlock(&data->mutex);
-        usleep(5000);
+        drain_resampler(data);
+        atomic_store(&data->decode_done, true);
+        break;
     }
     
-    // Завершение воспроизведения
-    pthread_mutex_lock(&data->mutex);
-    data->playing = false;
-    if (!data->paused && pa_simple_drain(data->pa, &error) < 0) {
-        // Игнорируем ошибки drain
+    wake_reader(data);
+    return NULL;
+}
+
+// Применение меток, до которых дошло воспроизведение.
+// Возвращает число фреймов, которые можно вывести до следующей метки
+size_t apply_stream_markers(ProgressData* data) {
+    size_t count = ring_readable(&data->markers);
+    size_t applied = 0;
+    StreamMarker* last = NULL;
+    
+    // Перемотка отменяет все, что было до нее
+    for (size_t i = 0; i < count; i++) {
+        StreamMarker* marker = ring_peek(&data->markers, i);
+        if (marker->flush) {
+            applied = i + 1;
+            last = marker;
+        }
     }
-    pthread_mutex_unlock(&data->mutex);
     
-    // Очистка ресурсов
-    pa_simple_free(data->pa);
+    // Буфер сервера сброшен еще при запросе перемотки
+    if (last && last->pos > ring_read_position(&data->ring)) {
+        ring_skip_to(&data->ring, last->pos);
+    }
     
-    void* decoder_lib = dlopen("./libwavdecoder.so", RTLD_LAZY);
-    if (decoder_lib) {
-        void (*free_audio)(AudioData*) = dlsym(decoder_lib, "free_audio_data");
-        if (free_audio) {
-            free_audio(audio);
+    // Метки, до которых дошла позиция чтения
+    size_t limit = SIZE_MAX;
+    for (size_t i = applied; i < count; i++) {
+        StreamMarker* marker = ring_peek(&data->markers, i);
+        size_t read_pos = ring_read_position(&data->ring);
+        if (marker->pos > read_pos) {
+            limit = marker->pos - read_pos;
+            break;
         }
-        dlclose(decoder_lib);
+        applied = i + 1;
+        last = marker;
     }
     
-    pthread_mutex_destroy(&data->mutex);
-    free(data);
+    if (last) {
+        // Метка могла появиться, когда порция за ней уже выведена
+        atomic_store(&data->current_frame, last->frame + (ring_read_position(&data->ring) - last->pos));
+        atomic_store(&data->total_frames, last->total_frames);
+        if (last->track_id != data->track_id) {
+            data->track_id = last->track_id;
+            atomic_store(&data->track_changed, true);
+            events_notify();
+        }
+        ring_commit_read(&data->markers, applied);
+    }
     
-    global_playing = false;
-    global_paused = false;
-    current_progress_data = NULL;
+    return limit;
+}
+
+// Громкость и перевод в формат устройства за один проход по памяти:
+// из кольца сразу в буфер сервера
+static void render_output(ProgressData* data, const float* src, void* dst, size_t samples) {
+    float volume = global_volume;
+    bool unity = gain_is_unity(&data->gain, volume);
+    
+    if (data->output_format == OUTPUT_FORMAT_FLOAT32) {
+        if (unity) memcpy(dst, src, samples * sizeof(float));
+        else gain_apply_f32(&data->gain, src, dst, samples, volume);
+        return;
+    }
     
-    return NULL;
+    // Целый формат: громкость через короткий блок, он не выходит из кэша.
+    // Блок кратен числу каналов, чтобы переход громкости шел по фреймам
+    float block[OUTPUT_BLOCK_SAMPLES];
+    size_t block_samples = OUTPUT_BLOCK_SAMPLES / data->channels * data->channels;
+    
+    for (size_t done = 0; done < samples; ) {
+        size_t count = samples - done < block_samples ? samples - done : block_samples;
+        const float* in = src + done;
+        if (!unity) {
+            gain_apply_f32(&data->gain, in, block, count, volume);
+            in = block;
+        }
+        
+        if (data->output_format == OUTPUT_FORMAT_S32) {
+            convert_f32_s32(in, (int32_t*)dst + done, count);
+        } else {
+            convert_f32_s16(&data->dither, in, (int16_t*)dst + done, count);
+        }
+        done += count;
+    }
+}
+
+// Источник данных для вывода: вызывается из потока PulseAudio и пишет PCM
+// из кольца в буфер сервера. 0 если декодер еще не успел
+long fill_output(void* userdata, void* buffer, size_t frames) {
+    ProgressData* data = (ProgressData*)userdata;
+    size_t sample_size = data->output_format == OUTPUT_FORMAT_S16 ? sizeof(int16_t) : sizeof(float);
+    size_t done = 0;
+    
+    // Перемотка запрошена, но метки еще нет: в кольце старые данные
+    if (atomic_load(&data->seek_target) >= 0) return 0;
+    
+    while (done < frames) {
+        size_t limit = apply_stream_markers(data);
+        
+        void* region;
+        size_t count = ring_read_region(&data->ring, &region);
+        if (count > limit) count = limit;
+        if (count > frames - done) count = frames - done;
+        if (count == 0) break;
+        
+        void* dst = (unsigned char*)buffer + done * data->channels * sample_size;
+        render_output(data, region, dst, count * data->channels);
+        
+        ring_commit_read(&data->ring, count);
+        atomic_fetch_add(&data->current_frame, count);
+        done += count;
+    }
+    
+    // Освободилось место в кольце или в очереди меток
+    wake_decoder(data);
+    
+    if (done == 0 && atomic_load(&data->decode_done) && ring_readable(&data->ring) == 0 &&
+        ring_readable(&data->markers) == 0) {
+        return OUTPUT_END;
+    }
+    return done;
+}
+
+// Сервер доиграл трек до конца: главный цикл переходит к следующему
+void output_finished(void* userdata) {
+    ProgressData* data = (ProgressData*)userdata;
+    atomic_store(&data->playing, false);
+    events_notify();
+}
+
+// Слышимая позиция: отданное серверу минус его задержка
+uint64_t playback_frame(ProgressData* data) {
+    uint64_t written = atomic_load(&data->current_frame);
+    uint64_t latency = output_latency_usec() * data->sample_rate / 1000000;
+    return written > latency ? written - latency : 0;
 }
 
 // Остановка текущего воспроизведения
 void stop_current_playback() {
-    if (current_progress_data && (global_playing || global_paused)) {
-        pthread_mutex_lock(&current_progress_data->mutex);
-        current_progress_data->playing = false;
-        current_progress_data->paused = false;
-        current_progress_data->next_track_requested = true;
-        pthread_mutex_unlock(&current_progress_data->mutex);
+    if (current_progress_data) {
+        ProgressData* data = current_progress_data;
+        
+        // После stop поток PulseAudio больше не читает кольцо
+        output_stop();
+        atomic_store(&data->paused, false);
         
-        pthread_join(playback_thread, NULL);
         global_playing = false;
         global_paused = false;
         current_progress_data = NULL;
+        
+        free_progress_data(data);
     }
 }
 
@@ -649,69 +1654,94 @@ void stop_current_playback() {
 void seek_forward() {
     if (!current_progress_data || !global_playing) return;
     
-    pthread_mutex_lock(&current_progress_data->mutex);
-    size_t samples_per_second = current_progress_data->audio->sample_rate * current_progress_data->audio->channels;
-    size_t seek_samples = 10 * samples_per_second;
-    
-    if (current_progress_data->current_sample + seek_samples < current_progress_data->audio->samples_count) {
-        current_progress_data->current_sample += seek_samples;
-    } else {
-        current_progress_data->current_sample = current_progress_data->audio->samples_count - 1;
-    }
+    ProgressData* data = current_progress_data;
+    int64_t pending = atomic_load(&data->seek_target);
+    uint64_t base = pending >= 0 ? (uint64_t)pending : playback_frame(data);
     
-    current_progress_data->seek_requested = true;
-    pthread_mutex_unlock(&current_progress_data->mutex);
+    seek_to_frame(base + 10 * (uint64_t)data->sample_rate);
     
-    printf("\rSeek +10s        ");
-    fflush(stdout);
+    set_status("Seek +10s");
 }
 
 // Перемотка назад на 10 секунд
 void seek_backward() {
     if (!current_progress_data || !global_playing) return;
     
-    pthread_mutex_lock(&current_progress_data->mutex);
-    size_t samples_per_second = current_progress_data->audio->sample_rate * current_progress_data->audio->channels;
-    size_t seek_samples = 10 * samples_per_second;
+    ProgressData* data = current_progress_data;
+    uint64_t seek_frames = 10 * (uint64_t)data->sample_rate;
+    int64_t pending = atomic_load(&data->seek_target);
+    uint64_t base = pending >= 0 ? (uint64_t)pending : playback_frame(data);
     
-    if (current_progress_data->current_sample > seek_samples) {
-        current_progress_data->current_sample -= seek_samples;
-    } else {
-        current_progress_data->current_sample = 0;
+    seek_to_frame(base > seek_frames ? base - seek_frames : 0);
+    
+    set_status("Seek -10s");
+}
+
+// Переход на абсолютную позицию. Сама перемотка выполняется декодером
+// через индекс кодека, поэтому не зависит от длины файла
+void seek_to_frame(uint64_t target) {
+    if (!current_progress_data || !global_playing) return;
+    
+    ProgressData* data = current_progress_data;
+    uint64_t total_frames = atomic_load(&data->total_frames);
+    
+    if (total_frames > 0 && target >= total_frames) {
+        target = total_frames - 1;
     }
     
-    current_progress_data->seek_requested = true;
-    pthread_mutex_unlock(&current_progress_data->mutex);
+    atomic_store(&data->seek_target, (int64_t)target);
+    wake_decoder(data);
+    
+    // Уже отданное серверу выбрасываем сразу, не дожидаясь декодера
+    output_flush();
+}
+
+// Переход на процент длины трека
+void seek_to_percent(int percent) {
+    if (!current_progress_data || !global_playing) return;
+    
+    uint64_t total_frames = atomic_load(&current_progress_data->total_frames);
+    if (total_frames == 0) return; // Длина неизвестна
+    
+    seek_to_frame(total_frames * percent / 100);
+    
+    set_status("Seek to %d%%", percent);
+}
+
+// Разбор времени вида "ss", "m:ss" или "h:mm:ss". -1 при ошибке
+int parse_time_string(const char* text) {
+    int seconds = 0;
+    int value = -1;
+    
+    for (const char* p = text; ; p++) {
+        if (isdigit((unsigned char)*p)) {
+            value = (value < 0 ? 0 : value * 10) + (*p - '0');
+        } else if (*p == ':' || *p == '\0') {
+            if (value < 0) return -1;
+            seconds = seconds * 60 + value;
+            value = -1;
+            if (*p == '\0') break;
+        } else {
+            return -1;
+        }
+    }
     
-    printf("\rSeek -10s        ");
-    fflush(stdout);
+    return seconds;
 }
 
 // Следующий трек
 void play_next_track() {
     if (!global_playing && !global_paused) return;
     
-    int start_index = file_manager.selected_index;
-    int current_index = start_index;
+    int next = find_next_track(file_manager.selected_index,
+                               file_manager.play_mode == MODE_PLAYLIST_LOOP);
+    if (next < 0) {
+        stop_current_playback();
+        return;
+    }
     
-    do {
-        current_index++;
-        if (current_index >= file_manager.file_count) {
-            if (file_manager.play_mode == MODE_PLAYLIST_LOOP) {
-                current_index = 0;
-            } else {
-                stop_current_playback();
-                return;
-            }
-        }
-        
-        FileEntry* entry = &file_manager.files[current_index];
-        if (entry->is_audio_file && !entry->is_directory) {
-            file_manager.selected_index = current_index;
-            play_audio_file(entry->full_path);
-            return;
-        }
-    } while (current_index != start_index);
+    file_manager.selected_index = next;
+    play_audio_file(file_list_path(&file_manager.list, &file_manager.list.entries[next]));
 }
 
 // Предыдущий трек
@@ -725,16 +1755,16 @@ void play_previous_track() {
         current_index--;
         if (current_index < 0) {
             if (file_manager.play_mode == MODE_PLAYLIST_LOOP) {
-                current_index = file_manager.file_count - 1;
+                current_index = file_manager.list.count - 1;
             } else {
                 return;
             }
         }
         
-        FileEntry* entry = &file_manager.files[current_index];
-        if (entry->is_audio_file && !entry->is_directory) {
+        FileEntry* entry = &file_manager.list.entries[current_index];
+        if (file_is_audio(entry) && !file_is_directory(entry)) {
             file_manager.selected_index = current_index;
-            play_audio_file(entry->full_path);
+            play_audio_file(file_list_path(&file_manager.list, entry));
             return;
         }
     } while (current_index != start_index);
@@ -744,17 +1774,11 @@ void play_previous_track() {
 void toggle_pause() {
     if (!current_progress_data || !global_playing) return;
     
-    pthread_mutex_lock(&current_progress_data->mutex);
-    current_progress_data->paused = !current_progress_data->paused;
-    global_paused = current_progress_data->paused;
-    pthread_mutex_unlock(&current_progress_data->mutex);
+    global_paused = !atomic_load(&current_progress_data->paused);
+    atomic_store(&current_progress_data->paused, global_paused);
+    output_pause(global_paused);
     
-    if (global_paused) {
-        printf("\rPaused        ");
-    } else {
-        printf("\rPlaying        ");
-    }
-    fflush(stdout);
+    set_status(global_paused ? "Paused" : "Playing");
 }
 
 // Регулировка громкости
@@ -763,164 +1787,47 @@ void adjust_volume(float change) {
     if (global_volume > 1.0f) global_volume = 1.0f;
     if (global_volume < 0.0f) global_volume = 0.0f;
     
-    printf("\rVolume: %d%%        ", (int)(global_volume * 100));
-    fflush(stdout);
+    set_status("Volume: %d%%", (int)(global_volume * 100));
 }
 
-// Поток ввода
-/*void* input_thread(void* arg) {
-    (void)arg;
+// Обработка ввода: главный цикл вызывает, когда в stdin есть данные,
+// и все доступное вычитывается сразу. Состояние живет между вызовами
+void handle_input(void) {
+    static char last_key = 0;
+    static time_t last_key_time = 0;
+    static bool goto_mode = false;
+    static char goto_buffer[16] = "";
     
     while (1) {
         int c = getchar();
         
         if (c == EOF) {
-            usleep(10000);
-            continue;
+            // stdin неблокирующий: EOF без feof значит, что данные кончились
+            if (feof(stdin)) events_ignore_input();
+            clearerr(stdin);
+            return;
         }
         
-        switch (c) {
-            case 'q': // Выход
-                stop_current_playback();
-                set_nonblocking_mode(false);
-                clear_screen();
-                exit(0);
-                break;
-                
-            case 'j': // Вниз
-                if (file_manager.selected_index < file_manager.file_count - 1) {
-                    file_manager.selected_index++;
-                }
-                break;
-                
-            case 'k': // Вверх
-                if (file_manager.selected_index > 0) {
-                    file_manager.selected_index--;
-                }
-                break;
-                
-            case '\n': // Enter - воспроизведение/открытие папки
-                if (file_manager.selected_index < file_manager.file_count) {
-                    FileEntry* selected = &file_manager.files[file_manager.selected_index];
-                    
-                    if (selected->is_directory) {
-                        if (selected->is_parent_dir) {
-                            // Переход на уровень выше
-                            char* last_slash = strrchr(file_manager.current_path, '/');
-                            if (last_slash) {
-                                if (last_slash == file_manager.current_path) {
-                                    // Мы в корневой директории
-                                    strcpy(file_manager.current_path, "/");
-                                } else {
-                                    *last_slash = '\0';
-                                }
-                            }
-                            load_directory(file_manager.current_path);
-                        } else {
-                            // Переход в папку
-                            char new_path[MAX_PATH];
-                            snprintf(new_path, sizeof(new_path), "%s/%s", 
-                                   file_manager.current_path, selected->name);
-                            load_directory(new_path);
-                        }
-                    } else if (selected->is_audio_file) {
-                        play_audio_file(selected->full_path);
-                    }
-                }
-                break;
-                
-            case ' ': // Пробел - пауза/продолжение
-                toggle_pause();
-                break;
-                
-            case 'n': // Следующий трек
-                play_next_track();
-                break;
-                
-            case 'p': // Предыдущий трек
-                play_previous_track();
-                break;
-                
-            case 'r': // Смена режима воспроизведения
-                file_manager.play_mode = (file_manager.play_mode + 1) % 3;
-                printf("\rMode: %s        ", get_play_mode_name(file_manager.play_mode));
-                fflush(stdout);
-                break;
-                
-            case '+': // Увеличить громкость
-            case '=': // На той же клавише что и +
-                adjust_volume(0.1f);
-                break;
-                
-            case '-': // Уменьшить громкость
-                adjust_volume(-0.1f);
-                break;
-                
-            case 'm': // Mute/Unmute
-                {
-                    static float previous_volume = 1.0f;
-                    if (global_volume > 0.0f) {
-                        previous_volume = global_volume;
-                        global_volume = 0.0f;
-                        printf("\rMuted        ");
-                    } else {
-                        global_volume = previous_volume;
-                        printf("\rVolume: %d%%        ", (int)(global_volume * 100));
-                    }
-                    fflush(stdout);
-                }
-                break;
-                
-            case 'h': // Помощь
-                file_manager.show_help = !file_manager.show_help;
-                break;
-                
-            case 27: // Escape sequence (стрелки)
-                {
-                    int c2 = getchar();
-                    if (c2 == EOF) break;
-                    
-                    if (c2 == '[') {
-                        int c3 = getchar();
-                        if (c3 == EOF) break;
-                        
-                        switch (c3) {
-                            case 'A': // Стрелка вверх
-                                if (file_manager.selected_index > 0) {
-                                    file_manager.selected_index--;
-                                }
-                                break;
-                            case 'B': // Стрелка вниз
-                                if (file_manager.selected_index < file_manager.file_count - 1) {
-                                    file_manager.selected_index++;
-                                }
-                                break;
-                            case 'C': // Стрелка вправо (перемотка вперед)
-                                seek_forward();
-                                break;
-                            case 'D': // Стрелка влево (перемотка назад)
-                                seek_backward();
-                                break;
-                        }
-                    }
+        // Ввод времени для перехода после 'g'
+        if (goto_mode) {
+            size_t len = strlen(goto_buffer);
+            
+            if (c == '\n') {
+                int seconds = parse_time_string(goto_buffer);
+                if (seconds >= 0 && current_progress_data) {
+                    seek_to_frame((uint64_t)seconds * current_progress_data->sample_rate);
                 }
-                break;
-        }
-    }
-    
-    return NULL;
-}*/
-// Поток обработки ввода
-void* input_thread(void* arg) {
-    (void)arg;
-    char last_key = 0;
-    time_t last_key_time = 0;
-    
-    while (1) {
-        int c = getchar();
-        
-        if (c == EOF) {
-            usleep(10000);
+                goto_mode = false;
+            } else if (c == 27) {
+                goto_mode = false;
+            } else if ((c == 127 || c == '\b') && len > 0) {
+                goto_buffer[len - 1] = '\0';
+            } else if ((isdigit(c) || c == ':') && len < sizeof(goto_buffer) - 1) {
+                goto_buffer[len] = c;
+                goto_buffer[len + 1] = '\0';
+            }
+            
+            set_status("Go to: %s", goto_mode ? goto_buffer : "");
             continue;
         }
         
@@ -937,18 +1844,18 @@ void* input_thread(void* arg) {
                 last_key_time = now;
                 
                 int start_index = file_manager.selected_index + 1;
-                if (start_index >= file_manager.file_count) {
+                if (start_index >= file_manager.list.count) {
                     start_index = 0;
                 }
                 
                 int found = -1;
-                for (int i = 0; i < file_manager.file_count; i++) {
-                    int idx = (start_index + i) % file_manager.file_count;
-                    FileEntry* entry = &file_manager.files[idx];
+                for (int i = 0; i < file_manager.list.count; i++) {
+                    int idx = (start_index + i) % file_manager.list.count;
+                    FileEntry* entry = &file_manager.list.entries[idx];
                     
-                    if (entry->is_parent_dir) continue;
+                    if (file_is_parent(entry)) continue;
                     
-                    char first_char = entry->name[0];
+                    char first_char = file_list_name(&file_manager.list, entry)[0];
                     char search_char = tolower(c);
                     
                     if (tolower(first_char) == search_char) {
@@ -959,8 +1866,7 @@ void* input_thread(void* arg) {
                 
                 if (found != -1) {
                     file_manager.selected_index = found;
-                    printf("\rJump to: %c       ", c);
-                    fflush(stdout);
+                    set_status("Jump to: %c", c);
                 }
                 continue;
             }
@@ -970,14 +1876,21 @@ void* input_thread(void* arg) {
             case 'q': // Выход
             case 'Q':
                 stop_current_playback();
+                stop_format_scan();
+                reset_prefetch();
+                output_shutdown();
+                replaygain_shutdown();
+                registry_unload();
+                pcm_pool_destroy();
+                events_shutdown();
+                screen_shutdown();
                 set_nonblocking_mode(false);
-                clear_screen();
                 exit(0);
                 break;
                 
             case 'j': // Вниз по списку
             case 'J':
-                if (file_manager.selected_index < file_manager.file_count - 1) {
+                if (file_manager.selected_index < file_manager.list.count - 1) {
                     file_manager.selected_index++;
                     last_key = 0;
                 }
@@ -1000,11 +1913,11 @@ void* input_thread(void* arg) {
                     toggle_pause();
                 } else {
                     // Музыка не играет - открыть папку или воспроизвести файл
-                    if (file_manager.selected_index < file_manager.file_count) {
-                        FileEntry* selected = &file_manager.files[file_manager.selected_index];
+                    if (file_manager.selected_index < file_manager.list.count) {
+                        FileEntry* selected = &file_manager.list.entries[file_manager.selected_index];
                         
-                        if (selected->is_directory) {
-                            if (selected->is_parent_dir) {
+                        if (file_is_directory(selected)) {
+                            if (file_is_parent(selected)) {
                                 // Переход на уровень выше
                                 char* last_slash = strrchr(file_manager.current_path, '/');
                                 if (last_slash) {
@@ -1019,12 +1932,12 @@ void* input_thread(void* arg) {
                                 // Переход в папку
                                 char new_path[MAX_PATH];
                                 snprintf(new_path, sizeof(new_path), "%s/%s", 
-                                       file_manager.current_path, selected->name);
+                                       file_manager.current_path, file_list_name(&file_manager.list, selected));
                                 load_directory(new_path);
                             }
                             last_key = 0;
-                        } else if (selected->is_audio_file) {
-                            play_audio_file(selected->full_path);
+                        } else if (file_is_audio(selected)) {
+                            play_audio_file(file_list_path(&file_manager.list, selected));
                         }
                     }
                 }
@@ -1053,9 +1966,26 @@ void* input_thread(void* arg) {
                 stop_current_playback();
                 break;
                 
+            case 'g': // Переход на время (m:ss)
+            case 'G':
+                if (global_playing || global_paused) {
+                    goto_mode = true;
+                    goto_buffer[0] = '\0';
+                    set_status("Go to: ");
+                }
+                break;
+                
+            case '0': case '1': case '2': case '3': case '4': // Переход на 0-90% трека
+            case '5': case '6': case '7': case '8': case '9':
+                if (global_playing || global_paused) {
+                    seek_to_percent((c - '0') * 10);
+                }
+                break;
+                
             case 'r': // Смена режима воспроизведения
             case 'R':
                 file_manager.play_mode = (file_manager.play_mode + 1) % 3;
+                reset_prefetch(); // Следующий трек теперь выбирается иначе
                 break;
                 
             case '+': // Увеличить громкость
@@ -1103,7 +2033,7 @@ void* input_thread(void* arg) {
                                 }
                                 break;
                             case 'B': // Стрелка вниз - навигация
-                                if (file_manager.selected_index < file_manager.file_count - 1) {
+                                if (file_manager.selected_index < file_manager.list.count - 1) {
                                     file_manager.selected_index++;
                                     last_key = 0;
                                 }
@@ -1124,8 +2054,6 @@ void* input_thread(void* arg) {
                 break;
         }
     }
-    
-    return NULL;
 }
 
 // Вспомогательные функции
@@ -1145,28 +2073,17 @@ const char* get_format_name(AudioFormat format) {
         case FORMAT_OGG: return "OGG";
         case FORMAT_MP3: return "MP3";
         case FORMAT_FLAC: return "FLAC";
+        case FORMAT_PENDING: return "...";
         default: return "UNK";
     }
 }
 
-void clear_screen() {
-    printf("\033[2J");
-}
-
-void move_cursor(int row, int col) {
-    printf("\033[%d;%dH", row + 1, col + 1);
-}
-
-int get_console_width() {
-    struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    return w.ws_col;
-}
-
-int get_console_height() {
-    struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    return w.ws_row;
+// Сообщение в строке состояния, остается до следующего
+void set_status(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(status_message, sizeof(status_message), format, args);
+    va_end(args);
 }
 
 void set_nonblocking_mode(bool enable) {
@@ -1190,14 +2107,297 @@ void set_nonblocking_mode(bool enable) {
     }
 }
 
+// Ожидание данных в рендере без опроса по таймеру: поток спит в read,
+// пока декодер не допишет порцию в кольцо или не закончит трек
+static void wait_for_decoder(ProgressData* data) {
+    atomic_store(&data->reader_waiting, true);
+    // Как в wait_for_output: порция, записанная до того, как декодер увидел флаг,
+    // иначе осталась бы без пробуждения
+    atomic_thread_fence(memory_order_seq_cst);
+    if (ring_readable(&data->ring) == 0 && !atomic_load(&data->decode_done)) {
+        uint64_t count;
+        ssize_t got = read(data->ready_fd, &count, sizeof(count));
+        (void)got;
+    }
+    atomic_store(&data->reader_waiting, false);
+}
+
+static double elapsed_seconds(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Рендер одного файла тем же путем, что и воспроизведение: поток декодера
+// пишет в кольцо, fill_output применяет громкость и переводит в формат вывода.
+// Вместо звуковой карты данные забирает этот поток, без ожидания реального времени
+static bool render_file(const RenderJob* job, OutputFormat format, int decode_threads,
+                        double* audio_seconds, bool* fallback) {
+    TrackDecoder decoder = {0};
+    const char* error = NULL;
+    if (!open_track_decoder(job->input, &decoder, &error)) {
+        fprintf(stderr, "%s: %s\n", job->input, error);
+        return false;
+    }
+    
+    ProgressData* data = create_progress_data(&decoder);
+    if (!data) {
+        close_track_decoder(&decoder);
+        return false;
+    }
+    data->output_format = format;
+    
+    size_t frame_bytes = decoder.channels * (format == OUTPUT_FORMAT_S16 ? sizeof(int16_t) : sizeof(float));
+    void* buffer = pcm_pool_alloc(RENDER_PERIOD_FRAMES * frame_bytes);
+    WavWriter* wav = wav_writer_open(job->output, data->sample_rate, data->channels, format);
+    if (!buffer || !wav) {
+        pcm_pool_free(buffer);
+        wav_writer_close(wav);
+        free_progress_data(data);
+        return false;
+    }
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // Трек нужен весь подряд: длинный файл декодируется сразу на свободных ядрах
+    int mode = DECODE_ALL_SERIAL;
+    load_whole_track(&data->decoder, job->input, decode_threads, RENDER_WHOLE_TRACK_BYTES, &mode);
+    // Стыки отрезков разошлись, и файл декодирован дважды: это видно в итогах
+    *fallback = mode == DECODE_ALL_FALLBACK;
+    pthread_create(&data->decode_thread, NULL, decode_worker, data);
+    
+    uint64_t frames = 0;
+    bool ok = true;
+    while (ok) {
+        long got = fill_output(data, buffer, RENDER_PERIOD_FRAMES);
+        if (got == OUTPUT_END) break;
+        if (got == 0) {
+            wait_for_decoder(data); // Декодер не успевает, это и есть предел скорости
+            continue;
+        }
+        ok = wav_writer_write(wav, buffer, got);
+        frames += got;
+    }
+    
+    int sample_rate = data->sample_rate; // Частота вывода, data освобождается ниже
+    free_progress_data(data);
+    ok = wav_writer_close(wav) && ok;
+    pcm_pool_free(buffer);
+    
+    double seconds = elapsed_seconds(&start);
+    *audio_seconds = (double)frames / sample_rate;
+    printf("%s: %.1f s in %.2f s, %.1fx realtime%s\n", job->input, *audio_seconds, seconds,
+           seconds > 0 ? *audio_seconds / seconds : 0.0, ok ? "" : " (write failed)");
+    return ok;
+}
+
+// Следующий файл: сначала из своей очереди, потом украденный из чужой
+static bool render_take_job(RenderContext* context, int self, int* job) {
+    RenderQueue* own = &context->queues[self];
+    bool found = false;
+    
+    pthread_mutex_lock(&own->mutex);
+    if (own->head < own->tail) {
+        *job = own->head++;
+        found = true;
+    }
+    pthread_mutex_unlock(&own->mutex);
+    
+    for (int i = 1; i < context->worker_count && !found; i++) {
+        RenderQueue* victim = &context->queues[(self + i) % context->worker_count];
+        pthread_mutex_lock(&victim->mutex);
+        if (victim->head < victim->tail) {
+            *job = --victim->tail;
+            found = true;
+        }
+        pthread_mutex_unlock(&victim->mutex);
+    }
+    return found;
+}
+
+static void* render_worker(void* arg) {
+    RenderWorker* worker = (RenderWorker*)arg;
+    RenderContext* context = worker->context;
+    int job;
+    
+    while (render_take_job(context, worker->index, &job)) {
+        double seconds = 0;
+        bool fallback = false;
+        bool ok = render_file(&context->jobs[job], context->format, context->decode_threads, &seconds, &fallback);
+        if (fallback) worker->fallbacks++;
+        if (ok) {
+            worker->rendered++;
+            worker->audio_seconds += seconds;
+        } else {
+            fprintf(stderr, "Render failed: %s\n", context->jobs[job].input);
+            worker->failed++;
+        }
+    }
+    return NULL;
+}
+
+// Список заданий для каталога: аудио файлы, найденные load_directory,
+// в output с тем же именем и расширением .wav
+static int collect_render_jobs(const char* input, const char* output, RenderJob** jobs) {
+    if (!load_directory(input)) {
+        fprintf(stderr, "Error loading directory: %s\n", input);
+        return -1;
+    }
+    
+    // Вывод в тот же каталог перезаписал бы исходные WAV
+    char input_real[MAX_PATH];
+    char output_real[MAX_PATH];
+    if (mkdir(output, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s: %s\n", output, strerror(errno));
+        return -1;
+    }
+    if (!realpath(input, input_real) || !realpath(output, output_real) ||
+        strcmp(input_real, output_real) == 0) {
+        fprintf(stderr, "Output directory must differ from the input directory\n");
+        return -1;
+    }
+    
+    *jobs = malloc(file_manager.list.count * sizeof(RenderJob));
+    if (!*jobs) return -1;
+    
+    int count = 0;
+    for (int i = 0; i < file_manager.list.count; i++) {
+        FileEntry* entry = &file_manager.list.entries[i];
+        if (!file_is_audio(entry)) continue;
+        
+        RenderJob* job = &(*jobs)[count++];
+        snprintf(job->input, sizeof(job->input), "%s", file_list_path(&file_manager.list, entry));
+        
+        const char* name = file_list_name(&file_manager.list, entry);
+        int stem = (int)strlen(name);
+        const char* ext = strrchr(name, '.');
+        if (ext) stem = (int)(ext - name);
+        snprintf(job->output, sizeof(job->output), "%s/%.*s.wav", output, stem, name);
+    }
+    return count;
+}
+
+// Рендер файла или каталога в WAV так быстро, как позволяет процессор.
+// Возвращает код завершения программы
+int run_render(const char* input, const char* output, int jobs, OutputFormat format) {
+    // Громкость интерфейса к рендеру не относится
+    global_volume = 1.0f;
+    
+    struct stat st;
+    if (stat(input, &st) != 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", input, strerror(errno));
+        return 1;
+    }
+    
+    RenderContext context = { .format = format };
+    int job_count;
+    if (S_ISDIR(st.st_mode)) {
+        job_count = collect_render_jobs(input, output, &context.jobs);
+        if (job_count < 0) return 1;
+    } else {
+        context.jobs = malloc(sizeof(RenderJob));
+        if (!context.jobs) return 1;
+        snprintf(context.jobs[0].input, sizeof(context.jobs[0].input), "%s", input);
+        snprintf(context.jobs[0].output, sizeof(context.jobs[0].output), "%s", output);
+        job_count = 1;
+    }
+    
+    // Рендер не начинается, пока громкость всех файлов не известна
+    if (replaygain_mode != REPLAYGAIN_OFF) {
+        const char** paths = malloc((job_count > 0 ? job_count : 1) * sizeof(char*));
+        if (paths) {
+            for (int i = 0; i < job_count; i++) paths[i] = context.jobs[i].input;
+            replaygain_scan(paths, job_count);
+            free(paths);
+        }
+        replaygain_wait();
+        if (replaygain_fallbacks() > 0) {
+            fprintf(stderr, "Loudness scan: %d file(s) decoded serially after a segment mismatch\n",
+                    replaygain_fallbacks());
+        }
+    }
+    
+    if (jobs < 1) jobs = 1;
+    if (jobs > RENDER_MAX_JOBS) jobs = RENDER_MAX_JOBS;
+    if (jobs > job_count) jobs = job_count > 0 ? job_count : 1;
+    context.worker_count = jobs;
+    
+    // Файлов меньше, чем ядер: оставшиеся ядра делят длинный файл на отрезки
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    context.decode_threads = cpus > jobs ? (int)(cpus / jobs) : 1;
+    
+    // Файлы делятся поровну подряд идущими отрезками, дальше балансирует кража
+    for (int i = 0; i < jobs; i++) {
+        pthread_mutex_init(&context.queues[i].mutex, NULL);
+        context.queues[i].head = (int)((long)job_count * i / jobs);
+        context.queues[i].tail = (int)((long)job_count * (i + 1) / jobs);
+    }
+    
+    RenderWorker workers[RENDER_MAX_JOBS] = {0};
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for (int i = 0; i < jobs; i++) {
+        workers[i].context = &context;
+        workers[i].index = i;
+        pthread_create(&workers[i].thread, NULL, render_worker, &workers[i]);
+    }
+    
+    double audio_seconds = 0;
+    int rendered = 0;
+    int failed = 0;
+    int fallbacks = 0;
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&context.queues[i].mutex);
+        audio_seconds += workers[i].audio_seconds;
+        rendered += workers[i].rendered;
+        failed += workers[i].failed;
+        fallbacks += workers[i].fallbacks;
+    }
+    
+    double seconds = elapsed_seconds(&start);
+    printf("Rendered %d file(s) on %d thread(s): %.1f s of audio in %.2f s, %.1fx realtime",
+           rendered, jobs, audio_seconds, seconds, seconds > 0 ? audio_seconds / seconds : 0.0);
+    if (failed > 0) printf(", %d failed", failed);
+    if (fallbacks > 0) printf(", %d decoded serially after a segment mismatch", fallbacks);
+    printf("\n");
+    
+    free(context.jobs);
+    return failed > 0 ? 1 : 0;
+}
+
 void print_help(const char* program_name) {
     printf("Audio Player with File Manager\n");
-    printf("Usage: %s\n", program_name);
+    printf("Usage: %s [--mlock] [--no-cache] [--tlength MS] [--minreq MS] [--prebuf MS]\n"
+           "       [--output pulse|alsa|null|file] [--device NAME] [--unthrottled]\n"
+           "       [--rate HZ] [--resample-quality low|medium|high|best] [--crossfade SEC]\n"
+           "       [--replaygain off|track|album]\n"
+           "       [--render IN OUT [--jobs N] [--render-format f32|s32|s16]]\n", program_name);
+    printf("\nOptions:\n");
+    printf("  --mlock    - Lock PCM buffers in RAM\n");
+    printf("  --no-cache - Do not read or write the decoded PCM cache\n");
+    printf("  --tlength  - Server buffer length in ms (default %d)\n", OUTPUT_DEFAULT_TLENGTH_MS);
+    printf("  --minreq   - Minimum request size in ms (default %d)\n", OUTPUT_DEFAULT_MINREQ_MS);
+    printf("  --prebuf   - Prebuffer before playback starts in ms (default: server)\n");
+    printf("  --output   - Audio output: pulse (default), alsa, null or file\n");
+    printf("  --device   - Sink or ALSA device; WAV path for file (default output.wav)\n");
+    printf("  --unthrottled - null/file: process as fast as possible, not in real time\n");
+    printf("  --rate     - Output sample rate for the whole session, 0 = rate of each track (default %d,\n"
+           "               --render keeps the rate of each file)\n", OUTPUT_DEFAULT_RATE);
+    printf("  --resample-quality - Filter length: low 16, medium 32, high 64 (default), best 128 taps\n");
+    printf("  --crossfade - Equal-power crossfade between tracks in seconds (default 0, gapless)\n");
+    printf("  --replaygain - Loudness normalization from tags or background EBU R128 analysis (default off)\n");
+    printf("  --render IN OUT - Render a file or a directory of files to WAV and exit (bypasses the PCM cache)\n");
+    printf("  --jobs N   - Files rendered in parallel (default: number of CPUs)\n");
+    printf("  --render-format f32|s32|s16 - Sample format of rendered WAV (default f32)\n");
     printf("\nControls:\n");
     printf("  j/k    - Navigate up/down\n");
     printf("  Enter  - Play selected/Open directory\n");
     printf("  Space  - Pause/Resume\n");
     printf("  ←/→    - Seek backward/forward 10 seconds\n");
+    printf("  0-9    - Seek to 0%%-90%% of the track\n");
+    printf("  g      - Go to time (m:ss), Enter to confirm\n");
     printf("  n/p    - Next/Previous track\n");
     printf("  +/-    - Increase/decrease volume\n");
     printf("  m      - Mute/Unmute\n");
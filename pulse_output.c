@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pulse/pulseaudio.h>
+#include <pulse/rtclock.h>
+#include "output.h"
+
+// Вывод через pa_threaded_mainloop и pa_stream. Сервер сам запрашивает
+// данные, источник пишет прямо в буфер от pa_stream_begin_write. Поток
+// PulseAudio живет между треками и пересоздается, только если меняется
+// частота или число каналов
+
+#define OUTPUT_RETRY_USEC 5000          // Повторный запрос, если у источника не было данных
+
+static pa_threaded_mainloop* mainloop = NULL;
+static pa_context* context = NULL;
+static pa_stream* stream = NULL;
+static pa_sample_spec spec;
+static OutputConfig output_config;
+static pa_time_event* retry_event = NULL;
+
+// Источник данных, меняется только под блокировкой mainloop
+static output_fill_fn fill_fn = NULL;
+static output_done_fn done_fn = NULL;
+static void* fill_data = NULL;
+static bool draining = false;
+
+static _Atomic uint64_t latency_usec = 0;
+static atomic_uint underruns = 0;
+
+static void release_operation(pa_operation* operation) {
+    if (operation) pa_operation_unref(operation);
+}
+
+static void context_state_cb(pa_context* c, void* userdata) {
+    (void)c;
+    (void)userdata;
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void stream_state_cb(pa_stream* s, void* userdata) {
+    (void)userdata;
+    pa_stream_state_t state = pa_stream_get_state(s);
+
+    // Поток оборвался посреди трека: сообщаем, как о завершении
+    if (state == PA_STREAM_FAILED && done_fn) done_fn(fill_data);
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void underflow_cb(pa_stream* s, void* userdata) {
+    (void)s;
+    (void)userdata;
+    atomic_fetch_add(&underruns, 1);
+}
+
+static void latency_cb(pa_stream* s, void* userdata) {
+    (void)userdata;
+    pa_usec_t usec;
+    int negative = 0;
+    if (pa_stream_get_latency(s, &usec, &negative) == 0) {
+        atomic_store(&latency_usec, negative ? 0 : usec);
+    }
+}
+
+static void drain_cb(pa_stream* s, int success, void* userdata) {
+    (void)s;
+    (void)success;
+    (void)userdata;
+    if (draining && done_fn) done_fn(fill_data);
+}
+
+static void schedule_retry(void) {
+    pa_context_rttime_restart(context, retry_event, pa_rtclock_now() + OUTPUT_RETRY_USEC);
+}
+
+// Заполнение nbytes буфера сервера. Выполняется в потоке mainloop.
+// Источник пишет прямо в память от pa_stream_begin_write, и pa_stream_write
+// для нее ничего не копирует
+static void write_output(pa_stream* s, size_t nbytes) {
+    if (!fill_fn || draining) return;
+
+    size_t frame_size = pa_frame_size(&spec);
+
+    while (nbytes >= frame_size) {
+        void* buffer;
+        size_t size = nbytes;
+        if (pa_stream_begin_write(s, &buffer, &size) < 0 || size < frame_size) {
+            pa_stream_cancel_write(s);
+            return;
+        }
+
+        size_t count = size / frame_size;
+        long got = fill_fn(fill_data, buffer, count);
+
+        if (got == OUTPUT_END) {
+            pa_stream_cancel_write(s);
+
+            // Доигрываем то, что уже у сервера; prebuf мог не набраться
+            draining = true;
+            release_operation(pa_stream_trigger(s, NULL, NULL));
+            release_operation(pa_stream_drain(s, drain_cb, NULL));
+            return;
+        }
+        if (got <= 0) {
+            pa_stream_cancel_write(s);
+            schedule_retry();
+            return;
+        }
+
+        pa_stream_write(s, buffer, got * frame_size, NULL, 0, PA_SEEK_RELATIVE);
+        nbytes -= got * frame_size;
+
+        // Источник отдал меньше, чем просили: остаток запросим позже
+        if ((size_t)got < count) {
+            schedule_retry();
+            return;
+        }
+    }
+}
+
+static void stream_write_cb(pa_stream* s, size_t nbytes, void* userdata) {
+    (void)userdata;
+    write_output(s, nbytes);
+}
+
+static void retry_cb(pa_mainloop_api* api, pa_time_event* event, const struct timeval* tv, void* userdata) {
+    (void)api;
+    (void)event;
+    (void)tv;
+    (void)userdata;
+    if (!stream || pa_stream_get_state(stream) != PA_STREAM_READY) return;
+
+    size_t writable = pa_stream_writable_size(stream);
+    if (writable > 0 && writable != (size_t)-1) write_output(stream, writable);
+}
+
+static uint32_t buffer_bytes(int ms, const pa_sample_spec* ss) {
+    return ms < 0 ? (uint32_t)-1 : (uint32_t)pa_usec_to_bytes((pa_usec_t)ms * PA_USEC_PER_MSEC, ss);
+}
+
+static void destroy_stream(void) {
+    if (!stream) return;
+
+    pa_stream_set_state_callback(stream, NULL, NULL);
+    pa_stream_set_write_callback(stream, NULL, NULL);
+    pa_stream_disconnect(stream);
+    pa_stream_unref(stream);
+    stream = NULL;
+}
+
+// Создание потока и ожидание готовности. Вызывается под блокировкой
+static bool create_stream(const pa_sample_spec* ss) {
+    stream = pa_stream_new(context, "Audio", ss, NULL);
+    if (!stream) return false;
+
+    pa_stream_set_state_callback(stream, stream_state_cb, NULL);
+    pa_stream_set_write_callback(stream, stream_write_cb, NULL);
+    pa_stream_set_underflow_callback(stream, underflow_cb, NULL);
+    pa_stream_set_latency_update_callback(stream, latency_cb, NULL);
+
+    pa_buffer_attr attr = {
+        .maxlength = (uint32_t)-1,
+        .tlength = buffer_bytes(output_config.tlength_ms, ss),
+        .prebuf = buffer_bytes(output_config.prebuf_ms, ss),
+        .minreq = buffer_bytes(output_config.minreq_ms, ss),
+        .fragsize = (uint32_t)-1
+    };
+
+    // ADJUST_LATENCY: tlength задает полную задержку, а не только буфер клиента
+    pa_stream_flags_t flags = PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE |
+                              PA_STREAM_ADJUST_LATENCY;
+    if (pa_stream_connect_playback(stream, output_config.device, &attr, flags, NULL, NULL) < 0) {
+        destroy_stream();
+        return false;
+    }
+
+    pa_stream_state_t state;
+    while ((state = pa_stream_get_state(stream)) != PA_STREAM_READY) {
+        if (!PA_STREAM_IS_GOOD(state)) {
+            destroy_stream();
+            return false;
+        }
+        pa_threaded_mainloop_wait(mainloop);
+    }
+
+    spec = *ss;
+    return true;
+}
+
+static void pulse_shutdown(void);
+
+static bool pulse_init(const OutputConfig* config) {
+    output_config = *config;
+
+    mainloop = pa_threaded_mainloop_new();
+    if (!mainloop) return false;
+
+    context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), "Player");
+    if (!context) {
+        pa_threaded_mainloop_free(mainloop);
+        mainloop = NULL;
+        return false;
+    }
+    pa_context_set_state_callback(context, context_state_cb, NULL);
+
+    pa_threaded_mainloop_lock(mainloop);
+    bool ok = pa_context_connect(context, NULL, PA_CONTEXT_NOFLAGS, NULL) >= 0 &&
+              pa_threaded_mainloop_start(mainloop) >= 0;
+
+    while (ok) {
+        pa_context_state_t state = pa_context_get_state(context);
+        if (state == PA_CONTEXT_READY) break;
+        if (!PA_CONTEXT_IS_GOOD(state)) ok = false;
+        else pa_threaded_mainloop_wait(mainloop);
+    }
+
+    // Таймер повтора создается выключенным и взводится, когда источнику нечего отдать
+    if (ok) retry_event = pa_context_rttime_new(context, PA_USEC_INVALID, retry_cb, NULL);
+    pa_threaded_mainloop_unlock(mainloop);
+
+    if (!ok) {
+        fprintf(stderr, "PulseAudio connection failed: %s\n", pa_strerror(pa_context_errno(context)));
+        pulse_shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+static void pulse_shutdown(void) {
+    if (!mainloop) return;
+
+    pa_threaded_mainloop_stop(mainloop);
+    destroy_stream();
+    if (retry_event) pa_threaded_mainloop_get_api(mainloop)->time_free(retry_event);
+    retry_event = NULL;
+    if (context) {
+        pa_context_disconnect(context);
+        pa_context_unref(context);
+        context = NULL;
+    }
+    pa_threaded_mainloop_free(mainloop);
+    mainloop = NULL;
+}
+
+static OutputFormat format_from_pulse(pa_sample_format_t format) {
+    switch (format) {
+        case PA_SAMPLE_FLOAT32LE: return OUTPUT_FORMAT_FLOAT32;
+        case PA_SAMPLE_S32LE: return OUTPUT_FORMAT_S32;
+        default: return OUTPUT_FORMAT_S16;
+    }
+}
+
+static bool pulse_start(int sample_rate, int channels, output_fill_fn fill,
+                        output_done_fn done, void* userdata, OutputFormat* format) {
+    if (!mainloop) return false;
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    // Пока поток пересоздается, старый источник не должен вызываться
+    fill_fn = NULL;
+    done_fn = NULL;
+
+    bool reuse = stream && pa_stream_get_state(stream) == PA_STREAM_READY &&
+                 spec.rate == (uint32_t)sample_rate && spec.channels == channels;
+
+    if (!reuse) {
+        destroy_stream();
+
+        // Сначала форматы без потери разрядности, 16 бит в последнюю очередь
+        const pa_sample_format_t formats[] = { PA_SAMPLE_FLOAT32LE, PA_SAMPLE_S32LE, PA_SAMPLE_S16LE };
+        for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+            pa_sample_spec ss = {
+                .format = formats[i],
+                .rate = (uint32_t)sample_rate,
+                .channels = (uint8_t)channels
+            };
+            if (pa_sample_spec_valid(&ss) && create_stream(&ss)) break;
+        }
+    }
+
+    bool ok = stream != NULL;
+    if (ok) {
+        fill_fn = fill;
+        done_fn = done;
+        fill_data = userdata;
+        draining = false;
+        *format = format_from_pulse(spec.format);
+
+        // Поток остался от прошлого трека: старые данные уже не нужны
+        if (reuse) release_operation(pa_stream_flush(stream, NULL, NULL));
+        release_operation(pa_stream_cork(stream, 0, NULL, NULL));
+
+        size_t writable = pa_stream_writable_size(stream);
+        if (writable > 0 && writable != (size_t)-1) write_output(stream, writable);
+    }
+
+    pa_threaded_mainloop_unlock(mainloop);
+    return ok;
+}
+
+static void pulse_stop(void) {
+    if (!mainloop) return;
+
+    pa_threaded_mainloop_lock(mainloop);
+    fill_fn = NULL;
+    done_fn = NULL;
+    fill_data = NULL;
+    draining = false;
+    pa_context_rttime_restart(context, retry_event, PA_USEC_INVALID);
+
+    if (stream) {
+        release_operation(pa_stream_cork(stream, 1, NULL, NULL));
+        release_operation(pa_stream_flush(stream, NULL, NULL));
+    }
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+static void pulse_pause(bool paused) {
+    if (!mainloop) return;
+
+    pa_threaded_mainloop_lock(mainloop);
+    if (stream) release_operation(pa_stream_cork(stream, paused, NULL, NULL));
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+static void pulse_flush(void) {
+    if (!mainloop) return;
+
+    pa_threaded_mainloop_lock(mainloop);
+    if (stream) release_operation(pa_stream_flush(stream, NULL, NULL));
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+static uint64_t pulse_latency_usec(void) {
+    return atomic_load(&latency_usec);
+}
+
+static unsigned pulse_underruns(void) {
+    return atomic_load(&underruns);
+}
+
+const OutputBackend pulse_output = {
+    .name = "pulse",
+    .init = pulse_init,
+    .shutdown = pulse_shutdown,
+    .start = pulse_start,
+    .stop = pulse_stop,
+    .pause = pulse_pause,
+    .flush = pulse_flush,
+    .latency_usec = pulse_latency_usec,
+    .underruns = pulse_underruns
+};
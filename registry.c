@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include "registry.h"
+
+static DecoderPlugin plugins[MAX_PLUGINS];
+static int plugin_count = 0;
+
+static int is_plugin_name(const char* name) {
+    size_t len = strlen(name);
+    return len > 13 && strncmp(name, "lib", 3) == 0 && strcmp(name + len - 10, "decoder.so") == 0;
+}
+
+static int load_plugin(const char* path, const char* name) {
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "Error loading decoder: %s\n", dlerror());
+        return 0;
+    }
+
+    DecoderPlugin plugin = {
+        .handle = handle,
+        .probe = (decoder_probe_fn)dlsym(handle, "decoder_probe"),
+        .open = (decoder_open_fn)dlsym(handle, "decoder_open"),
+        .read = (decoder_read_fn)dlsym(handle, "decoder_read"),
+        .seek = (decoder_seek_fn)dlsym(handle, "decoder_seek"),
+        .close = (decoder_close_fn)dlsym(handle, "decoder_close"),
+        .shutdown = (decoder_shutdown_fn)dlsym(handle, "decoder_shutdown"),
+        .replaygain = (decoder_replaygain_fn)dlsym(handle, "decoder_replaygain"),
+        .decode_all = (decoder_decode_all_fn)dlsym(handle, "decoder_decode_all")
+    };
+    snprintf(plugin.name, sizeof(plugin.name), "%s", name);
+
+    if (!plugin.probe || !plugin.open || !plugin.read || !plugin.seek || !plugin.close) {
+        fprintf(stderr, "Error loading decoder functions: %s\n", name);
+        dlclose(handle);
+        return 0;
+    }
+
+    decoder_flags_fn flags = (decoder_flags_fn)dlsym(handle, "decoder_flags");
+    if (flags) plugin.flags = flags();
+
+    decoder_init_fn init = (decoder_init_fn)dlsym(handle, "decoder_init");
+    if (init && init() != 0) {
+        fprintf(stderr, "Decoder init failed: %s\n", name);
+        dlclose(handle);
+        return 0;
+    }
+
+    plugins[plugin_count++] = plugin;
+    return 1;
+}
+
+int registry_load(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) return 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL && plugin_count < MAX_PLUGINS) {
+        if (!is_plugin_name(entry->d_name)) continue;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        load_plugin(path, entry->d_name);
+    }
+
+    closedir(d);
+    return plugin_count;
+}
+
+const DecoderPlugin* registry_find(const char* filename) {
+    unsigned char header[DECODER_PROBE_SIZE];
+    size_t size = 0;
+
+    FILE* file = fopen(filename, "rb");
+    if (file) {
+        size = fread(header, 1, sizeof(header), file);
+        fclose(file);
+    }
+    if (size == 0) return NULL;
+
+    const DecoderPlugin* best = NULL;
+    int best_score = 0;
+    for (int i = 0; i < plugin_count; i++) {
+        int score = plugins[i].probe(header, size, filename);
+        if (score > best_score) {
+            best_score = score;
+            best = &plugins[i];
+        }
+    }
+
+    return best;
+}
+
+void registry_unload(void) {
+    for (int i = 0; i < plugin_count; i++) {
+        if (plugins[i].shutdown) plugins[i].shutdown();
+        dlclose(plugins[i].handle);
+    }
+    plugin_count = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "decoders/decoder_api.h"
+
+#define MAX_PLUGINS 16
+
+// Загруженный плагин декодера: библиотека открывается один раз при старте,
+// таблица функций кэшируется на все время работы
+typedef struct {
+    char name[64];
+    void* handle;
+    decoder_probe_fn probe;
+    decoder_open_fn open;
+    decoder_read_fn read;
+    decoder_seek_fn seek;
+    decoder_close_fn close;
+    decoder_shutdown_fn shutdown;
+    decoder_replaygain_fn replaygain;   // NULL, если плагин не читает теги
+    decoder_decode_all_fn decode_all;   // NULL, если плагин декодирует только потоком
+    int flags;                          // DECODER_FLAG_*
+} DecoderPlugin;
+
+// Загружает все lib*decoder.so из каталога. Возвращает число плагинов
+int registry_load(const char* dir);
+
+// Плагин с наибольшей оценкой decoder_probe для файла. NULL если никто не подходит
+const DecoderPlugin* registry_find(const char* filename);
+
+void registry_unload(void);
+
+#endif
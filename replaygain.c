@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "replaygain.h"
+#include "loudness.h"
+#include "pcm_cache.h"
+#include "registry.h"
+
+#define GAIN_MAGIC "ORGN"
+#define GAIN_VERSION 1
+#define SCAN_CHUNK_FRAMES 4096
+#define SCAN_MAX_THREADS 4
+#define SCAN_WHOLE_TRACK_BYTES (256UL << 20)    // Предел файла, который анализ декодирует в память целиком
+#define SCAN_NICE 10                // Анализ не должен отнимать процессор у воспроизведения
+
+// Запись кэша: заголовок и гистограмма блоков за ним
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_dev;
+    uint64_t source_ino;
+    uint64_t source_size;
+    int64_t source_mtime;
+    float integrated;
+    float true_peak;
+} GainCacheHeader;
+
+typedef struct {
+    char* path;
+    bool done;
+    ReplayGainInfo gain;            // Альбомные поля заполняются, когда готов весь каталог
+    LoudnessResult* loudness;       // NULL, если громкость взята из тегов
+} GainEntry;
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;         // Новая работа или конец очередного анализа
+    pthread_t threads[SCAN_MAX_THREADS];
+    int thread_count;
+    atomic_bool stopping;           // Прерывает и анализ, который уже идет
+
+    GainEntry* entries;             // Все файлы, которые когда-либо ставились в очередь
+    size_t entry_count;
+    size_t entry_capacity;
+
+    size_t* album;                  // Индексы файлов текущего каталога
+    size_t album_count;
+    size_t next;                    // Следующий необработанный из album
+    int active;                     // Сколько файлов анализируется прямо сейчас
+    atomic_int fallbacks;           // Файлы, у которых параллельное декодирование не сошлось
+
+    char cache_dir[768];
+} scanner = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .changed = PTHREAD_COND_INITIALIZER
+};
+
+bool replaygain_mode_from_name(const char* name, ReplayGainMode* mode) {
+    static const char* names[] = { "off", "track", "album" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(names[i], name) == 0) {
+            *mode = (ReplayGainMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Кэш
+
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Ключ не зависит от пути: переименованный или перемещенный файл не пересчитывается
+static void cache_path(const struct stat* st, char* path, size_t size) {
+    uint64_t hash = fnv1a(&st->st_dev, sizeof(st->st_dev), 0xcbf29ce484222325ULL);
+    hash = fnv1a(&st->st_ino, sizeof(st->st_ino), hash);
+    hash = fnv1a(&st->st_size, sizeof(st->st_size), hash);
+    hash = fnv1a(&st->st_mtime, sizeof(st->st_mtime), hash);
+    snprintf(path, size, "%s/%016llx.gain", scanner.cache_dir, (unsigned long long)hash);
+}
+
+static bool cache_load(const struct stat* st, LoudnessResult* result) {
+    if (!scanner.cache_dir[0]) return false;
+
+    char path[1024];
+    cache_path(st, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+
+    GainCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, GAIN_MAGIC, 4) == 0 && header.version == GAIN_VERSION &&
+              header.source_dev == (uint64_t)st->st_dev && header.source_ino == (uint64_t)st->st_ino &&
+              header.source_size == (uint64_t)st->st_size && header.source_mtime == st->st_mtime &&
+              fread(result->histogram, sizeof(result->histogram), 1, file) == 1;
+    fclose(file);
+
+    result->integrated = header.integrated;
+    result->true_peak = header.true_peak;
+    return ok;
+}
+
+// Запись через временный файл: параллельный анализ того же файла не увидит половину
+static void cache_store(const struct stat* st, const LoudnessResult* result) {
+    if (!scanner.cache_dir[0]) return;
+
+    char path[1024], temp[1040];
+    cache_path(st, path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, (long)syscall(SYS_gettid));
+
+    FILE* file = fopen(temp, "wb");
+    if (!file) return;
+
+    GainCacheHeader header = {
+        .version = GAIN_VERSION,
+        .source_dev = st->st_dev,
+        .source_ino = st->st_ino,
+        .source_size = st->st_size,
+        .source_mtime = st->st_mtime,
+        .integrated = result->integrated,
+        .true_peak = result->true_peak
+    };
+    memcpy(header.magic, GAIN_MAGIC, 4);
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(result->histogram, sizeof(result->histogram), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || rename(temp, path) != 0) unlink(temp);
+}
+
+// Анализ одного файла
+
+static void track_gain_from(const LoudnessResult* loudness, ReplayGainInfo* gain) {
+    gain->track_gain = loudness->integrated > LOUDNESS_SILENCE_LUFS ?
+                       LOUDNESS_REFERENCE_LUFS - loudness->integrated : 0.0f;
+    gain->track_peak = loudness->true_peak;
+    gain->album_gain = NAN;
+    gain->album_peak = NAN;
+}
+
+// Громкость файла. Теги используются, только если в них есть и трек, и альбом:
+// иначе для альбома все равно нужна гистограмма. threads - сколько потоков
+// можно отдать плагину на параллельное декодирование этого файла
+// Опрашивается decoder_decode_all: остановка не ждет декодирования всего файла
+static int scan_cancelled(void* context) {
+    (void)context;
+    return atomic_load(&scanner.stopping);
+}
+
+static bool analyse_file(const char* path, int threads, ReplayGainInfo* gain, LoudnessResult** loudness) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+
+    LoudnessResult* result = malloc(sizeof(LoudnessResult));
+    if (!result) return false;
+
+    if (cache_load(&st, result)) {
+        track_gain_from(result, gain);
+        *loudness = result;
+        return true;
+    }
+
+    const DecoderPlugin* plugin = registry_find(path);
+    StreamInfo info;
+    DecoderStream* stream = plugin ? plugin->open(path, &info) : NULL;
+    if (!stream) {
+        free(result);
+        return false;
+    }
+
+    ReplayGainInfo tags;
+    if (plugin->replaygain && plugin->replaygain(stream, &tags) == 0 && !isnan(tags.album_gain)) {
+        plugin->close(stream);
+        free(result);
+        *gain = tags;
+        *loudness = NULL;
+        return true;
+    }
+
+    LoudnessAnalyzer* analyzer = loudness_create(info.sample_rate, info.channels);
+    size_t frame_bytes = (size_t)info.channels * sizeof(float);
+    long got = -1;
+
+    // Плагин умеет декодировать весь файл на нескольких ядрах: отрезки идут параллельно
+    float* whole = NULL;
+    if (analyzer && plugin->decode_all && threads > 1 && info.total_frames > 0 &&
+        !atomic_load(&scanner.stopping) &&
+        info.total_frames <= SCAN_WHOLE_TRACK_BYTES / frame_bytes) {
+        whole = malloc(info.total_frames * frame_bytes);
+    }
+
+    if (whole) {
+        plugin->close(stream);
+        DecodeAllOptions options = { .threads = threads, .cancelled = scan_cancelled };
+        long frames = plugin->decode_all(path, whole, info.total_frames, &options);
+        if (options.mode == DECODE_ALL_FALLBACK) atomic_fetch_add(&scanner.fallbacks, 1);
+        if (frames > 0 && !atomic_load(&scanner.stopping)) {
+            loudness_add(analyzer, whole, frames);
+            got = 0;
+        }
+        free(whole);
+    } else {
+        float* buffer = malloc(SCAN_CHUNK_FRAMES * frame_bytes);
+        if (analyzer && buffer) {
+            while (!atomic_load(&scanner.stopping) && (got = plugin->read(stream, buffer, SCAN_CHUNK_FRAMES)) > 0) {
+                loudness_add(analyzer, buffer, got);
+            }
+        }
+        plugin->close(stream);
+        free(buffer);
+    }
+
+    // Ошибка чтения или остановка: неполное измерение не запоминаем
+    if (got != 0) {
+        loudness_destroy(analyzer);
+        free(result);
+        return false;
+    }
+
+    loudness_finish(analyzer, result);
+    loudness_destroy(analyzer);
+    cache_store(&st, result);
+
+    track_gain_from(result, gain);
+    *loudness = result;
+    return true;
+}
+
+// Все файлы каталога готовы: громкость альбома по сумме гистограмм.
+// Вызывается под mutex
+static void finish_album(void) {
+    static uint32_t histogram[LOUDNESS_HISTOGRAM_BINS];
+    float peak = 0.0f;
+    bool any = false;
+
+    memset(histogram, 0, sizeof(histogram));
+    for (size_t i = 0; i < scanner.album_count; i++) {
+        GainEntry* entry = &scanner.entries[scanner.album[i]];
+        if (!entry->loudness) continue;
+
+        for (int bin = 0; bin < LOUDNESS_HISTOGRAM_BINS; bin++) histogram[bin] += entry->loudness->histogram[bin];
+        if (entry->loudness->true_peak > peak) peak = entry->loudness->true_peak;
+        any = true;
+    }
+    if (!any) return;
+
+    float integrated = loudness_from_histogram(histogram);
+    float album_gain = integrated > LOUDNESS_SILENCE_LUFS ? LOUDNESS_REFERENCE_LUFS - integrated : 0.0f;
+    for (size_t i = 0; i < scanner.album_count; i++) {
+        GainEntry* entry = &scanner.entries[scanner.album[i]];
+        if (!entry->loudness) continue;
+        entry->gain.album_gain = album_gain;
+        entry->gain.album_peak = peak;
+    }
+}
+
+static void* scan_worker(void* arg) {
+    (void)arg;
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), SCAN_NICE);
+
+    pthread_mutex_lock(&scanner.mutex);
+    while (!atomic_load(&scanner.stopping)) {
+        if (scanner.next >= scanner.album_count) {
+            pthread_cond_wait(&scanner.changed, &scanner.mutex);
+            continue;
+        }
+
+        size_t index = scanner.album[scanner.next++];
+        if (scanner.entries[index].done) continue;
+
+        // Путь копируется: массив записей может переехать, пока идет анализ
+        char* path = strdup(scanner.entries[index].path);
+        scanner.active++;
+        // Очередь каталога пуста: потоки сканера, которым нечего делать, отдаем этому файлу
+        int threads = scanner.next >= scanner.album_count ? scanner.thread_count - scanner.active + 1 : 1;
+        pthread_mutex_unlock(&scanner.mutex);
+
+        ReplayGainInfo gain;
+        LoudnessResult* loudness = NULL;
+        bool ok = path && analyse_file(path, threads, &gain, &loudness);
+        free(path);
+
+        pthread_mutex_lock(&scanner.mutex);
+        scanner.active--;
+        GainEntry* entry = &scanner.entries[index];
+        if (ok && !entry->done) {
+            entry->gain = gain;
+            entry->loudness = loudness;
+        } else {
+            free(loudness);
+        }
+        // Неудачный файл тоже считается обработанным, чтобы не повторять попытки
+        entry->done = true;
+
+        // Последний файл каталога: анализ мог начаться еще для прошлого каталога,
+        // но альбом всегда текущий
+        if (scanner.next >= scanner.album_count && scanner.active == 0) finish_album();
+        pthread_cond_broadcast(&scanner.changed);
+    }
+    pthread_mutex_unlock(&scanner.mutex);
+    return NULL;
+}
+
+static void start_threads(void) {
+    if (!pcm_cache_directory(scanner.cache_dir, sizeof(scanner.cache_dir))) scanner.cache_dir[0] = '\0';
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = cpus > 1 ? (int)(cpus / 2) : 1;
+    if (count > SCAN_MAX_THREADS) count = SCAN_MAX_THREADS;
+
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&scanner.threads[scanner.thread_count], NULL, scan_worker, NULL) == 0) {
+            scanner.thread_count++;
+        }
+    }
+}
+
+static GainEntry* find_entry(const char* path) {
+    for (size_t i = 0; i < scanner.entry_count; i++) {
+        if (strcmp(scanner.entries[i].path, path) == 0) return &scanner.entries[i];
+    }
+    return NULL;
+}
+
+// Индекс записи для файла, новая запись при первом появлении. Под mutex
+static bool add_entry(const char* path, size_t* index) {
+    GainEntry* found = find_entry(path);
+    if (found) {
+        *index = found - scanner.entries;
+        return true;
+    }
+
+    if (scanner.entry_count == scanner.entry_capacity) {
+        size_t capacity = scanner.entry_capacity ? scanner.entry_capacity * 2 : 256;
+        GainEntry* grown = realloc(scanner.entries, capacity * sizeof(GainEntry));
+        if (!grown) return false;
+        scanner.entries = grown;
+        scanner.entry_capacity = capacity;
+    }
+
+    char* copy = strdup(path);
+    if (!copy) return false;
+
+    scanner.entries[scanner.entry_count] = (GainEntry){ .path = copy };
+    *index = scanner.entry_count++;
+    return true;
+}
+
+void replaygain_scan(const char* const* paths, int count) {
+    pthread_mutex_lock(&scanner.mutex);
+    if (scanner.thread_count == 0 && !atomic_load(&scanner.stopping)) start_threads();
+
+    size_t* album = malloc((count > 0 ? count : 1) * sizeof(size_t));
+    if (!album) {
+        pthread_mutex_unlock(&scanner.mutex);
+        return;
+    }
+
+    size_t album_count = 0;
+    bool pending = false;
+    for (int i = 0; i < count; i++) {
+        if (!add_entry(paths[i], &album[album_count])) continue;
+        if (!scanner.entries[album[album_count]].done) pending = true;
+        album_count++;
+    }
+
+    free(scanner.album);
+    scanner.album = album;
+    scanner.album_count = album_count;
+    scanner.next = 0;
+
+    // Каталог уже весь известен: альбом считается сразу
+    if (!pending) finish_album();
+    pthread_cond_broadcast(&scanner.changed);
+    pthread_mutex_unlock(&scanner.mutex);
+}
+
+void replaygain_wait(void) {
+    pthread_mutex_lock(&scanner.mutex);
+    while (scanner.thread_count > 0 && (scanner.next < scanner.album_count || scanner.active > 0)) {
+        pthread_cond_wait(&scanner.changed, &scanner.mutex);
+    }
+    pthread_mutex_unlock(&scanner.mutex);
+}
+
+void replaygain_shutdown(void) {
+    pthread_mutex_lock(&scanner.mutex);
+    atomic_store(&scanner.stopping, true);
+    pthread_cond_broadcast(&scanner.changed);
+    pthread_mutex_unlock(&scanner.mutex);
+
+    for (int i = 0; i < scanner.thread_count; i++) pthread_join(scanner.threads[i], NULL);
+    scanner.thread_count = 0;
+
+    for (size_t i = 0; i < scanner.entry_count; i++) {
+        free(scanner.entries[i].path);
+        free(scanner.entries[i].loudness);
+    }
+    free(scanner.entries);
+    free(scanner.album);
+    scanner.entries = NULL;
+    scanner.album = NULL;
+    scanner.entry_count = scanner.entry_capacity = scanner.album_count = 0;
+}
+
+int replaygain_fallbacks(void) {
+    return atomic_load(&scanner.fallbacks);
+}
+
+float replaygain_factor(const char* path, ReplayGainMode mode) {
+    if (mode == REPLAYGAIN_OFF) return 1.0f;
+
+    pthread_mutex_lock(&scanner.mutex);
+    GainEntry* entry = find_entry(path);
+    ReplayGainInfo gain = entry && entry->done ? entry->gain : (ReplayGainInfo){ NAN, NAN, NAN, NAN };
+    pthread_mutex_unlock(&scanner.mutex);
+
+    float db = gain.track_gain;
+    float peak = gain.track_peak;
+    if (mode == REPLAYGAIN_ALBUM && !isnan(gain.album_gain)) {
+        db = gain.album_gain;
+        peak = gain.album_peak;
+    }
+    if (isnan(db)) return 1.0f;
+
+    float factor = powf(10.0f, db / 20.0f);
+    if (!isnan(peak) && peak > 0.0f && factor * peak > 1.0f) factor = 1.0f / peak;
+    return factor;
+}
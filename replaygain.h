@@ -0,0 +1,39 @@
+#ifndef REPLAYGAIN_H
+#define REPLAYGAIN_H
+
+#include <stdbool.h>
+
+// Фоновое измерение громкости треков для ReplayGain.
+// Пул потоков проходит файлы каталога: громкость берется из тегов, из кэша
+// (~/.cache/oplayer/*.gain, ключ - устройство, inode, размер и mtime файла)
+// или измеряется декодированием. Альбом - все треки одного каталога,
+// его громкость считается по сумме гистограмм треков.
+// При воспроизведении остается только умножение на готовый множитель
+
+typedef enum {
+    REPLAYGAIN_OFF,
+    REPLAYGAIN_TRACK,
+    REPLAYGAIN_ALBUM
+} ReplayGainMode;
+
+bool replaygain_mode_from_name(const char* name, ReplayGainMode* mode);
+
+// Поставить файлы каталога в очередь. Необработанные файлы прошлого
+// каталога из очереди убираются. Потоки запускаются при первом вызове
+void replaygain_scan(const char* const* paths, int count);
+
+// Дождаться, пока очередь опустеет (рендер ждет перед стартом)
+void replaygain_wait(void);
+
+// Остановка и освобождение пула и результатов
+void replaygain_shutdown(void);
+
+// Сколько файлов анализ декодировал дважды: стыки параллельных отрезков
+// разошлись с последовательным декодированием
+int replaygain_fallbacks(void);
+
+// Множитель громкости для файла: 1.0, если громкость еще не известна.
+// Не дает пику трека (или альбома) выйти за полную шкалу
+float replaygain_factor(const char* path, ReplayGainMode mode);
+
+#endif
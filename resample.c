@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "resample.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLE_X86 1
+#endif
+
+#define RESAMPLE_MAX_PHASES 1024    // Больше фаз - интерполяция между соседними
+#define RESAMPLE_MAX_TAPS 256
+#define RESAMPLE_BLOCK 1024         // Входных фреймов в истории за одно заполнение
+
+typedef struct {
+    const char* name;
+    int taps;
+    double beta;        // Параметр окна Кайзера, задает подавление
+    double passband;    // Доля полосы до частоты Найквиста, которая проходит без потерь
+} QualityParams;
+
+static const QualityParams quality_params[] = {
+    [RESAMPLE_QUALITY_LOW] = { "low", 16, 6.0, 0.85 },
+    [RESAMPLE_QUALITY_MEDIUM] = { "medium", 32, 8.0, 0.90 },
+    [RESAMPLE_QUALITY_HIGH] = { "high", 64, 10.0, 0.94 },
+    [RESAMPLE_QUALITY_BEST] = { "best", 128, 12.0, 0.96 }
+};
+
+struct Resampler {
+    int channels;
+    int taps;                   // Кратно 8
+    uint32_t up;                // Выходная частота / НОД
+    uint32_t down;              // Входная частота / НОД
+    uint32_t phases;            // Строк в таблице без последней
+    bool exact;                 // phases == up: фаза совпадает с остатком
+    float* coeffs;              // (phases + 1) строк по taps коэффициентов
+    float* interpolated;        // Коэффициенты текущей фазы при интерполяции
+
+    // История входа по каналам раздельно: свертка идет по непрерывной памяти
+    float* history;
+    size_t capacity;            // Фреймов на канал
+    size_t filled;
+    size_t index;               // Первый отвод для текущего выходного фрейма
+    uint32_t frac;              // Дробная часть позиции входа, в долях 1/up
+
+    uint64_t input_total;
+    uint64_t output_total;
+};
+
+typedef float (*dot_fn)(const float* a, const float* b, size_t count);
+
+static float dot_scalar(const float* a, const float* b, size_t count) {
+    float sum[4] = { 0, 0, 0, 0 };
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        for (int k = 0; k < 4; k++) sum[k] += a[i + k] * b[i + k];
+    }
+    for (; i < count; i++) sum[0] += a[i] * b[i];
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#ifdef RESAMPLE_X86
+
+__attribute__((target("sse2")))
+static float dot_sse2(const float* a, const float* b, size_t count) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+
+    // Число отводов кратно 8
+    for (size_t i = 0; i < count; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float* a, const float* b, size_t count) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+    if (i < count) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+    }
+
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+#endif
+
+static dot_fn dot = dot_scalar;
+
+__attribute__((constructor))
+static void resample_select_kernels(void) {
+#ifdef RESAMPLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        dot = dot_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        dot = dot_sse2;
+    }
+#endif
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Модифицированная функция Бесселя нулевого порядка для окна Кайзера
+static double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+// Строка phase таблицы: фильтр для выходного фрейма, который отстоит
+// от входного index на phase / phases входного фрейма
+static void build_phase(float* row, int taps, double offset, double cutoff, double beta) {
+    double half = taps / 2.0;
+    double norm = bessel_i0(beta);
+    double sum = 0.0;
+
+    for (int k = 0; k < taps; k++) {
+        // Отвод k - это вход index - taps/2 + 1 + k
+        double x = k - (taps / 2 - 1) - offset;
+        double sinc = x == 0.0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+        double r = x / half;
+        double window = r * r < 1.0 ? bessel_i0(beta * sqrt(1.0 - r * r)) / norm : 0.0;
+        row[k] = (float)(sinc * window);
+        sum += row[k];
+    }
+
+    // Единичное усиление на постоянном сигнале в каждой фазе
+    for (int k = 0; k < taps; k++) row[k] = (float)(row[k] / sum);
+}
+
+Resampler* resampler_create(int in_rate, int out_rate, int channels, ResampleQuality quality) {
+    if (in_rate <= 0 || out_rate <= 0 || channels <= 0) return NULL;
+    if ((unsigned)quality > RESAMPLE_QUALITY_BEST) quality = RESAMPLE_DEFAULT_QUALITY;
+
+    Resampler* r = calloc(1, sizeof(Resampler));
+    if (!r) return NULL;
+
+    const QualityParams* params = &quality_params[quality];
+    uint32_t divisor = gcd(in_rate, out_rate);
+    r->channels = channels;
+    r->up = out_rate / divisor;
+    r->down = in_rate / divisor;
+    r->exact = r->up <= RESAMPLE_MAX_PHASES;
+    r->phases = r->exact ? r->up : RESAMPLE_MAX_PHASES;
+
+    // При понижении частоты полоса сужается, и фильтр удлиняется в той же
+    // пропорции, чтобы переходная полоса осталась такой же крутой
+    double ratio = (double)out_rate / in_rate;
+    double cutoff = params->passband * (ratio < 1.0 ? ratio : 1.0);
+    int taps = params->taps;
+    if (ratio < 1.0) taps = (int)ceil(taps / ratio);
+    if (taps > RESAMPLE_MAX_TAPS) taps = RESAMPLE_MAX_TAPS;
+    r->taps = (taps + 7) & ~7;
+
+    r->coeffs = malloc((size_t)(r->phases + 1) * r->taps * sizeof(float));
+    r->interpolated = malloc(r->taps * sizeof(float));
+    r->capacity = RESAMPLE_BLOCK + r->taps;
+    r->history = malloc(r->capacity * channels * sizeof(float));
+    if (!r->coeffs || !r->interpolated || !r->history) {
+        resampler_destroy(r);
+        return NULL;
+    }
+
+    for (uint32_t p = 0; p <= r->phases; p++) {
+        build_phase(r->coeffs + (size_t)p * r->taps, r->taps, (double)p / r->phases, cutoff, params->beta);
+    }
+
+    resampler_reset(r);
+    return r;
+}
+
+void resampler_destroy(Resampler* resampler) {
+    if (!resampler) return;
+
+    free(resampler->coeffs);
+    free(resampler->interpolated);
+    free(resampler->history);
+    free(resampler);
+}
+
+void resampler_reset(Resampler* resampler) {
+    // Нули перед первым входным фреймом: первый выход приходится точно на него
+    resampler->filled = resampler->taps / 2 - 1;
+    memset(resampler->history, 0, resampler->capacity * resampler->channels * sizeof(float));
+    resampler->index = 0;
+    resampler->frac = 0;
+    resampler->input_total = 0;
+    resampler->output_total = 0;
+}
+
+int resampler_latency(const Resampler* resampler) {
+    return resampler->taps / 2;
+}
+
+uint64_t resampler_output_frames(const Resampler* resampler, uint64_t in_frames) {
+    return (in_frames * resampler->up + resampler->down - 1) / resampler->down;
+}
+
+bool resample_quality_from_name(const char* name, ResampleQuality* quality) {
+    for (size_t i = 0; i < sizeof(quality_params) / sizeof(quality_params[0]); i++) {
+        if (strcmp(quality_params[i].name, name) == 0) {
+            *quality = (ResampleQuality)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Коэффициенты для текущей дробной позиции
+static const float* phase_coeffs(Resampler* r) {
+    if (r->exact) return r->coeffs + (size_t)r->frac * r->taps;
+
+    double position = (double)r->frac * r->phases / r->up;
+    uint32_t row = (uint32_t)position;
+    float mu = (float)(position - row);
+    const float* a = r->coeffs + (size_t)row * r->taps;
+    const float* b = a + r->taps;
+    for (int k = 0; k < r->taps; k++) r->interpolated[k] = a[k] + (b[k] - a[k]) * mu;
+    return r->interpolated;
+}
+
+// Выходные фреймы, для которых в истории уже есть все отводы
+static size_t produce(Resampler* r, float* out, size_t out_frames, uint64_t limit) {
+    size_t produced = 0;
+
+    while (produced < out_frames && r->index + r->taps <= r->filled && r->output_total < limit) {
+        const float* h = phase_coeffs(r);
+        for (int c = 0; c < r->channels; c++) {
+            out[produced * r->channels + c] = dot(h, r->history + c * r->capacity + r->index, r->taps);
+        }
+        produced++;
+        r->output_total++;
+
+        r->frac += r->down;
+        r->index += r->frac / r->up;
+        r->frac %= r->up;
+    }
+    return produced;
+}
+
+// Сдвиг непрочитанной истории в начало и дозапись до count фреймов входа.
+// in == NULL - дописываются нули (хвост в конце потока)
+static size_t refill(Resampler* r, const float* in, size_t count) {
+    size_t keep = r->index < r->filled ? r->filled - r->index : 0;
+    size_t start = r->index < r->filled ? r->index : r->filled;
+
+    for (int c = 0; c < r->channels; c++) {
+        float* channel = r->history + c * r->capacity;
+        memmove(channel, channel + start, keep * sizeof(float));
+    }
+    r->index -= start;
+    r->filled = keep;
+
+    size_t space = r->capacity - r->filled;
+    if (count > space) count = space;
+
+    for (int c = 0; c < r->channels; c++) {
+        float* dst = r->history + c * r->capacity + r->filled;
+        if (!in) {
+            memset(dst, 0, count * sizeof(float));
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) dst[i] = in[i * r->channels + c];
+    }
+    r->filled += count;
+    return count;
+}
+
+size_t resampler_process(Resampler* resampler, const float* in, size_t in_frames,
+                         size_t* consumed, float* out, size_t out_frames) {
+    size_t produced = 0;
+    size_t used = 0;
+
+    for (;;) {
+        produced += produce(resampler, out + produced * resampler->channels, out_frames - produced, UINT64_MAX);
+        if (produced == out_frames || used == in_frames) break;
+
+        used += refill(resampler, in + used * resampler->channels, in_frames - used);
+    }
+
+    resampler->input_total += used;
+    *consumed = used;
+    return produced;
+}
+
+size_t resampler_drain(Resampler* resampler, float* out, size_t out_frames) {
+    // Выход обрывается на последнем фрейме, который приходится на вход
+    uint64_t limit = resampler_output_frames(resampler, resampler->input_total);
+    size_t produced = 0;
+
+    for (;;) {
+        produced += produce(resampler, out + produced * resampler->channels, out_frames - produced, limit);
+        if (produced == out_frames || resampler->output_total >= limit) break;
+
+        // Нулей после входа нужно на половину фильтра
+        refill(resampler, NULL, resampler->taps / 2);
+    }
+    return produced;
+}
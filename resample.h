@@ -0,0 +1,48 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Передискретизация многофазным фильтром sinc с окном Кайзера.
+// Отношение частот хранится точной дробью up/down, фазы берутся из таблицы.
+// Если фаз получается слишком много (например, 44100 -> 47999), таблица
+// прореживается и коэффициенты интерполируются между соседними фазами.
+// Вход и выход - interleaved float
+
+typedef enum {
+    RESAMPLE_QUALITY_LOW,       // 16 отводов, подавление ~60 дБ
+    RESAMPLE_QUALITY_MEDIUM,    // 32 отвода, ~80 дБ
+    RESAMPLE_QUALITY_HIGH,      // 64 отвода, ~100 дБ
+    RESAMPLE_QUALITY_BEST       // 128 отводов, ~120 дБ
+} ResampleQuality;
+
+#define RESAMPLE_DEFAULT_QUALITY RESAMPLE_QUALITY_HIGH
+
+typedef struct Resampler Resampler;
+
+Resampler* resampler_create(int in_rate, int out_rate, int channels, ResampleQuality quality);
+void resampler_destroy(Resampler* resampler);
+
+// Обработка in_frames входных фреймов, не больше out_frames выходных.
+// consumed получает число забранных входных фреймов. Вход, который не
+// поместился, нужно передать в следующий вызов
+size_t resampler_process(Resampler* resampler, const float* in, size_t in_frames,
+                         size_t* consumed, float* out, size_t out_frames);
+
+// Конец входа: выдает хвост фильтра. 0 - все выдано
+size_t resampler_drain(Resampler* resampler, float* out, size_t out_frames);
+
+// Сброс истории для перемотки и нового потока той же частоты
+void resampler_reset(Resampler* resampler);
+
+// Задержка фильтра во входных фреймах: вход доходит до выхода с этим запаздыванием
+int resampler_latency(const Resampler* resampler);
+
+// Число выходных фреймов для in_frames входных
+uint64_t resampler_output_frames(const Resampler* resampler, uint64_t in_frames);
+
+bool resample_quality_from_name(const char* name, ResampleQuality* quality);
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Кольцевой буфер без блокировок для одного писателя и одного читателя.
+// Позиции - монотонные счетчики элементов, емкость - степень двойки.
+// Писатель меняет только write_pos, читатель только read_pos.
+
+typedef struct {
+    unsigned char* data;
+    size_t capacity;
+    size_t mask;
+    size_t item_size;
+    _Atomic size_t write_pos;
+    _Atomic size_t read_pos;
+} RingBuffer;
+
+static inline size_t ring_capacity_for(size_t min_items) {
+    size_t capacity = 1;
+    while (capacity < min_items) capacity <<= 1;
+    return capacity;
+}
+
+// Кольцо поверх готовой памяти на capacity элементов (степень двойки).
+// Память освобождает ее владелец, а не ring_free
+static inline void ring_init_storage(RingBuffer* ring, void* data, size_t capacity, size_t item_size) {
+    ring->data = data;
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    ring->item_size = item_size;
+    atomic_init(&ring->write_pos, 0);
+    atomic_init(&ring->read_pos, 0);
+}
+
+static inline bool ring_init(RingBuffer* ring, size_t min_items, size_t item_size) {
+    size_t capacity = ring_capacity_for(min_items);
+    void* data = malloc(capacity * item_size);
+    if (!data) return false;
+
+    ring_init_storage(ring, data, capacity, item_size);
+    return true;
+}
+
+static inline void ring_free(RingBuffer* ring) {
+    free(ring->data);
+    ring->data = NULL;
+}
+
+// Сторона читателя
+
+static inline size_t ring_readable(RingBuffer* ring) {
+    size_t write_pos = atomic_load_explicit(&ring->write_pos, memory_order_acquire);
+    return write_pos - atomic_load_explicit(&ring->read_pos, memory_order_relaxed);
+}
+
+static inline size_t ring_read_position(RingBuffer* ring) {
+    return atomic_load_explicit(&ring->read_pos, memory_order_relaxed);
+}
+
+// Непрерывный участок для чтения без копирования
+static inline size_t ring_read_region(RingBuffer* ring, void** ptr) {
+    size_t read_pos = atomic_load_explicit(&ring->read_pos, memory_order_relaxed);
+    size_t available = ring_readable(ring);
+    size_t offset = read_pos & ring->mask;
+    size_t contiguous = ring->capacity - offset;
+
+    *ptr = ring->data + offset * ring->item_size;
+    return available < contiguous ? available : contiguous;
+}
+
+// Элемент index от текущей позиции чтения (index < ring_readable)
+static inline void* ring_peek(RingBuffer* ring, size_t index) {
+    size_t read_pos = atomic_load_explicit(&ring->read_pos, memory_order_relaxed);
+    return ring->data + ((read_pos + index) & ring->mask) * ring->item_size;
+}
+
+static inline void ring_commit_read(RingBuffer* ring, size_t items) {
+    atomic_fetch_add_explicit(&ring->read_pos, items, memory_order_release);
+}
+
+// Пропуск всех данных до позиции pos (pos не дальше позиции записи)
+static inline void ring_skip_to(RingBuffer* ring, size_t pos) {
+    atomic_store_explicit(&ring->read_pos, pos, memory_order_release);
+}
+
+// Сторона писателя
+
+static inline size_t ring_writable(RingBuffer* ring) {
+    size_t read_pos = atomic_load_explicit(&ring->read_pos, memory_order_acquire);
+    return ring->capacity - (atomic_load_explicit(&ring->write_pos, memory_order_relaxed) - read_pos);
+}
+
+static inline size_t ring_write_position(RingBuffer* ring) {
+    return atomic_load_explicit(&ring->write_pos, memory_order_relaxed);
+}
+
+// Непрерывный участок для записи: декодер пишет прямо в кольцо
+static inline size_t ring_write_region(RingBuffer* ring, void** ptr) {
+    size_t write_pos = atomic_load_explicit(&ring->write_pos, memory_order_relaxed);
+    size_t available = ring_writable(ring);
+    size_t offset = write_pos & ring->mask;
+    size_t contiguous = ring->capacity - offset;
+
+    *ptr = ring->data + offset * ring->item_size;
+    return available < contiguous ? available : contiguous;
+}
+
+static inline void ring_commit_write(RingBuffer* ring, size_t items) {
+    atomic_fetch_add_explicit(&ring->write_pos, items, memory_order_release);
+}
+
+static inline bool ring_push(RingBuffer* ring, const void* item) {
+    void* ptr;
+    if (ring_write_region(ring, &ptr) == 0) return false;
+
+    memcpy(ptr, item, ring->item_size);
+    ring_commit_write(ring, 1);
+    return true;
+}
+
+#endif
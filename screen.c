@@ -0,0 +1,245 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "screen.h"
+
+#define DEFAULT_WIDTH 80
+#define DEFAULT_HEIGHT 24
+#define MAX_SKIP_CELLS 4   // Короче последовательности перемещения курсора: проще дописать ячейки
+#define MOVE_MAX_BYTES 16  // \033[row;colH
+
+// Байты символа UTF-8, упакованные в одно слово, чтобы сравнивать ячейки целиком.
+// 0 не встречается в кадре и помечает ячейки, которые надо перерисовать
+typedef uint32_t Cell;
+
+#define CELL_BLANK ((Cell)' ')
+
+static struct {
+    int width;
+    int height;
+    Cell* back;        // Собираемый кадр
+    Cell* front;       // Что сейчас на терминале
+    char* output;      // Разница кадров перед write
+} screen;
+
+static void invalidate_front(void) {
+    memset(screen.front, 0, (size_t)screen.width * screen.height * sizeof(Cell));
+}
+
+static bool allocate(int width, int height) {
+    size_t cells = (size_t)width * height;
+    Cell* back = malloc(cells * sizeof(Cell));
+    Cell* front = malloc(cells * sizeof(Cell));
+    // Худший случай: перемещение курсора перед каждой ячейкой
+    size_t output_size = cells * (sizeof(Cell) + MOVE_MAX_BYTES) + MOVE_MAX_BYTES;
+    char* output = malloc(output_size);
+    if (!back || !front || !output) {
+        free(back);
+        free(front);
+        free(output);
+        return false;
+    }
+
+    free(screen.back);
+    free(screen.front);
+    free(screen.output);
+    screen.back = back;
+    screen.front = front;
+    screen.output = output;
+    screen.width = width;
+    screen.height = height;
+
+    screen_clear();
+    invalidate_front();
+    return true;
+}
+
+static void query_size(int* width, int* height) {
+    struct winsize w;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_col > 0 && w.ws_row > 0) {
+        *width = w.ws_col;
+        *height = w.ws_row;
+    } else {
+        *width = DEFAULT_WIDTH;
+        *height = DEFAULT_HEIGHT;
+    }
+}
+
+// stdout делит файл терминала с неблокирующим stdin, поэтому write может вернуть EAGAIN
+static void write_all(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, size);
+        if (written > 0) {
+            data += written;
+            size -= written;
+        } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd out = { .fd = STDOUT_FILENO, .events = POLLOUT };
+            poll(&out, 1, -1);
+        } else if (written < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return;
+        }
+    }
+}
+
+bool screen_init(void) {
+    int width, height;
+    query_size(&width, &height);
+    if (!allocate(width, height)) return false;
+
+    // Курсор не мигает по экрану во время вывода кадра
+    fflush(stdout);
+    write_all("\033[?25l\033[2J", 10);
+    return true;
+}
+
+void screen_shutdown(void) {
+    if (screen.back) write_all("\033[?25h\033[2J\033[H", 13);
+    free(screen.back);
+    free(screen.front);
+    free(screen.output);
+    memset(&screen, 0, sizeof(screen));
+}
+
+void screen_resize(void) {
+    int width, height;
+    query_size(&width, &height);
+    if (width != screen.width || height != screen.height) {
+        // Без памяти остаемся на старом размере, кадр просто обрежется
+        allocate(width, height);
+    }
+    screen_invalidate();
+}
+
+void screen_invalidate(void) {
+    if (screen.front) invalidate_front();
+}
+
+int screen_width(void) {
+    return screen.width;
+}
+
+int screen_height(void) {
+    return screen.height;
+}
+
+void screen_clear(void) {
+    size_t cells = (size_t)screen.width * screen.height;
+    for (size_t i = 0; i < cells; i++) screen.back[i] = CELL_BLANK;
+}
+
+// Длина символа по первому байту, 0 для байта, с которого символ начаться не может
+static int utf8_length(unsigned char lead) {
+    if (lead < 0x80) return 1;
+    if (lead >= 0xC2 && lead <= 0xDF) return 2;
+    if (lead >= 0xE0 && lead <= 0xEF) return 3;
+    if (lead >= 0xF0 && lead <= 0xF4) return 4;
+    return 0;
+}
+
+// Следующий символ строки в виде ячейки. Управляющие и битые байты заменяются на '?'
+static Cell next_cell(const char** text) {
+    const unsigned char* p = (const unsigned char*)*text;
+    int length = utf8_length(p[0]);
+    for (int i = 1; i < length; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            length = 0;
+            break;
+        }
+    }
+
+    if (length == 0 || p[0] < 0x20 || p[0] == 0x7F) {
+        *text += 1;
+        return (Cell)'?';
+    }
+
+    Cell cell = 0;
+    memcpy(&cell, p, length);
+    *text += length;
+    return cell;
+}
+
+int screen_put(int row, int col, const char* text, int max_cols) {
+    if (row < 0 || row >= screen.height || col < 0 || col >= screen.width) return 0;
+    if (max_cols > screen.width - col) max_cols = screen.width - col;
+
+    Cell* line = screen.back + (size_t)row * screen.width + col;
+    int written = 0;
+    while (*text && written < max_cols) {
+        line[written++] = next_cell(&text);
+    }
+    return written;
+}
+
+int screen_printf(int row, int col, int max_cols, const char* format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return screen_put(row, col, buffer, max_cols);
+}
+
+void screen_fill(int row, int col, int count, char c) {
+    if (row < 0 || row >= screen.height || col < 0 || col >= screen.width) return;
+    if (count > screen.width - col) count = screen.width - col;
+
+    Cell* line = screen.back + (size_t)row * screen.width + col;
+    for (int i = 0; i < count; i++) line[i] = (Cell)(unsigned char)c;
+}
+
+int screen_text_width(const char* text) {
+    int width = 0;
+    while (*text) {
+        next_cell(&text);
+        width++;
+    }
+    return width;
+}
+
+static size_t emit_cell(char* out, Cell cell) {
+    const char* bytes = (const char*)&cell;
+    size_t length = utf8_length((unsigned char)bytes[0]);
+    memcpy(out, bytes, length);
+    return length;
+}
+
+void screen_flush(void) {
+    char* out = screen.output;
+    size_t length = 0;
+    // Где курсор терминала, -1 если неизвестно
+    int cursor_row = -1, cursor_col = -1;
+
+    for (int row = 0; row < screen.height; row++) {
+        Cell* back = screen.back + (size_t)row * screen.width;
+        Cell* front = screen.front + (size_t)row * screen.width;
+
+        for (int col = 0; col < screen.width; col++) {
+            if (back[col] == front[col]) continue;
+
+            int gap = col - cursor_col;
+            if (row == cursor_row && gap >= 0 && gap <= MAX_SKIP_CELLS) {
+                // Несколько совпавших ячеек дешевле переписать, чем перескочить
+                for (int i = cursor_col; i < col; i++) length += emit_cell(out + length, back[i]);
+            } else {
+                length += snprintf(out + length, MOVE_MAX_BYTES, "\033[%d;%dH", row + 1, col + 1);
+            }
+
+            length += emit_cell(out + length, back[col]);
+            front[col] = back[col];
+            cursor_row = row;
+            // После последней колонки терминал может перенести курсор, позиция неизвестна
+            cursor_col = col + 1 < screen.width ? col + 1 : -1;
+            if (cursor_col < 0) cursor_row = -1;
+        }
+    }
+
+    if (length > 0) write_all(out, length);
+}
@@ -0,0 +1,40 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stdbool.h>
+
+// Экран с двойной буферизацией. Кадр собирается в памяти, сравнивается
+// с предыдущим, и в терминал одним write уходят только изменившиеся ячейки.
+// Ячейка - один символ UTF-8, широкие символы считаются за одну колонку
+
+bool screen_init(void);
+void screen_shutdown(void);
+
+// Перечитать размер терминала (по SIGWINCH). Следующий кадр рисуется целиком
+void screen_resize(void);
+
+// Содержимое терминала изменили в обход экрана: перерисовать все
+void screen_invalidate(void);
+
+int screen_width(void);
+int screen_height(void);
+
+// Начало кадра: задний буфер заполняется пробелами
+void screen_clear(void);
+
+// Текст с позиции row, col не длиннее max_cols колонок и до края экрана.
+// Возвращает число занятых колонок
+int screen_put(int row, int col, const char* text, int max_cols);
+int screen_printf(int row, int col, int max_cols, const char* format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+// count одинаковых символов ASCII подряд
+void screen_fill(int row, int col, int count, char c);
+
+// Ширина строки UTF-8 в колонках
+int screen_text_width(const char* text);
+
+// Вывод разницы между кадрами, после него терминал совпадает с задним буфером
+void screen_flush(void);
+
+#endif
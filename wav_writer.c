@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wav_writer.h"
+
+#define WAVE_FORMAT_PCM        0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAV_MAX_DATA_SIZE 0xFFFFFFD0u   // Чтобы размер RIFF не переполнил 32 бита
+
+struct WavWriter {
+    FILE* file;
+    int sample_rate;
+    int channels;
+    OutputFormat format;
+    size_t frame_bytes;
+    uint64_t data_bytes;
+    bool failed;
+};
+
+static void write_le16(unsigned char* p, uint16_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void write_le32(unsigned char* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = value >> (8 * i);
+}
+
+static size_t sample_bytes(OutputFormat format) {
+    return format == OUTPUT_FORMAT_S16 ? 2 : 4;
+}
+
+static bool write_header(WavWriter* writer) {
+    uint32_t data_size = writer->data_bytes > WAV_MAX_DATA_SIZE ? WAV_MAX_DATA_SIZE : (uint32_t)writer->data_bytes;
+    size_t bytes = sample_bytes(writer->format);
+    unsigned char header[44];
+
+    memcpy(header, "RIFF", 4);
+    write_le32(header + 4, 36 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    write_le32(header + 16, 16);
+    write_le16(header + 20, writer->format == OUTPUT_FORMAT_FLOAT32 ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    write_le16(header + 22, writer->channels);
+    write_le32(header + 24, writer->sample_rate);
+    write_le32(header + 28, writer->sample_rate * writer->frame_bytes);
+    write_le16(header + 32, writer->frame_bytes);
+    write_le16(header + 34, bytes * 8);
+    memcpy(header + 36, "data", 4);
+    write_le32(header + 40, data_size);
+
+    return fseek(writer->file, 0, SEEK_SET) == 0 &&
+           fwrite(header, 1, sizeof(header), writer->file) == sizeof(header) &&
+           fseek(writer->file, 0, SEEK_END) == 0;
+}
+
+WavWriter* wav_writer_open(const char* path, int sample_rate, int channels, OutputFormat format) {
+    WavWriter* writer = calloc(1, sizeof(WavWriter));
+    if (!writer) return NULL;
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        fprintf(stderr, "Cannot open output file: %s\n", path);
+        free(writer);
+        return NULL;
+    }
+
+    writer->sample_rate = sample_rate;
+    writer->channels = channels;
+    writer->format = format;
+    writer->frame_bytes = sample_bytes(format) * channels;
+
+    if (!write_header(writer)) {
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+bool wav_writer_write(WavWriter* writer, const void* frames, size_t count) {
+    if (fwrite(frames, writer->frame_bytes, count, writer->file) != count) {
+        writer->failed = true;
+        return false;
+    }
+    writer->data_bytes += count * writer->frame_bytes;
+    return true;
+}
+
+bool wav_writer_sync(WavWriter* writer) {
+    if (!write_header(writer) || fflush(writer->file) != 0) writer->failed = true;
+    return !writer->failed;
+}
+
+bool wav_writer_close(WavWriter* writer) {
+    if (!writer) return false;
+
+    bool ok = wav_writer_sync(writer);
+    if (fclose(writer->file) != 0) ok = false;
+    free(writer);
+    return ok;
+}
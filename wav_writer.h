@@ -0,0 +1,24 @@
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "output.h"
+
+// Запись WAV в формате вывода: float 32 (WAVE_FORMAT_IEEE_FLOAT), int32 или int16.
+// Размеры в заголовке обновляются по wav_writer_sync и при закрытии,
+// поэтому недописанный файл тоже читается
+
+typedef struct WavWriter WavWriter;
+
+WavWriter* wav_writer_open(const char* path, int sample_rate, int channels, OutputFormat format);
+
+// count фреймов interleaved в формате, заданном при открытии
+bool wav_writer_write(WavWriter* writer, const void* frames, size_t count);
+
+bool wav_writer_sync(WavWriter* writer);
+
+// false, если какая-то запись не удалась
+bool wav_writer_close(WavWriter* writer);
+
+#endif